@@ -427,6 +427,46 @@ uint32_t efc_perform_fcr(Efc *p_efc, uint32_t ul_fcr)
 	return (ul_status & EEFC_ERROR_FLAGS);
 }
 
+/**
+ * \brief Start a command and return without waiting for it to complete.
+ *
+ * \note Interrupts are left enabled. Until efc_wait_ready() reports the
+ * command has finished, the caller and every enabled interrupt handler
+ * (including its vector fetch) must execute from SRAM.
+ *
+ * \param p_efc Pointer to an EFC instance.
+ * \param ul_command Command to perform.
+ * \param ul_argument Command argument.
+ */
+__no_inline
+RAMFUNC
+void efc_start_command(Efc *p_efc, uint32_t ul_command,
+		uint32_t ul_argument)
+{
+	p_efc->EEFC_FCR = EEFC_FCR_FKEY_PASSWD | EEFC_FCR_FARG(ul_argument) |
+			EEFC_FCR_FCMD(ul_command);
+}
+
+/**
+ * \brief Wait for the command started by efc_start_command() to complete.
+ *
+ * \param p_efc Pointer to an EFC instance.
+ *
+ * \return The error flags of the completed command.
+ */
+__no_inline
+RAMFUNC
+uint32_t efc_wait_ready(Efc *p_efc)
+{
+	volatile uint32_t ul_status;
+
+	do {
+		ul_status = p_efc->EEFC_FSR;
+	} while ((ul_status & EEFC_FSR_FRDY) != EEFC_FSR_FRDY);
+
+	return (ul_status & EEFC_ERROR_FLAGS);
+}
+
 //@}
 
 /// @cond 0
@@ -138,6 +138,9 @@ uint32_t efc_get_result(Efc *p_efc);
 uint32_t efc_perform_read_sequence(Efc *p_efc,
 		uint32_t ul_cmd_st, uint32_t ul_cmd_sp,
 		uint32_t *p_ul_buf, uint32_t ul_size);
+void efc_start_command(Efc *p_efc, uint32_t ul_command,
+		uint32_t ul_argument);
+uint32_t efc_wait_ready(Efc *p_efc);
 
 /// @cond 0
 /**INDENT-OFF**/
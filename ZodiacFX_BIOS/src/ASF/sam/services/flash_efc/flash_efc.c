@@ -583,6 +583,111 @@ uint32_t flash_erase_sector(uint32_t ul_address)
 
 	return FLASH_RC_OK;
 }
+
+/**
+ * \brief Wait until the flash controller has finished the last command.
+ *
+ * \return 0 if the last command succeeded, otherwise returns an error code.
+ */
+__no_inline
+RAMFUNC
+uint32_t flash_wait_ready(void)
+{
+	if (efc_wait_ready(EFC)) {
+		return FLASH_RC_ERROR;
+	}
+
+	return FLASH_RC_OK;
+}
+
+/**
+ * \brief Start erasing the flash sector without waiting for completion.
+ *
+ * \note Interrupts stay enabled while the sector is erased. The caller and
+ * any enabled interrupt handler must run from SRAM until flash_wait_ready()
+ * returns.
+ *
+ * \param ul_address Flash sector start address.
+ *
+ * \return 0 if successful; otherwise returns an error code.
+ */
+__no_inline
+RAMFUNC
+uint32_t flash_erase_sector_start(uint32_t ul_address)
+{
+	if (flash_wait_ready() != FLASH_RC_OK) {
+		return FLASH_RC_ERROR;
+	}
+
+	efc_start_command(EFC, EFC_FCMD_ES,
+			(ul_address - IFLASH_ADDR) / IFLASH_PAGE_SIZE);
+
+	return FLASH_RC_OK;
+}
+
+/**
+ * \brief Load a full page into the write latch and start programming it,
+ * without waiting for completion.
+ *
+ * \note Interrupts stay enabled while the page is programmed. The caller and
+ * any enabled interrupt handler must run from SRAM until flash_wait_ready()
+ * returns.
+ *
+ * \param ul_address Page aligned write address.
+ * \param pul_buffer Word aligned page data (IFLASH_PAGE_SIZE bytes).
+ *
+ * \return 0 if successful; otherwise returns an error code.
+ */
+__no_inline
+RAMFUNC
+uint32_t flash_write_page_start(uint32_t ul_address,
+		const uint32_t *pul_buffer)
+{
+	uint32_t ul_idx;
+	uint32_t *p_aligned_dest = (uint32_t *) ul_address;
+
+	if (ul_address % IFLASH_PAGE_SIZE) {
+		return FLASH_RC_INVALID;
+	}
+
+	/* The latch cannot be loaded while the previous command runs. */
+	if (flash_wait_ready() != FLASH_RC_OK) {
+		return FLASH_RC_ERROR;
+	}
+
+	for (ul_idx = 0; ul_idx < (IFLASH_PAGE_SIZE / sizeof(uint32_t));
+			++ul_idx) {
+		*p_aligned_dest++ = pul_buffer[ul_idx];
+	}
+
+	return flash_program_latch_start(ul_address);
+}
+
+/**
+ * \brief Start programming a page whose data the caller has already written
+ * into the write latch, without waiting for completion.
+ *
+ * \note The latch is loaded by 32-bit writes to the target page addresses,
+ * after flash_wait_ready() has returned. Interrupts stay enabled while the
+ * page is programmed.
+ *
+ * \param ul_address Page aligned write address.
+ *
+ * \return 0 if successful; otherwise returns an error code.
+ */
+__no_inline
+RAMFUNC
+uint32_t flash_program_latch_start(uint32_t ul_address)
+{
+	if (ul_address % IFLASH_PAGE_SIZE) {
+		return FLASH_RC_INVALID;
+	}
+
+	efc_start_command(EFC, EFC_FCMD_WP,
+			(ul_address - IFLASH_ADDR) / IFLASH_PAGE_SIZE);
+
+	return FLASH_RC_OK;
+}
 #endif
 
 /**
@@ -683,6 +788,53 @@ uint32_t flash_write(uint32_t ul_address, const void *p_buffer,
 }
 
 
+/**
+ * \brief Write whole pages from a word aligned buffer.
+ *
+ * \note Unlike flash_write(), the data is copied straight into the write
+ * latch, without going through the alignment page buffer. The address must
+ * be page aligned and the size a multiple of the page size.
+ *
+ * \param ul_address Page aligned write address.
+ * \param pul_buffer Word aligned data buffer.
+ * \param ul_size Size of data buffer in bytes.
+ *
+ * \return 0 if successful, otherwise returns an error code.
+ */
+uint32_t flash_write_aligned(uint32_t ul_address, const uint32_t *pul_buffer,
+		uint32_t ul_size)
+{
+	Efc *p_efc;
+	uint16_t us_page;
+	uint16_t us_offset;
+	uint32_t ul_error;
+	uint32_t ul_idx;
+	uint32_t *p_aligned_dest = (uint32_t *) ul_address;
+
+	translate_address(&p_efc, ul_address, &us_page, &us_offset);
+
+	if (us_offset || (ul_size % IFLASH_PAGE_SIZE)) {
+		return FLASH_RC_INVALID;
+	}
+
+	while (ul_size > 0) {
+		for (ul_idx = 0; ul_idx < (IFLASH_PAGE_SIZE / sizeof(uint32_t));
+				++ul_idx) {
+			*p_aligned_dest++ = *pul_buffer++;
+		}
+
+		ul_error = efc_perform_command(p_efc, EFC_FCMD_WP, us_page);
+		if (ul_error) {
+			return ul_error;
+		}
+
+		ul_size -= IFLASH_PAGE_SIZE;
+		us_page++;
+	}
+
+	return FLASH_RC_OK;
+}
+
 /**
  * \brief Lock all the regions in the given address range. The actual lock
  * range is reported through two output parameters.
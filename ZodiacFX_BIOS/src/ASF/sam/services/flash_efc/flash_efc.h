@@ -113,10 +113,29 @@ uint32_t flash_erase_plane(uint32_t ul_address);
 	 SAMV71 || SAMV70 || SAMS70 || SAME70)
 uint32_t flash_erase_page(uint32_t ul_address, uint8_t uc_page_num);
 uint32_t flash_erase_sector(uint32_t ul_address);
+uint32_t flash_wait_ready(void);
+uint32_t flash_erase_sector_start(uint32_t ul_address);
+uint32_t flash_write_page_start(uint32_t ul_address,
+		const uint32_t *pul_buffer);
+uint32_t flash_program_latch_start(uint32_t ul_address);
+
+/**
+ * \brief Store one word in the flash write latch.
+ *
+ * \param ul_address Word aligned flash address the word will be programmed to.
+ * \param ul_data Word to store.
+ */
+static __always_inline void flash_latch_write(uint32_t ul_address,
+		uint32_t ul_data)
+{
+	*(volatile uint32_t *)ul_address = ul_data;
+}
 #endif
 
 uint32_t flash_write(uint32_t ul_address, const void *p_buffer,
 		uint32_t ul_size, uint32_t ul_erase_flag);
+uint32_t flash_write_aligned(uint32_t ul_address, const uint32_t *pul_buffer,
+		uint32_t ul_size);
 uint32_t flash_lock(uint32_t ul_start, uint32_t ul_end,
 		uint32_t *pul_actual_start, uint32_t *pul_actual_end);
 uint32_t flash_unlock(uint32_t ul_start, uint32_t ul_end,
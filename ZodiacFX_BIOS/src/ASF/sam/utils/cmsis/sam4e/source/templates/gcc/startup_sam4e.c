@@ -64,6 +64,8 @@ extern uint32_t _estack;
 
 /** \cond DOXYGEN_SHOULD_SKIP_THIS */
 int main(void);
+void boot_time_reset(void);
+void boot_fast_path(void);
 /** \endcond */
 
 void __libc_init_array(void);
@@ -180,6 +182,12 @@ void Reset_Handler(void)
 {
 	uint32_t *pSrc, *pDest;
 
+	/* Start the boot timer, it only touches .noinit */
+	boot_time_reset();
+
+	/* Straight to the firmware unless an update is pending */
+	boot_fast_path();
+
 	/* Initialize the relocate segment */
 	pSrc = &_etext;
 	pDest = &_srelocate;
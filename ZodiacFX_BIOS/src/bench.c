@@ -0,0 +1,227 @@
+/**
+ * @file
+ * bench.c
+ *
+ * This file contains the on-device benchmark functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "bench.h"
+#include "flash.h"
+#include "perf.h"
+#include "slot.h"
+
+// Internal Functions
+static uint32_t bench_program(uint32_t buffer, uint32_t source);
+static void bench_print_header(void);
+static void bench_print(const char *name, uint32_t cycles, uint32_t bytes);
+
+/*
+*	Print the result table header
+*
+*/
+static void bench_print_header(void)
+{
+	printf("\r\n");
+	printf("%-20s %12s %10s %10s\r\n", "Test", "Cycles", "Time(us)", "KB/s");
+	printf("-------------------------------------------------------\r\n");
+}
+
+/*
+*	Print one row of the result table
+*
+*	@param name - test name
+*	@param cycles - elapsed CPU cycles
+*	@param bytes - bytes processed, or 0 if no rate applies
+*/
+static void bench_print(const char *name, uint32_t cycles, uint32_t bytes)
+{
+	uint32_t cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+	uint32_t usec = cycles / cycles_per_us;
+	uint32_t kbps = 0;
+	
+	if (bytes > 0 && usec > 0)
+	{
+		kbps = (uint32_t)(((uint64_t)bytes * 1000000 / 1024) / usec);
+	}
+	
+	printf("%-20s %12lu %10lu %10lu\r\n", name, (unsigned long)cycles,
+	(unsigned long)usec, (unsigned long)kbps);
+}
+
+/*
+*	Program BENCH_PAGES pages of the buffer from the running firmware
+*
+*	Runs from SRAM, since each page write returns with the EFC busy.
+*
+*	@param buffer - first page to program, erased
+*	@param source - data to program
+*/
+RAMFUNC
+static uint32_t bench_program(uint32_t buffer, uint32_t source)
+{
+	uint32_t rc = FLASH_RC_OK;
+	
+	for (uint32_t offset = 0; rc == FLASH_RC_OK && offset < BENCH_PAGES * IFLASH_PAGE_SIZE; offset += IFLASH_PAGE_SIZE)
+	{
+		rc = flash_write_page_start(buffer + offset, (const uint32_t *)(source + offset));
+		if (rc == FLASH_RC_OK)
+		{
+			rc = flash_wait_ready();
+		}
+	}
+	return rc;
+}
+
+/*
+*	Time flash erase, program and read, and the verification kernel
+*
+*	The update buffer (the staging slot) is used as scratch space and is
+*	left erased. An image in it, a pending update or the A/B rollback
+*	image, is only erased with force. A running image that spans into
+*	the buffer is never touched.
+*
+*	@param force - erase the buffer if it is not blank
+*/
+void bench_flash(int force)
+{
+	uint32_t start, cycles;
+	uint32_t rc;
+	volatile uint32_t sink = 0;
+	const uint32_t *read_ptr;
+	uint32_t store = slot_base(slot_active());
+	uint32_t store_end = slot_end(slot_active());
+	uint32_t buffer = slot_base(slot_staging());
+	
+	if (slot_spanned())
+	{
+		printf("The running firmware fills the update buffer too\r\n");
+		return;
+	}
+	if (!force && !flash_region_blank(buffer, slot_end(slot_staging())))
+	{
+		printf("The update buffer holds an image, 'bench force' erases it\r\n");
+		return;
+	}
+	
+	perf_cycles_init();
+	bench_print_header();
+	
+	// Verification kernel over the running firmware slot
+	start = DWT->CYCCNT;
+	verification_check_region(store, store_end);
+	cycles = DWT->CYCCNT - start;
+	bench_print("verify slot", cycles, store_end - store);
+	
+	// 128-bit flash reads over the running firmware slot
+	read_ptr = (const uint32_t *)store;
+	start = DWT->CYCCNT;
+	while (read_ptr < (const uint32_t *)store_end)
+	{
+		sink += read_ptr[0] ^ read_ptr[1] ^ read_ptr[2] ^ read_ptr[3];
+		read_ptr += 4;
+	}
+	cycles = DWT->CYCCNT - start;
+	bench_print("flash read 128-bit", cycles, store_end - store);
+	
+	// Unlock the buffer, erasing it only if it was not blank
+	if (!firmware_buffer_prepare())
+	{
+		printf("Flash error during benchmark\r\n");
+		return;
+	}
+	
+	// Program pages, using the running firmware as the data source
+	start = DWT->CYCCNT;
+	rc = bench_program(buffer, store);
+	cycles = DWT->CYCCNT - start;
+	bench_print("page program", cycles / BENCH_PAGES, IFLASH_PAGE_SIZE);
+	
+	// Erase the sector just programmed, which leaves the buffer empty
+	start = DWT->CYCCNT;
+	if (flash_erase_region(buffer, buffer + ERASE_SECTOR_SIZE) != FLASH_RC_OK)
+	{
+		rc = FLASH_RC_ERROR;
+	}
+	cycles = DWT->CYCCNT - start;
+	bench_print("sector erase", cycles, ERASE_SECTOR_SIZE);
+	
+	if (rc != FLASH_RC_OK)
+	{
+		printf("Flash error during benchmark\r\n");
+	}
+	printf("\r\n");
+	return;
+}
+
+/*
+*	Time USB CDC receive and transmit throughput
+*
+*	The host side (tools/bench_usb.py) sends BENCH_USB_LEN bytes once
+*	the ready line is seen, then reads BENCH_USB_LEN bytes back.
+*/
+void bench_usb(void)
+{
+	uint8_t usb_buf[64];
+	uint32_t count = 0;
+	uint32_t start = 0, rx_cycles, tx_cycles;
+	iram_size_t len;
+	
+	perf_cycles_init();
+	printf("BENCH-USB READY %lu\r\n", (unsigned long)BENCH_USB_LEN);
+	
+	// Receive, timed from the first byte
+	while (count < BENCH_USB_LEN)
+	{
+		len = udi_cdc_read_no_polling(usb_buf, sizeof(usb_buf));
+		if (len > 0 && count == 0)
+		{
+			start = DWT->CYCCNT;
+		}
+		count += len;
+	}
+	rx_cycles = DWT->CYCCNT - start;
+	
+	// Transmit
+	memset(usb_buf, 0x55, sizeof(usb_buf));
+	count = 0;
+	start = DWT->CYCCNT;
+	while (count < BENCH_USB_LEN)
+	{
+		udi_cdc_write_buf(usb_buf, sizeof(usb_buf));
+		count += sizeof(usb_buf);
+	}
+	tx_cycles = DWT->CYCCNT - start;
+	
+	bench_print_header();
+	bench_print("usb cdc rx", rx_cycles, BENCH_USB_LEN);
+	bench_print("usb cdc tx", tx_cycles, BENCH_USB_LEN);
+	printf("\r\n");
+	return;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file
+ * bench.h
+ *
+ * This file contains the function declarations for the benchmark functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+void bench_flash(int force);
+void bench_usb(void);
+
+#define BENCH_PAGES		16		// Pages programmed by the page program test
+#define BENCH_USB_LEN	65536	// Bytes moved in each direction by the USB test
+
+#endif /* BENCH_H_ */
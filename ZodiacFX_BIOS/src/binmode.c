@@ -0,0 +1,379 @@
+/**
+ * @file
+ * binmode.c
+ *
+ * binary command mode for host tools
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "binmode.h"
+#include "flash.h"
+#include "slot.h"
+#include "partition.h"
+#include "telemetry.h"
+#include "perf.h"
+#include "dfu.h"
+
+#define BINMODE_BYTE_MS		500		// Gap allowed inside a request
+#define BINMODE_FLUSH_MS	20		// Time for the last reply to leave before a reset
+
+// Global variables
+extern struct verification_data verify;
+extern struct xmodem_stats xmodem_stats;
+
+// Static variables
+static int magic_matched;
+
+// Internal Functions
+static int binmode_read(uint8_t *data, int length);
+static void binmode_reply(uint8_t opcode, uint8_t seq, uint8_t status, const void *payload, uint16_t length);
+static int binmode_request(uint8_t opcode, uint8_t seq, const uint8_t *payload, uint16_t length);
+static void binmode_upload(uint8_t seq);
+static void binmode_dump(uint8_t seq, const uint8_t *payload);
+static uint8_t binmode_slot_flags(int slot);
+
+/*
+*	Look for BINMODE_MAGIC in the characters typed at the prompt
+*
+*	@return 1 when it is complete, -1 for a character that is part of
+*	it, 0 for anything else
+*/
+int binmode_magic(char ch)
+{
+	if (ch == BINMODE_MAGIC[magic_matched])
+	{
+		if (++magic_matched == BINMODE_MAGIC_LEN)
+		{
+			magic_matched = 0;
+			return 1;
+		}
+		return -1;
+	}
+	if (magic_matched > 0 && ch == BINMODE_MAGIC[magic_matched - 1])
+	{
+		return -1;		// One <SYN> more than needed
+	}
+	magic_matched = 0;
+	return 0;
+}
+
+/*
+*	Read the rest of a request
+*
+*/
+static int binmode_read(uint8_t *data, int length)
+{
+	int ch;
+	
+	for (int i = 0; i < length; i++)
+	{
+		ch = cdc_getc_timeout(BINMODE_BYTE_MS);
+		if (ch < 0)
+		{
+			return 0;
+		}
+		data[i] = ch;
+	}
+	return 1;
+}
+
+/*
+*	Send a reply frame
+*
+*/
+static void binmode_reply(uint8_t opcode, uint8_t seq, uint8_t status, const void *payload, uint16_t length)
+{
+	uint8_t header[6] = {BINMODE_SYNC_REPLY, opcode, seq, status, length & 0xFF, length >> 8};
+	uint16_t crc;
+	uint8_t trailer[2];
+	
+	crc = xmodem_crc16(0, header + 1, sizeof(header) - 1);
+	crc = xmodem_crc16(crc, payload, length);
+	trailer[0] = crc & 0xFF;
+	trailer[1] = crc >> 8;
+	
+	udi_cdc_write_buf(header, sizeof(header));
+	if (length > 0)
+	{
+		udi_cdc_write_buf(payload, length);
+	}
+	udi_cdc_write_buf(trailer, sizeof(trailer));
+}
+
+/*
+*	Flags describing a slot
+*
+*/
+static uint8_t binmode_slot_flags(int slot)
+{
+	uint8_t flags = 0;
+	
+	if (slot == slot_active()) flags |= BINMODE_SLOT_ACTIVE;
+	if (*(const uint32_t *)slot_base(slot) == 0xFFFFFFFF) flags |= BINMODE_SLOT_EMPTY;
+	if (slot == slot_staging() && slot_pending()) flags |= BINMODE_SLOT_PENDING;
+	if (slot_holds_stage1(slot)) flags |= BINMODE_SLOT_STAGE1;
+	if (slot != slot_active() && slot_spanned()) flags |= BINMODE_SLOT_SPANNED;
+	return flags;
+}
+
+/*
+*	Receive an image into the staging slot, as 'upload' does
+*
+*/
+static void binmode_upload(uint8_t seq)
+{
+	struct binmode_image image;
+	uint8_t status = BINMODE_OK;
+	int upload_ok;
+	
+	if (dfu_active())
+	{
+		binmode_reply(BINMODE_OP_UPLOAD, seq, BINMODE_ERR_BUSY, NULL, 0);
+		return;
+	}
+	
+	binmode_reply(BINMODE_OP_UPLOAD, seq, BINMODE_OK, NULL, 0);
+	upload_ok = firmware_upload();
+	if (!upload_ok)
+	{
+		status = BINMODE_ERR_TRANSFER;
+	}
+	else if (verification_check() != SUCCESS || !slot_upload_done(verify.length, verify.found))
+	{
+		status = BINMODE_ERR_IMAGE;
+	}
+	telemetry_log_upload(&xmodem_stats, (status == BINMODE_OK) ? 0 : 1 + !upload_ok);
+	
+	image.length = verify.length;
+	image.found = verify.found;
+	image.calculated = verify.calculated;
+	binmode_reply(BINMODE_OP_UPLOAD, seq, status, &image, sizeof(image));
+}
+
+/*
+*	Send a flash range to the host, as 'dump' does
+*
+*/
+static void binmode_dump(uint8_t seq, const uint8_t *payload)
+{
+	struct binmode_transfer transfer;
+	struct xmodem_stats stats;
+	uint32_t start, length;
+	
+	memcpy(&start, payload, sizeof(start));
+	memcpy(&length, payload + 4, sizeof(length));
+	if (start < IFLASH_ADDR || length == 0 || start > flash_end || length > flash_end - start
+		|| start % 16 != 0 || length % 128 != 0)
+	{
+		binmode_reply(BINMODE_OP_DUMP, seq, BINMODE_ERR_RANGE, NULL, 0);
+		return;
+	}
+	
+	binmode_reply(BINMODE_OP_DUMP, seq, BINMODE_OK, NULL, 0);
+	if (!xmodem_send(start, length, &stats))
+	{
+		binmode_reply(BINMODE_OP_DUMP, seq, BINMODE_ERR_TRANSFER, NULL, 0);
+		return;
+	}
+	transfer.bytes = stats.bytes;
+	transfer.blocks = stats.blocks;
+	transfer.naks = stats.naks;
+	transfer.timeouts = stats.timeouts;
+	transfer.total_us = stats.total_cycles / (sysclk_get_cpu_hz() / 1000000);
+	binmode_reply(BINMODE_OP_DUMP, seq, BINMODE_OK, &transfer, sizeof(transfer));
+}
+
+/*
+*	Carry out one request
+*
+*	@return 1 to leave binary mode
+*/
+static int binmode_request(uint8_t opcode, uint8_t seq, const uint8_t *payload, uint16_t length)
+{
+	struct binmode_status status;
+	struct binmode_slot slot;
+	struct binmode_image image;
+	struct binmode_stats stats;
+	struct verification_data scan;
+	uint32_t cyc_per_us = sysclk_get_cpu_hz() / 1000000;
+	uint32_t start;
+	uint16_t expected = 0;
+	
+	switch (opcode)
+	{
+		case BINMODE_OP_SLOT:
+		case BINMODE_OP_VERIFY:
+			expected = 1;
+			break;
+		case BINMODE_OP_DUMP:
+			expected = 8;
+			break;
+	}
+	if (length != expected)
+	{
+		binmode_reply(opcode, seq, BINMODE_ERR_LENGTH, NULL, 0);
+		return 0;
+	}
+	if (expected == 1 && payload[0] >= SLOT_COUNT)
+	{
+		binmode_reply(opcode, seq, BINMODE_ERR_RANGE, NULL, 0);
+		return 0;
+	}
+	
+	switch (opcode)
+	{
+		case BINMODE_OP_STATUS:
+			memset(&status, 0, sizeof(status));
+			strncpy(status.version, VERSION, sizeof(status.version));
+			status.flash_size = flash_end - IFLASH_ADDR;
+			status.active = slot_active();
+			status.staging = slot_staging();
+			status.ab_slots = BIOS_AB_SLOTS;
+			status.trial = slot_trial();
+			binmode_reply(opcode, seq, BINMODE_OK, &status, sizeof(status));
+			break;
+		
+		case BINMODE_OP_SLOT:
+			slot.base = slot_base(payload[0]);
+			slot.size = slot_size(payload[0]);
+			slot.slot = payload[0];
+			slot.flags = binmode_slot_flags(payload[0]);
+			binmode_reply(opcode, seq, BINMODE_OK, &slot, sizeof(slot));
+			break;
+		
+		case BINMODE_OP_UPLOAD:
+			binmode_upload(seq);
+			break;
+		
+		case BINMODE_OP_DUMP:
+			binmode_dump(seq, payload);
+			break;
+		
+		case BINMODE_OP_VERIFY:
+			if (payload[0] == SLOT_A && slot_spanned())
+			{
+				verification_scan(slot_base(SLOT_A), slot_install_end(), &scan);
+			}
+			else
+			{
+				verification_scan(slot_base(payload[0]), slot_end(payload[0]), &scan);
+			}
+			image.length = scan.length;
+			image.found = scan.found;
+			image.calculated = scan.calculated;
+			binmode_reply(opcode, seq, (scan.length > 0 && scan.found == scan.calculated) ? BINMODE_OK : BINMODE_ERR_IMAGE,
+				&image, sizeof(image));
+			break;
+		
+		case BINMODE_OP_RESTART:
+			binmode_reply(opcode, seq, BINMODE_OK, NULL, 0);
+			start = DWT->CYCCNT;
+			while (DWT->CYCCNT - start < (sysclk_get_cpu_hz() / 1000) * BINMODE_FLUSH_MS);
+			restart();
+			break;
+		
+		case BINMODE_OP_STATS:
+			stats.bytes = xmodem_stats.bytes;
+			stats.blocks = xmodem_stats.blocks;
+			stats.naks = xmodem_stats.naks;
+			stats.timeouts = xmodem_stats.timeouts;
+			stats.duplicates = xmodem_stats.duplicates;
+			stats.erase_us = xmodem_stats.erase_cycles / cyc_per_us;
+			stats.program_us = xmodem_stats.program_cycles / cyc_per_us;
+			stats.usb_wait_us = xmodem_stats.usb_wait_cycles / cyc_per_us;
+			stats.total_us = xmodem_stats.total_cycles / cyc_per_us;
+			binmode_reply(opcode, seq, BINMODE_OK, &stats, sizeof(stats));
+			break;
+		
+		case BINMODE_OP_EXIT:
+			binmode_reply(opcode, seq, BINMODE_OK, NULL, 0);
+			return 1;
+		
+		default:
+			binmode_reply(opcode, seq, BINMODE_ERR_OPCODE, NULL, 0);
+			break;
+	}
+	return 0;
+}
+
+/*
+*	Serve binary requests until BINMODE_OP_EXIT or BINMODE_IDLE_MS
+*	without one
+*
+*	Bytes outside a frame are skipped, so text the host sent before the
+*	magic, or a request cut short, is dropped at the next sync byte.
+*/
+void binmode_run(void)
+{
+	uint8_t header[4];		// Opcode, seq, length
+	uint8_t payload[BINMODE_MAX_REQUEST];
+	uint8_t trailer[2];
+	uint16_t length, crc;
+	int ch;
+	
+	perf_cycles_init();
+	while (1)
+	{
+		ch = cdc_getc_timeout(BINMODE_IDLE_MS);
+		if (ch < 0)
+		{
+			return;
+		}
+		if (ch != BINMODE_SYNC_REQUEST || !binmode_read(header, sizeof(header)))
+		{
+			continue;
+		}
+		
+		length = header[2] | (header[3] << 8);
+		if (length > BINMODE_MAX_REQUEST)
+		{
+			binmode_reply(header[0], header[1], BINMODE_ERR_LENGTH, NULL, 0);
+			continue;
+		}
+		if (!binmode_read(payload, length) || !binmode_read(trailer, sizeof(trailer)))
+		{
+			continue;
+		}
+		
+		crc = xmodem_crc16(0, header, sizeof(header));
+		crc = xmodem_crc16(crc, payload, length);
+		if (crc != (trailer[0] | (trailer[1] << 8)))
+		{
+			binmode_reply(header[0], header[1], BINMODE_ERR_CRC, NULL, 0);
+			continue;
+		}
+		
+		if (binmode_request(header[0], header[1], payload, length))
+		{
+			return;
+		}
+	}
+}
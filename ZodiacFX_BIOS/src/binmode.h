@@ -0,0 +1,144 @@
+/**
+ * @file
+ * binmode.h
+ *
+ * binary command mode for host tools
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#ifndef BINMODE_H_
+#define BINMODE_H_
+
+#include <stdint.h>
+
+/*
+*	Host tools drive the BIOS through a binary request/response protocol
+*	on the CDC port instead of the command line. BINMODE_MAGIC, sent at
+*	the prompt, switches to it; there is no echo and no prompt until
+*	BINMODE_OP_EXIT, or BINMODE_IDLE_MS without a request.
+*
+*	Request:	BINMODE_SYNC_REQUEST, opcode, seq, length (16 bit), payload, CRC
+*	Reply:		BINMODE_SYNC_REPLY, opcode, seq, status, length (16 bit), payload, CRC
+*
+*	Numbers are little endian. The CRC is CRC-16/XMODEM of everything
+*	between the sync byte and the CRC. A request with a bad CRC gets a
+*	BINMODE_ERR_CRC reply. seq is echoed so a host can match replies.
+*
+*	Upload and dump reply once when the XMODEM transfer can start, and
+*	again with the result when it has ended. An upload during a DFU
+*	download gets BINMODE_ERR_BUSY instead. A staged image is installed
+*	on the next reset, BINMODE_OP_RESTART.
+*
+*	This header only depends on stdint.h so host tools can use it as it
+*	is; tools/bincmd.py is one.
+*/
+#define BINMODE_MAGIC			"\x16\x16\x16\x02"	// <SYN><SYN><SYN><STX>
+#define BINMODE_MAGIC_LEN		4
+#define BINMODE_SYNC_REQUEST	0xA5
+#define BINMODE_SYNC_REPLY		0xA6
+#define BINMODE_MAX_REQUEST		16		// Payload bytes
+#define BINMODE_IDLE_MS			30000
+
+// Opcodes
+#define BINMODE_OP_STATUS		0x01	// -> struct binmode_status
+#define BINMODE_OP_SLOT			0x02	// slot (8 bit) -> struct binmode_slot
+#define BINMODE_OP_UPLOAD		0x03	// -> ready, XMODEM upload, struct binmode_image
+#define BINMODE_OP_DUMP			0x04	// start, length (32 bit) -> ready, XMODEM send, struct binmode_transfer
+#define BINMODE_OP_VERIFY		0x05	// slot (8 bit) -> struct binmode_image
+#define BINMODE_OP_RESTART		0x06	// -> reply, then reset
+#define BINMODE_OP_STATS		0x07	// -> struct binmode_stats of the last upload
+#define BINMODE_OP_EXIT			0x08	// -> reply, back to the command line
+
+// Status codes
+#define BINMODE_OK				0
+#define BINMODE_ERR_CRC			1	// Request CRC did not match
+#define BINMODE_ERR_OPCODE		2	// Unknown opcode
+#define BINMODE_ERR_LENGTH		3	// Wrong payload length for the opcode
+#define BINMODE_ERR_RANGE		4	// No such slot, or a range outside flash
+#define BINMODE_ERR_TRANSFER	5	// The XMODEM transfer failed
+#define BINMODE_ERR_IMAGE		6	// No image, or its checksum does not match
+#define BINMODE_ERR_BUSY		7	// A DFU download is using the staging slot
+
+// Slot flags
+#define BINMODE_SLOT_ACTIVE		(1 << 0)
+#define BINMODE_SLOT_EMPTY		(1 << 1)
+#define BINMODE_SLOT_PENDING	(1 << 2)	// Installed on the next reset
+#define BINMODE_SLOT_STAGE1		(1 << 3)	// Holds a BIOS stage-1 image
+#define BINMODE_SLOT_SPANNED	(1 << 4)	// End of an image installed by 'upload direct'
+
+struct binmode_status
+{
+	char version[8];
+	uint32_t flash_size;
+	uint8_t active;			// Slot the firmware runs from
+	uint8_t staging;		// Slot uploads go to
+	uint8_t ab_slots;		// BIOS_AB_SLOTS
+	uint8_t trial;			// 1 while an A/B update runs on trial
+} __attribute__ ((packed));
+
+struct binmode_slot
+{
+	uint32_t base;
+	uint32_t size;
+	uint8_t slot;
+	uint8_t flags;			// BINMODE_SLOT_*
+} __attribute__ ((packed));
+
+struct binmode_image
+{
+	uint32_t length;		// Image bytes including the trailer
+	uint32_t found;			// Checksum in the trailer
+	uint32_t calculated;
+} __attribute__ ((packed));
+
+struct binmode_transfer
+{
+	uint32_t bytes;
+	uint32_t blocks;
+	uint32_t naks;
+	uint32_t timeouts;
+	uint32_t total_us;
+} __attribute__ ((packed));
+
+struct binmode_stats
+{
+	uint32_t bytes;			// Payload bytes accepted
+	uint32_t blocks;		// Blocks accepted
+	uint32_t naks;			// Blocks rejected on checksum
+	uint32_t timeouts;		// Timeout <NAK>s once the transfer started
+	uint32_t duplicates;	// Retransmitted blocks already accepted
+	uint32_t erase_us;		// Erasing the buffer before the transfer
+	uint32_t program_us;	// Starting page writes and waiting for the EFC
+	uint32_t usb_wait_us;	// Polling with no data from the host
+	uint32_t total_us;		// First byte to final <ACK>
+} __attribute__ ((packed));
+
+int binmode_magic(char ch);
+void binmode_run(void);
+
+#endif /* BINMODE_H_ */
@@ -0,0 +1,265 @@
+/**
+ * @file
+ * boot.c
+ *
+ * This file contains the boot time instrumentation
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <stddef.h>
+#include "conf_bios.h"
+#include "boot.h"
+#include "handoff.h"
+#include "mailbox.h"
+#include "slot.h"
+
+// Global variables
+// [0] is the boot in progress, [1] the boot before the last reset
+struct boot_times boot_times[2] __attribute__ ((section (".noinit")));
+// Left at HANDOFF_ADDR for the firmware, see flash.ld
+struct boot_handoff boot_handoff __attribute__ ((section (".handoff")));
+
+_Static_assert(BOOT_MARK_COUNT <= HANDOFF_MARKS, "boot marks do not fit the handoff block");
+_Static_assert(sizeof(struct boot_handoff) <= HANDOFF_SIZE, "handoff block too large");
+
+// Local Variables
+static const char * const boot_mark_names[BOOT_MARK_COUNT] =
+{
+#define BOOT_MARK_NAME(id, name) name,
+	BOOT_MARK_LIST(BOOT_MARK_NAME)
+#undef BOOT_MARK_NAME
+};
+
+/*
+*	Core clock the cycle counter is running at
+*
+*	Until sysclk_init() the core runs on the 4 MHz RC oscillator.
+*/
+uint32_t boot_cpu_hz(void)
+{
+	if ((PMC->PMC_MCKR & PMC_MCKR_CSS_Msk) == PMC_MCKR_CSS_MAIN_CLK)
+	{
+		return CHIP_FREQ_MAINCK_RC_4MHZ;
+	}
+	return sysclk_get_cpu_hz();
+}
+
+/*
+*	Start timing a boot
+*
+*	Called first thing in Reset_Handler, before .data and .bss are set
+*	up, so only .noinit and the core registers may be touched here.
+*/
+void boot_time_reset(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	if (boot_times[0].magic == BOOT_TIMES_MAGIC)
+	{
+		boot_times[1] = boot_times[0];
+	}
+	else
+	{
+		boot_times[1].magic = 0;
+	}
+	boot_times[0].magic = BOOT_TIMES_MAGIC;
+	boot_times[0].marked = 1 << BOOT_RESET;
+	boot_times[0].last_cycles = 0;
+	boot_times[0].last_us = 0;
+	boot_times[0].us[BOOT_RESET] = 0;
+}
+
+/*
+*	Jump straight to the firmware when no update is pending
+*
+*	Called from Reset_Handler after boot_time_reset(), before the C
+*	runtime is set up, so it may only read flash and touch .noinit and
+*	the core registers. The clocks are still as they come out of reset.
+*	Returns when the full BIOS is needed: no firmware, an update in the
+*	staging slot, an update on trial or a request in the mailbox.
+*/
+void boot_fast_path(void)
+{
+	const uint32_t *firmware_pmem = (const uint32_t *)slot_base(slot_active());
+	void (*firmware_code_entry)(void);
+	
+	if (slot_pending() || *firmware_pmem == 0xFFFFFFFF || slot_trial() || mailbox_pending())
+	{
+		return;
+	}
+	
+	boot_time_mark(BOOT_JUMP);
+	boot_handoff_begin(HANDOFF_PATH_FAST, NULL, NULL);
+	boot_handoff_finish();
+	firmware_code_entry = (void (*)(void))firmware_pmem[1];
+	SCB->VTOR = ((uint32_t)firmware_pmem & SCB_VTOR_TBLOFF_Msk);
+	__DSB();
+	__ISB();
+	__set_MSP(firmware_pmem[0]);
+	firmware_code_entry();
+}
+
+/*
+*	Start the handoff block for the firmware
+*
+*	serial and image may be NULL when they are not known. Like
+*	boot_fast_path() this must work before the C runtime is set up.
+*/
+void boot_handoff_begin(uint32_t path, const uint32_t *serial, const struct verification_data *image)
+{
+	struct boot_handoff *h = &boot_handoff;
+	const char *version = VERSION;
+	uint32_t *word = (uint32_t *)h;
+	
+	for (int i = 0; i < sizeof(*h) / 4; i++)
+	{
+		word[i] = 0;
+	}
+	h->version = HANDOFF_VERSION;
+	h->size = sizeof(*h);
+	h->reset_cause = rstc_get_reset_cause(RSTC) >> RSTC_SR_RSTTYP_Pos;
+	h->boot_path = path;
+	for (int i = 0; i < sizeof(h->bios_version) - 1 && version[i] != '\0'; i++)
+	{
+		h->bios_version[i] = version[i];
+	}
+	if (serial != NULL)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			h->serial[i] = serial[i];
+		}
+		h->flags |= HANDOFF_SERIAL_VALID;
+	}
+	if (image != NULL)
+	{
+		h->image_length = image->length;
+		h->image_checksum = image->found;
+		h->flags |= HANDOFF_IMAGE_VERIFIED;
+	}
+	if (slot_trial())
+	{
+		h->flags |= HANDOFF_TRIAL_BOOT;
+	}
+}
+
+/*
+*	Copy in the boot times and seal the handoff block, right before the
+*	jump
+*/
+void boot_handoff_finish(void)
+{
+	struct boot_handoff *h = &boot_handoff;
+	const struct boot_times *t = &boot_times[0];
+	const uint32_t *word = (const uint32_t *)h;
+	uint32_t sum = 0;
+	
+	h->boot_marked = t->marked;
+	for (int i = 0; i < BOOT_MARK_COUNT; i++)
+	{
+		h->boot_us[i] = t->us[i];
+	}
+	h->magic = HANDOFF_MAGIC;
+	for (int i = 0; i < offsetof(struct boot_handoff, checksum) / 4; i++)
+	{
+		sum += word[i];
+	}
+	h->checksum = ~sum;
+}
+
+/*
+*	Record that the boot has reached a mark
+*
+*	Marks after the boot has reached the command line or the jump are
+*	ignored, so shared code paths can be marked unconditionally.
+*/
+void boot_time_mark(enum boot_mark mark)
+{
+	struct boot_times *t = &boot_times[0];
+	uint32_t now = DWT->CYCCNT;
+	
+	if (!boot_time_active())
+	{
+		return;
+	}
+	
+	t->us[mark] = t->last_us + (now - t->last_cycles) / (boot_cpu_hz() / 1000000);
+	t->last_cycles = now;
+	t->last_us = t->us[mark];
+	t->marked |= 1 << mark;
+}
+
+/*
+*	Check whether the boot is still being timed
+*
+*/
+int boot_time_active(void)
+{
+	const struct boot_times *t = &boot_times[0];
+	
+	return t->magic == BOOT_TIMES_MAGIC && !(t->marked & ((1 << BOOT_CLI) | (1 << BOOT_JUMP)));
+}
+
+const struct boot_times *boot_times_current(void)
+{
+	return boot_times[0].magic == BOOT_TIMES_MAGIC ? &boot_times[0] : NULL;
+}
+
+const struct boot_times *boot_times_previous(void)
+{
+	return boot_times[1].magic == BOOT_TIMES_MAGIC ? &boot_times[1] : NULL;
+}
+
+/*
+*	Print the marks of the current and previous boots
+*
+*/
+void boot_times_dump(void)
+{
+	const struct boot_times *boots[2] = { boot_times_current(), boot_times_previous() };
+	static const char * const titles[2] = { "This boot", "Previous boot" };
+	
+	for (int b = 0; b < 2; b++)
+	{
+		uint32_t last_us = 0;
+		
+		if (boots[b] == NULL) continue;
+		printf("\r\n%s\r\n", titles[b]);
+		printf("%-22s %12s %12s\r\n", "Mark", "Time(us)", "Delta(us)");
+		printf("------------------------------------------------\r\n");
+		for (int i = 0; i < BOOT_MARK_COUNT; i++)
+		{
+			if (!(boots[b]->marked & (1 << i))) continue;
+			printf("%-22s %12lu %12lu\r\n", boot_mark_names[i], (unsigned long)boots[b]->us[i],
+			(unsigned long)(boots[b]->us[i] - last_us));
+			last_us = boots[b]->us[i];
+		}
+	}
+	printf("\r\n");
+}
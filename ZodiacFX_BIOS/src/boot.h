@@ -0,0 +1,92 @@
+/**
+ * @file
+ * boot.h
+ *
+ * This file contains the boot time instrumentation definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include "conf_bios.h"
+#include "flash.h"
+
+/*
+*	Boot marks, X(id, name), in the order the boot path passes them
+*
+*/
+#define BOOT_MARK_LIST(X) \
+	X(BOOT_RESET,			"reset") \
+	X(BOOT_MAIN,			"main") \
+	X(BOOT_SYSCLK,			"sysclk_init") \
+	X(BOOT_CHECK_START,		"firmware_check") \
+	X(BOOT_VERIFY_START,	"verification_check") \
+	X(BOOT_VERIFY_END,		"verification done") \
+	X(BOOT_CHECK_END,		"check done") \
+	X(BOOT_UPDATE_START,	"firmware_update") \
+	X(BOOT_UPDATE_END,		"update done") \
+	X(BOOT_ERASE_START,		"buffer erase") \
+	X(BOOT_ERASE_END,		"erase done") \
+	X(BOOT_CLI,				"command line") \
+	X(BOOT_JUMP,			"firmware_run jump")
+
+enum boot_mark
+{
+#define BOOT_MARK_ENUM(id, name) id,
+	BOOT_MARK_LIST(BOOT_MARK_ENUM)
+#undef BOOT_MARK_ENUM
+	BOOT_MARK_COUNT
+};
+
+#define BOOT_TIMES_MAGIC	0x42544D32	// "BTM2"
+
+/*
+*	Times are microseconds since reset. Each mark converts the cycles
+*	since the previous mark at the clock running at the time, so a
+*	clock switch must be preceded by a mark.
+*/
+struct boot_times
+{
+	uint32_t magic;
+	uint32_t marked;		// Bit per mark that was reached
+	uint32_t last_cycles;	// DWT cycle count at the previous mark
+	uint32_t last_us;		// Time of the previous mark
+	uint32_t us[BOOT_MARK_COUNT];
+};
+
+void boot_time_reset(void);
+void boot_fast_path(void);
+void boot_handoff_begin(uint32_t path, const uint32_t *serial, const struct verification_data *image);
+void boot_handoff_finish(void);
+void boot_time_mark(enum boot_mark mark);
+int boot_time_active(void);
+const struct boot_times *boot_times_current(void);
+const struct boot_times *boot_times_previous(void);
+void boot_times_dump(void);
+uint32_t boot_cpu_hz(void);
+
+#endif /* BOOT_H_ */
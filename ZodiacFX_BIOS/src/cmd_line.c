@@ -35,13 +35,22 @@
 #include "conf_bios.h"
 #include "cmd_line.h"
 #include "flash.h"
+#include "bench.h"
+#include "perf.h"
+#include "telemetry.h"
+#include "boot.h"
 #include "trace.h"
+#include "slot.h"
+#include "partition.h"
+#include "binmode.h"
+#include "dfu.h"
 
 #define RSTC_KEY  0xA5000000
 
 // Global variables
 extern int charcount, charcount_last;
 extern struct verification_data verify;
+extern struct xmodem_stats xmodem_stats;
 
 // Local Variables
 bool showintro = true;
@@ -49,7 +58,8 @@ uint8_t esc_char = 0;
 uint8_t uCLIContext = 0;
 
 // Internal Functions
-void command_root(char *command, char *param1, char *param2, char *param3);
+static const struct command *command_find(const char *name);
+static void command_dispatch(int argc, char *argv[]);
 void printintro(void);
 
 
@@ -62,15 +72,22 @@ void printintro(void);
 void task_command(char *str, char *str_last)
 {
 	char ch;
-	char *command;
-	char *param1;
-	char *param2;
-	char *param3;
+	char *argv[CMD_MAX_ARGS];
+	int argc;
 	char *pch;
 
 	while(udi_cdc_is_rx_ready()){
 		ch = udi_cdc_getc();
 
+		switch (binmode_magic(ch))	// Host tools switch to binary requests
+		{
+			case 1:
+				binmode_run();
+				printf("Bootloader# ");
+				return;
+			case -1:
+				continue;
+		}
 
 		if (showintro == true)	// Show the intro only on the first key press
 		{
@@ -103,18 +120,17 @@ void task_command(char *str, char *str_last)
 			str[charcount] = '\0';
 			strcpy(str_last, str);
 			charcount_last = charcount;
+			argc = 0;
 			pch = strtok (str," ");
-			command = pch;
-			pch = strtok (NULL, " ");
-			param1 = pch;
-			pch = strtok (NULL, " ");
-			param2 = pch;
-			pch = strtok (NULL, " ");
-			param3 = pch;
-
-			if (charcount > 0)
+			while (pch != NULL && argc < CMD_MAX_ARGS)
+			{
+				argv[argc++] = pch;
+				pch = strtok (NULL, " ");
+			}
+
+			if (argc > 0)
 			{
-				command_root(command, param1, param2, param3);
+				command_dispatch(argc, argv);
 			}
 
 			printf("Bootloader# ");
@@ -149,108 +165,373 @@ void task_command(char *str, char *str_last)
 }
 
 /*
-*	Commands within the root context
+*	Receive an image straight after reset, as asked for by the firmware
+*	through the GPBR mailbox. There is no intro or prompt, the XModem
+*	<NAK>s start as soon as USB is up. Returns if the upload fails,
+*	leaving the command line to a user.
+*
+*	@param request - the request taken from the mailbox
+*/
+void upload_mailbox(const struct mailbox_request *request)
+{
+	int upload_ok;
+	
+	if (request->command != MAILBOX_CMD_UPLOAD || request->protocol != MAILBOX_PROTO_XMODEM
+		|| request->size > slot_size(slot_staging()))
+	{
+		return;
+	}
+	
+	upload_ok = firmware_upload_mailbox();
+	if (upload_ok && verification_check() == SUCCESS
+		&& (request->size == 0 || verify.length == request->size)
+		&& (request->checksum == 0 || verify.found == request->checksum)
+		&& slot_upload_done(verify.length, verify.found))
+	{
+		telemetry_log_upload(&xmodem_stats, 0);
+		restart();
+	}
+	
+	// Don't leave an image that was not the one asked for
+	telemetry_log_upload(&xmodem_stats, 1 + !upload_ok);
+	firmware_buffer_init();
+}
+
+/*
+*	Find a command in the table
+*
+*	The linker sorts the table by name (see flash.ld), so this is a
+*	binary search.
+*/
+static const struct command *command_find(const char *name)
+{
+	const struct command *low = __commands_start;
+	const struct command *high = __commands_end;
+	const struct command *mid;
+	int cmp;
+	
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		cmp = strcmp(name, mid->name);
+		if (cmp == 0)
+		{
+			return mid;
+		}
+		if (cmp < 0)
+		{
+			high = mid;
+		}
+		else
+		{
+			low = mid + 1;
+		}
+	}
+	return NULL;
+}
+
+/*
+*	Run a command line split into words
 *
-*	@param command - pointer to the command string
-*	@param param1 - pointer to parameter 1
-*	@param param2- pointer to parameter 2
-*	@param param2 - pointer to parameter 3
+*	@param argc - number of words, at least 1
+*	@param argv - command name followed by its arguments
 */
-void command_root(char *command, char *param1, char *param2, char *param3)
+static void command_dispatch(int argc, char *argv[])
 {
+	const struct command *cmd = command_find(argv[0]);
+	
+	if (cmd == NULL)
+	{
+		printf("Unknown command\r\n");
+		return;
+	}
+	cmd->handler(argc, argv);
+}
 
-	// Upload firmware
-	if (strcmp(command, "upload") == 0)
+COMMAND(help, "[command]", "List the commands, or show one")
+{
+	const struct command *cmd;
+	
+	if (argc > 1)
 	{
+		cmd = command_find(argv[1]);
+		if (cmd == NULL)
+		{
+			printf("Unknown command\r\n");
+			return;
+		}
+		printf("%s %s\r\n  %s\r\n", cmd->name, (cmd->usage != NULL) ? cmd->usage : "", cmd->help);
+		return;
+	}
+	
+	printf("\r\n");
+	for (cmd = __commands_start; cmd < __commands_end; cmd++)
+	{
+		printf("%-20s %s\r\n", cmd->name, cmd->help);
+	}
+	printf("\r\n");
+}
+
+COMMAND(upload, "[direct]", "Receive new firmware via XMODEM")
+{
+	int upload_ok;
+	
+	if (dfu_active())
+	{
+		printf("A DFU download is using the staging slot\r\n");
+		return;
+	}
+	
+	// Install firmware in place, without the buffer and the copy
+	if (argc > 1 && strcmp(argv[1], "direct") == 0)
+	{
+		printf("Installing straight into the run slot, up to %lu KB\r\n",
+		(unsigned long)((slot_install_end() - slot_base(SLOT_A)) / 1024));
 		printf("Please begin firmware upload using XMODEM\r\n");
-		firmware_upload();
+		upload_ok = firmware_install();
 		printf("\r\n");
 		printf("Firmware upload complete.\r\n");
-		if(verification_check() == SUCCESS)
+		xmodem_stats_dump();
+		if(upload_ok && firmware_install_finish() == SUCCESS)
 		{
+			telemetry_log_upload(&xmodem_stats, 0);
 			restart();
 		}
 		else
 		{
+			telemetry_log_upload(&xmodem_stats, 1 + !upload_ok);
 			printf("\r\n");
-			printf("Firmware verification check failed\r\n");
+			printf("Firmware verification check failed, no firmware is installed\r\n");
 			printf("\r\n");
 		}
 		return;
-
 	}
 
-	// Restart switch
-	if (strcmp(command, "restart")==0)
+	printf("Please begin firmware upload using XMODEM\r\n");
+	upload_ok = firmware_upload();
+	printf("\r\n");
+	printf("Firmware upload complete.\r\n");
+	xmodem_stats_dump();
+	if(verification_check() == SUCCESS && slot_upload_done(verify.length, verify.found))
 	{
+		telemetry_log_upload(&xmodem_stats, !upload_ok);
 		restart();
 	}
+	else
+	{
+		telemetry_log_upload(&xmodem_stats, 1 + !upload_ok);
+		printf("\r\n");
+		printf("Firmware verification check failed\r\n");
+		printf("\r\n");
+	}
+}
+
+COMMAND(restart, NULL, "Restart the switch")
+{
+	restart();
+}
+
+COMMAND(write_verification, NULL, "Write the test verification value to the last page of flash")
+{
+	write_verification(flash_end - IFLASH_PAGE_SIZE, VERIFICATION_TEST_VALUE);
+}
+
+COMMAND(check_verification, NULL, "Check the test verification value in the last page of flash")
+{
+	uint64_t value;
 	
-	// Write test verification value to flash
-	if (strcmp(command, "write_verification")==0)
-	{
-		uint32_t addr = IFLASH_ADDR + IFLASH_SIZE - IFLASH_PAGE_SIZE;
-		//uint64_t ver_val = 0x4E5000ECCF020046;
-		// Reversed for testing:
-		uint64_t ver_val = 0x58460001FEF04E4E;
-		write_verification(addr, ver_val);
+	memcpy(&value, (const void *)(flash_end - IFLASH_PAGE_SIZE), sizeof(value));
+	printf("\r\n");
+	printf("%08lx%08lx at %08lx, verification value %s\r\n", (unsigned long)(value >> 32), (unsigned long)(uint32_t)value,
+	(unsigned long)(flash_end - IFLASH_PAGE_SIZE), (value == VERIFICATION_TEST_VALUE) ? "found" : "not found");
+	printf("\r\n");
+}
+
+COMMAND(check_firmware, NULL, "Check the firmware in the update buffer")
+{
+	int ret = firmware_check();
+	if(ret == 0)
+	{
+		printf("\r\n");
+		printf("new version found - needs to be written\r\n");
+		printf("\r\n");
+	}
+	else if(ret == -1)
+	{
+		printf("\r\n");
+		printf("no firmware found in buffer or run locations\r\n");
+		printf("\r\n");
+		return;
+	}
+	else if(ret == 1)
+	{
+		printf("\r\n");
+		printf("buffer and run locations are identical\r\n");
+		printf("\r\n");
 		return;
 	}
 	
-	// Check test verification value in flash
-	if (strcmp(command, "check_verification")==0)
+	ret = verification_check();
+	if(ret == SUCCESS)
 	{
+		printf("\r\n");
+		printf("verification check passed\r\n");
+		printf("\r\n");
+	}
+	else if(ret == FAILURE)
+	{
+		printf("\r\n");
+		printf("verification check failed\r\n");
+		printf("\r\n");
+	}
+}
 
+COMMAND(bench, "[usb|force]", "Benchmark flash, checksum and USB throughput")
+{
+	if (argc > 1 && strcmp(argv[1], "usb") == 0)
+	{
+		bench_usb();
+	}
+	else if (dfu_active())
+	{
+		printf("A DFU download is using the staging slot\r\n");
+	}
+	else
+	{
+		bench_flash(argc > 1 && strcmp(argv[1], "force") == 0);
+	}
+}
 
-		
-		return;
+COMMAND(perf, "[clear|hist]", "Show the profiling probes")
+{
+	if (argc > 1 && strcmp(argv[1], "clear") == 0)
+	{
+		perf_clear();
+	}
+	else if (argc > 1 && strcmp(argv[1], "hist") == 0)
+	{
+		perf_dump_hist();
+	}
+	else
+	{
+		perf_dump();
+	}
+}
+
+COMMAND(stats, NULL, "Show the statistics of the last upload")
+{
+	xmodem_stats_dump();
+}
+
+COMMAND(boot, NULL, "Show the boot phase times")
+{
+	boot_times_dump();
+}
+
+COMMAND(slots, NULL, "Show the firmware slots")
+{
+	slot_dump();
+}
+
+COMMAND(rollback, NULL, "Go back to the image the last update replaced")
+{
+#if BIOS_AB_SLOTS
+	if (slot_rollback())
+	{
+		printf("Rolled back to slot %c\r\n", 'A' + slot_active());
+		restart();
+	}
+	printf("No previous image to roll back to\r\n");
+#else
+	printf("Rollback needs BIOS_AB_SLOTS, the previous image is not kept\r\n");
+#endif
+}
+
+COMMAND(telemetry, "[clear]", "Stream out the telemetry log")
+{
+	if (argc > 1 && strcmp(argv[1], "clear") == 0)
+	{
+		if (!telemetry_clear()) printf("Error: failed to erase the telemetry log\r\n");
+	}
+	else
+	{
+		telemetry_dump();
+	}
+}
+
+COMMAND(trace, "[clear|raw]", "Show the trace ring")
+{
+	if (argc > 1 && strcmp(argv[1], "clear") == 0)
+	{
+		trace_clear();
+	}
+	else if (argc > 1 && strcmp(argv[1], "raw") == 0)
+	{
+		trace_dump_raw();
+	}
+	else
+	{
+		trace_dump();
 	}
+}
+
+/*
+*	The region is a slot ('a' or 'b'), the BIOS with its logs ('bios'),
+*	all of flash ('all'), or a start address and length in hex.
+*/
+COMMAND(dump, "a|b|bios|all|<start> <length>", "Send a flash region to the host with XMODEM")
+{
+	struct xmodem_stats stats;
+	uint32_t start, end;
+	uint32_t cyc_per_us = sysclk_get_cpu_hz() / 1000000;
+	uint32_t total_us;
 	
-	// Check uploaded firmware
-	if (strcmp(command, "check_firmware")==0)
+	if (argc < 2)
 	{
-		int ret = firmware_check();
-		if(ret == 0)
-		{
-			printf("\r\n");
-			printf("new version found - needs to be written\r\n");
-			printf("\r\n");
-		}
-		else if(ret == -1)
-		{
-			printf("\r\n");
-			printf("no firmware found in buffer or run locations\r\n");
-			printf("\r\n");
-			return;
-		}
-		else if(ret == 1)
+		printf("Usage: dump a|b|bios|all|<start> <length>\r\n");
+		return;
+	}
+	if (strcmp(argv[1], "a") == 0 || strcmp(argv[1], "b") == 0)
+	{
+		start = slot_base(argv[1][0] - 'a');
+		end = slot_end(argv[1][0] - 'a');
+	}
+	else if (strcmp(argv[1], "bios") == 0)
+	{
+		start = IFLASH_ADDR;
+		end = slot_base(SLOT_A);
+	}
+	else if (strcmp(argv[1], "all") == 0)
+	{
+		start = IFLASH_ADDR;
+		end = flash_end;
+	}
+	else
+	{
+		start = strtoul(argv[1], NULL, 16);
+		end = start + ((argc > 2) ? strtoul(argv[2], NULL, 16) : 0);
+		if (start < IFLASH_ADDR || end <= start || end > flash_end || start % 16 != 0 || (end - start) % 128 != 0)
 		{
-			printf("\r\n");
-			printf("buffer and run locations are identical\r\n");
-			printf("\r\n");
+			printf("The range must be in flash, start on 16 bytes and be whole 128 byte blocks\r\n");
 			return;
 		}
-		
-		ret = verification_check();
-		if(ret == SUCCESS)
-		{
-			printf("\r\n");
-			printf("verification check passed\r\n");
-			printf("\r\n");
-		}
-		else if(ret == FAILURE)
-		{
-			printf("\r\n");
-			printf("verification check failed\r\n");
-			printf("\r\n");
-		}
-		
-		return;
 	}
 	
-	// Unknown Command
-	printf("Unknown command\r\n");
-	return;
+	printf("Sending %lu KB from %08lx, please begin the XMODEM receive (1K/CRC or checksum)\r\n",
+	(unsigned long)((end - start) / 1024), (unsigned long)start);
+	if (!xmodem_send(start, end - start, &stats))
+	{
+		printf("\r\nDump failed after %lu blocks\r\n", (unsigned long)stats.blocks);
+		return;
+	}
+	total_us = stats.total_cycles / cyc_per_us;
+	printf("\r\nDump complete: %lu bytes in %lu blocks, %lu NAKs, %lu timeouts",
+	(unsigned long)stats.bytes, (unsigned long)stats.blocks, (unsigned long)stats.naks, (unsigned long)stats.timeouts);
+	if (total_us > 0)
+	{
+		printf(", %lu KB/s", (unsigned long)(((uint64_t)stats.bytes * 1000000 / 1024) / total_us));
+	}
+	printf("\r\n");
 }
 
 /*
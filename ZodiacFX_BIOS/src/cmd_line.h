@@ -32,7 +32,41 @@
 #define COMMANDS_H_
 
 #include "conf_bios.h"
+#include "mailbox.h"
+
+#define CMD_MAX_ARGS	8		// Command name and arguments
+
+struct command
+{
+	const char *name;
+	const char *usage;		// Arguments for 'help', NULL for none
+	const char *help;
+	void (*handler)(int argc, char *argv[]);
+};
+
+/*
+*	Define a command line command:
+*
+*		COMMAND(name, "[arguments]", "What it does")
+*		{
+*			... argv[0] is the name, argc counts it
+*		}
+*
+*	The entry goes into its own .commands.<name> section and the linker
+*	collects them into one table sorted by name (see flash.ld), which
+*	command_find() searches. A command can be defined in any file.
+*/
+#define COMMAND(cmd_name, cmd_usage, cmd_help) \
+	static void command_##cmd_name(int argc, char *argv[]); \
+	const struct command command_entry_##cmd_name __attribute__ ((section (".commands." #cmd_name), used)) = \
+		{ #cmd_name, cmd_usage, cmd_help, command_##cmd_name }; \
+	static void command_##cmd_name(int argc, char *argv[])
+
+// Table bounds, from the linker script
+extern const struct command __commands_start[];
+extern const struct command __commands_end[];
 
 void task_command(char *str, char * str_last);
+void upload_mailbox(const struct mailbox_request *request);
 
 #endif /* COMMANDS_H_ */
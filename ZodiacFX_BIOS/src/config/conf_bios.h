@@ -33,10 +33,30 @@
 
 #define VERSION "1.00"		// Firmware version number
 
-#define SHARED_BUFFER_LEN 2048
+#define STAGE1_BASE 0x402000	// Updatable part of the BIOS, stage-0 is below it, see stage0.h
+#define STAGE1_END 0x419000
+
+// Firmware slots until the partition table is written, see partition.h
 #define FLASH_BUFFER 0x450000
 #define FLASH_STORE 0x420000
 #define FLASH_BUFFER_END 0x480000
 #define FLASH_STORE_END 0x450000
 
+#define MANIFEST_BASE 0x419000	// Slot manifest, 8KB below the telemetry log, see slot.h
+#define MANIFEST_END 0x41B000
+
+#define PARTITION_BASE 0x41B000	// Partition table page, written once
+
+#define TELEMETRY_BASE 0x41C000	// Top 16KB of the BIOS region, see flash.ld
+#define TELEMETRY_END 0x420000
+
+#define BIOS_AB_SLOTS 0	// Boot either firmware region in place instead of copying updates (1 = on)
+#define BIOS_TRIAL_BOOTS 3	// Boots an unconfirmed A/B update gets before it is rolled back
+
+#define BIOS_PERF 0		// Build in the DWT profiling probes (1 = on, about 1.4KB of SRAM)
+
+#define TRACE_LEVEL TRACE_LEVEL_DEBUG	// Highest trace level built in
+#define TRACE_SINK_ITM 1	// Copy trace records to ITM stimulus port 1
+#define TRACE_SINK_CDC 1	// Copy trace records to the second CDC port instead of ITM
+
 #endif /* CONFIG_BOOTLOADER_H_ */
@@ -101,15 +101,19 @@
  */
 /**
  * Configuration of CDC interface
+ * Port 0 is the command line, port 1 carries trace records (trace.c)
  * @{
  */
+//! Number of CDC ports
+#define  UDI_CDC_PORT_NB                  2
+
 //! Interface callback definition
-#define  UDI_CDC_ENABLE_EXT(port)          stdio_usb_enable()
-#define  UDI_CDC_DISABLE_EXT(port)         stdio_usb_disable()
+#define  UDI_CDC_ENABLE_EXT(port)          ((port) == 0 ? stdio_usb_enable() : trace_cdc_enable())
+#define  UDI_CDC_DISABLE_EXT(port)         ((port) == 0 ? stdio_usb_disable() : trace_cdc_disable())
 #define  UDI_CDC_RX_NOTIFY(port)
 #define  UDI_CDC_TX_EMPTY_NOTIFY(port)
 #define  UDI_CDC_SET_CODING_EXT(port,cfg)
-#define  UDI_CDC_SET_DTR_EXT(port,set)
+#define  UDI_CDC_SET_DTR_EXT(port,set)     ((port) == TRACE_CDC_PORT ? trace_cdc_set_dtr(set) : (void)0)
 #define  UDI_CDC_SET_RTS_EXT(port,set)
 
 //! Default configuration of communication port
@@ -118,6 +122,15 @@
 #define  UDI_CDC_DEFAULT_PARITY           CDC_PAR_NONE
 #define  UDI_CDC_DEFAULT_DATABITS         8
 //@}
+
+/**
+ * Configuration of the DFU interface (udi_dfu.c), after the CDC ports.
+ * The descriptors are in usb_desc.c instead of udi_cdc_desc.c.
+ * @{
+ */
+#define  UDI_DFU_IFACE_NUMBER             4
+#define  USB_DEVICE_NB_INTERFACE          5
+//@}
 //@}
 
 
@@ -130,6 +143,7 @@
 //! The includes of classes and other headers must be done at the end of this file to avoid compile error
 #include <udi_cdc_conf.h>
 #include <stdio_usb.h>
+#include "trace.h"
 
 #endif // _CONF_USB_H_
 
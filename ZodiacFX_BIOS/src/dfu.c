@@ -0,0 +1,523 @@
+/**
+ * @file
+ * dfu.c
+ *
+ * This file contains the USB DFU 1.1 class state machine
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "dfu.h"
+#include "flash.h"
+#include "slot.h"
+#include "perf.h"
+
+// Work handed from the USB interrupt to dfu_task()
+#define DFU_JOB_NONE		0
+#define DFU_JOB_PREPARE		1	// Erase the staging slot, then write the block
+#define DFU_JOB_BLOCK		2	// Write the block
+#define DFU_JOB_MANIFEST	3	// Write the last page and check the image
+
+// Global variables
+extern struct verification_data verify;
+struct dfu_stats dfu_stats;
+
+// Static variables
+static volatile uint8_t state = DFU_STATE_IDLE;
+static volatile uint8_t status = DFU_STATUS_OK;
+static volatile uint8_t job = DFU_JOB_NONE;
+static uint8_t data_request;		// Request waiting for its data stage
+// IN data is sent from word aligned buffers
+static struct dfu_status reply COMPILER_ALIGNED(4);
+static uint8_t reply_state COMPILER_ALIGNED(4);
+static uint32_t block[DFU_TRANSFER_SIZE / sizeof(uint32_t)];
+static uint16_t block_length;
+static uint32_t page[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
+static uint32_t page_fill;
+static uint32_t write_address;		// Next page of the staging slot
+static uint32_t write_end;
+static uint32_t erase_sectors;		// Not blank when the download started
+static int prepared;
+static uint32_t upload_address;
+static uint32_t upload_end;
+static uint32_t job_start;			// Cycle count when the job was handed over
+static uint32_t job_estimate_us;	// Given to the host with the job
+static uint32_t manifest_done;		// Cycle count at the end of the manifest
+static uint32_t erase_us = DFU_ERASE_US;
+static uint32_t program_us = DFU_PROGRAM_US;
+static uint32_t verify_us_per_kb = DFU_VERIFY_US_PER_KB;
+
+// Internal Functions
+static void dfu_getstatus(void);
+static void dfu_poll(uint32_t us);
+static void dfu_download_start(void);
+static void dfu_upload_start(void);
+static void dfu_write_block(void);
+static void dfu_manifest(void);
+static void dfu_fail(uint8_t error);
+static int dfu_program_page(void);
+static uint32_t dfu_us(uint32_t cycles);
+
+/*
+*	Handle a DFU class request, from the USB interrupt
+*
+*	For IN requests *payload and *length are the reply, for DNLOAD they
+*	are where the block is received. dfu_setup_done() is called once the
+*	data stage is over.
+*
+*	@return 1 to accept the request, 0 to stall it
+*/
+int dfu_setup(const struct dfu_request *req, uint8_t **payload, uint16_t *length)
+{
+	*payload = NULL;
+	*length = 0;
+	
+	switch (req->bRequest)
+	{
+		case DFU_GETSTATUS:
+			if (req->wLength < sizeof(reply)) break;
+			dfu_getstatus();
+			*payload = (uint8_t *)&reply;
+			*length = sizeof(reply);
+			return 1;
+		
+		case DFU_GETSTATE:
+			if (req->wLength < 1) break;
+			reply_state = state;
+			*payload = &reply_state;
+			*length = 1;
+			return 1;
+		
+		case DFU_CLRSTATUS:
+			if (state != DFU_STATE_ERROR) break;
+			status = DFU_STATUS_OK;
+			state = DFU_STATE_IDLE;
+			return 1;
+		
+		case DFU_ABORT:
+			if (state != DFU_STATE_IDLE && state != DFU_STATE_DNLOAD_SYNC && state != DFU_STATE_DNLOAD_IDLE
+				&& state != DFU_STATE_MANIFEST_SYNC && state != DFU_STATE_UPLOAD_IDLE) break;
+			state = DFU_STATE_IDLE;
+			return 1;
+		
+		case DFU_DNLOAD:
+			if (req->wLength == 0)
+			{
+				// The end of the image
+				if (state != DFU_STATE_DNLOAD_IDLE) break;
+				state = DFU_STATE_MANIFEST_SYNC;
+				return 1;
+			}
+			if (req->wLength > DFU_TRANSFER_SIZE) break;
+			if (state == DFU_STATE_IDLE)
+			{
+				// dfu_task() sets up the slot with the first block
+				page_fill = 0;
+				prepared = 0;
+			}
+			else if (state != DFU_STATE_DNLOAD_IDLE) break;
+			data_request = DFU_DNLOAD;
+			block_length = req->wLength;
+			*payload = (uint8_t *)block;
+			*length = req->wLength;
+			return 1;
+		
+		case DFU_UPLOAD:
+			if (req->wLength > DFU_TRANSFER_SIZE) break;
+			if (state == DFU_STATE_IDLE)
+			{
+				dfu_upload_start();
+			}
+			else if (state != DFU_STATE_UPLOAD_IDLE) break;
+			// Sent straight from flash, a short block ends the upload
+			*payload = (uint8_t *)upload_address;
+			*length = (upload_end - upload_address < req->wLength) ? upload_end - upload_address : req->wLength;
+			upload_address += *length;
+			state = (*length < req->wLength) ? DFU_STATE_IDLE : DFU_STATE_UPLOAD_IDLE;
+			return 1;
+	}
+	
+	// DETACH (there is no run-time interface to go back to) and
+	// anything out of turn
+	dfu_stats.stalls++;
+	status = DFU_STATUS_ERR_STALLEDPKT;
+	state = DFU_STATE_ERROR;
+	return 0;
+}
+
+/*
+*	End of a request's status stage, from the USB interrupt
+*
+*/
+void dfu_setup_done(void)
+{
+	if (data_request == DFU_DNLOAD)
+	{
+		data_request = 0;
+		dfu_stats.blocks++;
+		state = DFU_STATE_DNLOAD_SYNC;
+	}
+}
+
+/*
+*	Do the flash work the last GETSTATUS handed over, from the main loop
+*
+*	After a manifest the BIOS restarts DFU_RESET_MS later, which
+*	installs the image.
+*/
+void dfu_task(void)
+{
+	uint32_t start;
+	
+	switch (job)
+	{
+		case DFU_JOB_NONE:
+			if (state == DFU_STATE_MANIFEST_WAIT_RESET
+				&& dfu_us(DWT->CYCCNT - manifest_done) >= DFU_RESET_MS * 1000)
+			{
+				restart();
+			}
+			return;
+		
+		case DFU_JOB_PREPARE:
+			dfu_download_start();
+			start = DWT->CYCCNT;
+			if (!firmware_buffer_prepare())
+			{
+				dfu_fail(DFU_STATUS_ERR_ERASE);
+				return;
+			}
+			dfu_stats.erase_cycles = DWT->CYCCNT - start;
+			if (erase_sectors > 0)
+			{
+				erase_us = dfu_us(dfu_stats.erase_cycles) / erase_sectors;
+			}
+			prepared = 1;
+			dfu_write_block();
+			return;
+		
+		case DFU_JOB_BLOCK:
+			dfu_write_block();
+			return;
+		
+		case DFU_JOB_MANIFEST:
+			dfu_manifest();
+			return;
+	}
+}
+
+/*
+*	Go back to dfuIDLE when the interface is enabled or disabled
+*
+*	A write that is under way finishes first, and a restart that is
+*	due after a manifest still happens.
+*/
+void dfu_reset(void)
+{
+	perf_cycles_init();
+	if (job != DFU_JOB_NONE || state == DFU_STATE_MANIFEST_WAIT_RESET)
+	{
+		return;
+	}
+	data_request = 0;
+	status = DFU_STATUS_OK;
+	state = DFU_STATE_IDLE;
+}
+
+int dfu_state(void)
+{
+	return state;
+}
+
+/*
+*	Check for a download that has started and not ended yet, which
+*	owns the staging slot
+*
+*/
+int dfu_active(void)
+{
+	return state >= DFU_STATE_DNLOAD_SYNC && state <= DFU_STATE_MANIFEST_WAIT_RESET;
+}
+
+/*
+*	Fill in the GETSTATUS reply, handing a received block or the
+*	manifest over to dfu_task()
+*
+*/
+static void dfu_getstatus(void)
+{
+	uint32_t us = 0;
+	uint32_t elapsed;
+	
+	switch (state)
+	{
+		case DFU_STATE_DNLOAD_SYNC:
+			if (!prepared)
+			{
+				us += DFU_SCAN_US;		// The erase is added once the slot is scanned
+			}
+			if (page_fill + block_length >= IFLASH_PAGE_SIZE)
+			{
+				us += program_us;
+			}
+			dfu_poll(us);
+			state = DFU_STATE_DNBUSY;
+			job = prepared ? DFU_JOB_BLOCK : DFU_JOB_PREPARE;
+			break;
+		
+		case DFU_STATE_MANIFEST_SYNC:
+			// The last page, the image check and the manifest record
+			if (page_fill > 0)
+			{
+				us += program_us;
+			}
+			us += (dfu_stats.bytes + page_fill) / 1024 * verify_us_per_kb + program_us;
+			dfu_poll(us);
+			state = DFU_STATE_MANIFEST;
+			job = DFU_JOB_MANIFEST;
+			break;
+		
+		case DFU_STATE_DNBUSY:
+		case DFU_STATE_MANIFEST:
+			// Polled again before the job is done
+			elapsed = dfu_us(DWT->CYCCNT - job_start);
+			us = (elapsed < job_estimate_us) ? job_estimate_us - elapsed : 1000;
+			break;
+	}
+	if (state == DFU_STATE_DNBUSY || state == DFU_STATE_MANIFEST)
+	{
+		dfu_stats.busy++;
+	}
+	
+	us = (us + 999) / 1000;
+	reply.bStatus = status;
+	reply.bwPollTimeout[0] = us;
+	reply.bwPollTimeout[1] = us >> 8;
+	reply.bwPollTimeout[2] = us >> 16;
+	reply.bState = state;
+	reply.iString = 0;
+}
+
+/*
+*	Start timing a job with the estimate sent to the host
+*
+*/
+static void dfu_poll(uint32_t us)
+{
+	job_start = DWT->CYCCNT;
+	job_estimate_us = us;
+}
+
+/*
+*	Set up a download into the staging slot, from dfu_task() before the
+*	first block is written
+*
+*	Nothing here runs in the USB interrupt, which must not read the
+*	flash while the EFC may be busy. The sectors that need erasing are
+*	counted and added to the estimate the pending poll timeout is
+*	measured against, so the host's next poll waits for the erase.
+*/
+static void dfu_download_start(void)
+{
+	int staging = slot_staging();
+	
+	// Counted from the first block and the poll that handed it over
+	memset(&dfu_stats, 0, sizeof(dfu_stats));
+	dfu_stats.blocks = 1;
+	dfu_stats.busy = 1;
+	write_address = slot_base(staging);
+	write_end = slot_end(staging);
+	erase_sectors = slot_spanned() ? 1 : 0;		// The end of the image in slot A goes too
+	for (uint32_t sector = write_address; sector < write_end; sector += ERASE_SECTOR_SIZE)
+	{
+		if (!flash_region_blank(sector, sector + ERASE_SECTOR_SIZE))
+		{
+			erase_sectors++;
+		}
+	}
+	job_estimate_us += erase_sectors * erase_us;
+}
+
+/*
+*	Set up an upload of the image in the active slot, up to the last
+*	byte that is not blank
+*
+*/
+static void dfu_upload_start(void)
+{
+	const uint8_t *end = (const uint8_t *)(slot_spanned() ? slot_install_end() : slot_end(slot_active()));
+	
+	upload_address = slot_base(slot_active());
+	while ((uint32_t)end > upload_address && end[-1] == 0xFF)
+	{
+		end--;
+	}
+	upload_end = (uint32_t)end;
+}
+
+/*
+*	Add the received block to the page buffer, writing the page when it
+*	is full
+*
+*/
+static void dfu_write_block(void)
+{
+	const uint8_t *data = (const uint8_t *)block;
+	uint32_t length = block_length;
+	uint32_t start;
+	uint32_t count;
+	int rc;
+	
+	while (length > 0)
+	{
+		count = IFLASH_PAGE_SIZE - page_fill;
+		if (count > length)
+		{
+			count = length;
+		}
+		memcpy((uint8_t *)page + page_fill, data, count);
+		page_fill += count;
+		data += count;
+		length -= count;
+		
+		if (page_fill == IFLASH_PAGE_SIZE)
+		{
+			start = DWT->CYCCNT;
+			rc = dfu_program_page();
+			if (rc != DFU_STATUS_OK)
+			{
+				dfu_fail(rc);
+				return;
+			}
+			dfu_stats.program_cycles += DWT->CYCCNT - start;
+			program_us = dfu_us(DWT->CYCCNT - start);
+		}
+	}
+	dfu_stats.bytes += block_length;
+	
+	// Unless the host aborted in the meantime
+	if (state == DFU_STATE_DNBUSY)
+	{
+		state = DFU_STATE_DNLOAD_IDLE;
+	}
+	job = DFU_JOB_NONE;
+}
+
+/*
+*	Write what is left in the page buffer, padded with blank bytes, and
+*	stage the image as 'upload' does
+*
+*/
+static void dfu_manifest(void)
+{
+	uint32_t start;
+	int rc;
+	
+	if (page_fill > 0)
+	{
+		memset((uint8_t *)page + page_fill, 0xFF, IFLASH_PAGE_SIZE - page_fill);
+		rc = dfu_program_page();
+		if (rc != DFU_STATUS_OK)
+		{
+			dfu_fail(rc);
+			return;
+		}
+	}
+	
+	start = DWT->CYCCNT;
+	if (verification_check() != SUCCESS)
+	{
+		dfu_fail(DFU_STATUS_ERR_VERIFY);
+		return;
+	}
+	dfu_stats.verify_cycles = DWT->CYCCNT - start;
+	if (verify.length >= 1024)
+	{
+		verify_us_per_kb = dfu_us(dfu_stats.verify_cycles) / (verify.length / 1024);
+	}
+	if (!slot_upload_done(verify.length, verify.found))
+	{
+		dfu_fail(DFU_STATUS_ERR_FIRMWARE);
+		return;
+	}
+	
+	manifest_done = DWT->CYCCNT;
+	state = DFU_STATE_MANIFEST_WAIT_RESET;
+	job = DFU_JOB_NONE;
+}
+
+/*
+*	End a job in dfuERROR
+*
+*/
+static void dfu_fail(uint8_t error)
+{
+	status = error;
+	state = DFU_STATE_ERROR;
+	job = DFU_JOB_NONE;
+}
+
+/*
+*	Write the page buffer to the next page of the staging slot
+*
+*	Stays in SRAM until the EFC is done, like flash_write_latched_page()
+*	callers.
+*
+*	@return DFU_STATUS_OK or the DFU error
+*/
+RAMFUNC
+static int dfu_program_page(void)
+{
+	uint32_t rc;
+	
+	if (write_address + IFLASH_PAGE_SIZE > write_end)
+	{
+		return DFU_STATUS_ERR_ADDRESS;	// The image does not fit the slot
+	}
+	rc = flash_write_page_start(write_address, page);
+	if (rc == FLASH_RC_OK)
+	{
+		rc = flash_wait_ready();
+	}
+	if (rc != FLASH_RC_OK)
+	{
+		return DFU_STATUS_ERR_PROG;
+	}
+	write_address += IFLASH_PAGE_SIZE;
+	page_fill = 0;
+	return DFU_STATUS_OK;
+}
+
+/*
+*	Convert core clock cycles to microseconds
+*
+*/
+static uint32_t dfu_us(uint32_t cycles)
+{
+	return cycles / (sysclk_get_cpu_hz() / 1000000);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file
+ * dfu.h
+ *
+ * This file contains the USB DFU 1.1 class state machine
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef DFU_H_
+#define DFU_H_
+
+#include <stdint.h>
+
+/*
+*	USB DFU 1.1 download and upload, next to the CDC port
+*
+*	The BIOS has a DFU-mode interface (protocol 2) in its configuration,
+*	so dfu-util and other standard hosts can write an image without the
+*	command line or XMODEM. A download goes to the staging slot, exactly
+*	like 'upload': the image is checked on the zero-length DNLOAD that
+*	ends it and installed by the restart that follows, so the device is
+*	not manifestation tolerant and detaches by itself (bitWillDetach).
+*	An upload reads back the image in the active slot.
+*
+*	Each DNLOAD block is at most one flash page. The block is taken in
+*	the USB interrupt and written by dfu_task() from the main loop, so
+*	the flash is never programmed from the interrupt. The GETSTATUS that
+*	starts the write answers dfuDNBUSY with a bwPollTimeout from the
+*	erase and program times measured on this device, typical SAM4E
+*	times until the first ones have been measured. The slot is only
+*	checked for the erase once dfu_task() has the first block, so the
+*	first poll timeout leaves the erase out and the polls after it
+*	give the time that is left.
+*
+*	dfu_setup() and dfu_setup_done() know nothing about the USB stack,
+*	udi_dfu.c connects them to the control endpoint and sim/dfu_bench.c
+*	drives them on a Linux host.
+*/
+#define DFU_TRANSFER_SIZE		512		// wTransferSize, one flash page
+#define DFU_DETACH_MS			1000	// wDetachTimeOut
+#define DFU_RESET_MS			100		// Manifest to restart, time for the last GETSTATUS
+#define DFU_ERASE_US			200000	// Typical 64k sector erase, until measured
+#define DFU_PROGRAM_US			1500	// Typical page program, until measured
+#define DFU_SCAN_US				1000	// Blank check of the staging slot before the first block
+#define DFU_VERIFY_US_PER_KB	50		// Image check, until measured
+
+// Functional descriptor bmAttributes
+#define DFU_ATTR_CAN_DNLOAD		(1 << 0)
+#define DFU_ATTR_CAN_UPLOAD		(1 << 1)
+#define DFU_ATTR_TOLERANT		(1 << 2)	// bitManifestationTolerant
+#define DFU_ATTR_WILL_DETACH	(1 << 3)
+#define DFU_ATTRIBUTES			(DFU_ATTR_CAN_DNLOAD | DFU_ATTR_CAN_UPLOAD | DFU_ATTR_WILL_DETACH)
+
+// Class requests
+#define DFU_DETACH				0
+#define DFU_DNLOAD				1
+#define DFU_UPLOAD				2
+#define DFU_GETSTATUS			3
+#define DFU_CLRSTATUS			4
+#define DFU_GETSTATE			5
+#define DFU_ABORT				6
+
+// bState
+#define DFU_STATE_APP_IDLE				0
+#define DFU_STATE_APP_DETACH			1
+#define DFU_STATE_IDLE					2
+#define DFU_STATE_DNLOAD_SYNC			3
+#define DFU_STATE_DNBUSY				4
+#define DFU_STATE_DNLOAD_IDLE			5
+#define DFU_STATE_MANIFEST_SYNC			6
+#define DFU_STATE_MANIFEST				7
+#define DFU_STATE_MANIFEST_WAIT_RESET	8
+#define DFU_STATE_UPLOAD_IDLE			9
+#define DFU_STATE_ERROR					10
+
+// bStatus
+#define DFU_STATUS_OK					0x00
+#define DFU_STATUS_ERR_TARGET			0x01
+#define DFU_STATUS_ERR_FILE				0x02
+#define DFU_STATUS_ERR_WRITE			0x03
+#define DFU_STATUS_ERR_ERASE			0x04
+#define DFU_STATUS_ERR_CHECK_ERASED		0x05
+#define DFU_STATUS_ERR_PROG				0x06
+#define DFU_STATUS_ERR_VERIFY			0x07
+#define DFU_STATUS_ERR_ADDRESS			0x08
+#define DFU_STATUS_ERR_NOTDONE			0x09
+#define DFU_STATUS_ERR_FIRMWARE			0x0A
+#define DFU_STATUS_ERR_VENDOR			0x0B
+#define DFU_STATUS_ERR_USBR				0x0C
+#define DFU_STATUS_ERR_POR				0x0D
+#define DFU_STATUS_ERR_UNKNOWN			0x0E
+#define DFU_STATUS_ERR_STALLEDPKT		0x0F
+
+// SETUP packet, with the 16-bit fields in CPU order
+struct dfu_request
+{
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+};
+
+// GETSTATUS reply
+struct dfu_status
+{
+	uint8_t bStatus;
+	uint8_t bwPollTimeout[3];	// Milliseconds, little endian
+	uint8_t bState;
+	uint8_t iString;
+};
+
+struct dfu_stats
+{
+	uint32_t bytes;				// Image bytes written
+	uint32_t blocks;			// DNLOAD blocks accepted
+	uint32_t busy;				// GETSTATUS replies with dfuDNBUSY or dfuMANIFEST
+	uint32_t stalls;			// Requests refused with errSTALLEDPKT
+	uint32_t erase_cycles;		// Preparing the staging slot
+	uint32_t program_cycles;	// Page writes, waiting for the EFC
+	uint32_t verify_cycles;		// Checking the image at manifest
+};
+
+int dfu_setup(const struct dfu_request *req, uint8_t **payload, uint16_t *length);
+void dfu_setup_done(void);
+void dfu_task(void);
+void dfu_reset(void);
+int dfu_state(void);
+int dfu_active(void);
+
+#endif /* DFU_H_ */
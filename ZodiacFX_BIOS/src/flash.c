@@ -34,20 +34,33 @@
 #include "flash.h"
 #include "conf_bios.h"
 #include "cmd_line.h"
+#include "perf.h"
+#include "boot.h"
 #include "trace.h"
+#include "slot.h"
+#include "partition.h"
 
 // Global variables
-uint8_t shared_buffer[SHARED_BUFFER_LEN];
 struct verification_data	verify;
-
-extern bool bios_debug;
+struct xmodem_stats xmodem_stats;
 
 // Static variables
-static uint32_t page_addr;
+static uint32_t install_page_addr;	// Page firmware_install() holds the vectors of, 0 for none
+static uint32_t install_vectors[INSTALL_VECTOR_WORDS];
 static	uint32_t ul_test_page_addr;
+static	uint32_t ul_test_page_end;		// Page writes stop here
 static	uint32_t ul_rc;
-static	uint32_t ul_idx;
-static	uint32_t ul_page_buffer[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
+
+// Internal Functions
+static int xmodem_clear_padding(int pad_start, uint32_t pad_word);
+static void clock_reset_state(void);
+static int flash_region_unlock(uint32_t start_address, uint32_t end_address);
+static int flash_region_prepare(uint32_t start_address, uint32_t end_address);
+static int firmware_buffer_unlock(void);
+static int firmware_receive(bool erase_all);
+static void xmodem_latch_write(uint32_t address, uint32_t data);
+static uint32_t install_vectors_write(uint32_t base);
+static void xmodem_read_flash(uint32_t *data, uint32_t address, int length);
 
 /*
 *	Get the unique serial number from the CPU
@@ -55,52 +68,160 @@ static	uint32_t ul_page_buffer[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
 */
 void get_serial(uint32_t *uid_buf)
 {
-	uint32_t uid_ok = flash_read_unique_id(uid_buf, 4);
-	return;
+	flash_read_unique_id(uid_buf, 4);
 }
 
 /*
-*	Firmware update function
+*	Set up the EFC and unlock a region for writing from its start
 *
 */
-void firmware_buffer_init(void)
+static int flash_region_unlock(uint32_t start_address, uint32_t end_address)
 {
-	ul_test_page_addr = FLASH_BUFFER;
+	ul_test_page_addr = start_address;
+	ul_test_page_end = end_address;
 	
 	/* Initialize flash: 6 wait states for flash writing. */
 	ul_rc = flash_init(FLASH_ACCESS_MODE_128, 6);
 	if (ul_rc != FLASH_RC_OK) {
 		printf("Buffer initialization error %lu\n\r", (unsigned long)ul_rc);
-		return;
+		return 0;
 	}
 	
 	// Unlock 8k lock regions (these should be unlocked by default)
 	uint32_t unlock_address = ul_test_page_addr;
-	while(unlock_address < FLASH_BUFFER_END)
+	while(unlock_address < end_address)
 	{
 		ul_rc = flash_unlock(unlock_address,
 		unlock_address + (4*IFLASH_PAGE_SIZE) - 1, 0, 0);
 		if (ul_rc != FLASH_RC_OK)
 		{
 			printf("Buffer unlock error %lu\n\r", (unsigned long)ul_rc);
-			return;
+			return 0;
 		}
 		
 		unlock_address += IFLASH_LOCK_REGION_SIZE;
 	}
+	return 1;
+}
 
-	// Erase 3 64k sectors
-	uint32_t erase_address = ul_test_page_addr;
-	while(erase_address < FLASH_BUFFER_END)
+/*
+*	Set up the EFC and unlock BIOS records for erasing or programming
+*
+*	The manifest, partition table and telemetry log are written outside
+*	an upload, when nothing may have set the wait states or cleared the
+*	lock bits yet. Unlike flash_region_unlock() this leaves the XModem
+*	write address alone.
+*
+*	@param start - first byte of the records
+*	@param end - address after the last byte
+*/
+int flash_records_unlock(uint32_t start, uint32_t end)
+{
+	return flash_init(FLASH_ACCESS_MODE_128, 6) == FLASH_RC_OK
+		&& flash_unlock(start, end - 1, 0, 0) == FLASH_RC_OK;
+}
+
+/*
+*	Set up the EFC and unlock the buffer region for writing
+*
+*	An image installed with 'upload direct' may run on into the buffer.
+*	It can't survive the buffer being erased, so it is made blank first
+*	rather than left to boot with its end missing.
+*/
+static int firmware_buffer_unlock(void)
+{
+	uint32_t store = slot_base(slot_active());
+	
+	if (!flash_region_unlock(slot_base(slot_staging()), slot_end(slot_staging())))
+	{
+		return 0;
+	}
+	if (slot_spanned())
 	{
-		ul_rc = flash_erase_sector(erase_address);
+		ul_rc = flash_erase_region(store, store + ERASE_SECTOR_SIZE);
+		if (ul_rc != FLASH_RC_OK)
+		{
+			printf("Firmware erase error %lu\n\r", (unsigned long)ul_rc);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+*	Erase the 64k sectors of a region that are not blank already
+*
+*/
+static int flash_region_prepare(uint32_t start_address, uint32_t end_address)
+{
+	for (uint32_t sector = start_address; sector < end_address; sector += ERASE_SECTOR_SIZE)
+	{
+		if (flash_region_blank(sector, sector + ERASE_SECTOR_SIZE))
+		{
+			continue;
+		}
+		ul_rc = flash_erase_region(sector, sector + ERASE_SECTOR_SIZE);
 		if (ul_rc != FLASH_RC_OK)
 		{
 			printf("Buffer erase error %lu\n\r", (unsigned long)ul_rc);
-			return;
+			return 0;
 		}
-		
-		erase_address += ERASE_SECTOR_SIZE;
+	}
+	return 1;
+}
+
+/*
+*	Get the buffer ready for an image, erasing only the sectors that are
+*	not blank already. After an update has been applied the whole buffer
+*	is blank and nothing needs erasing.
+*
+*	@return 1 if the buffer is ready to be written
+*/
+int firmware_buffer_prepare(void)
+{
+	if (!firmware_buffer_unlock())
+	{
+		return 0;
+	}
+	
+	return flash_region_prepare(ul_test_page_addr, ul_test_page_end);
+}
+
+/*
+*	Check that a region of flash is erased
+*
+*/
+int flash_region_blank(uint32_t start_address, uint32_t end_address)
+{
+	const uint32_t *word = (const uint32_t *)start_address;
+	
+	while (word < (const uint32_t *)end_address)
+	{
+		if (*word++ != 0xFFFFFFFF)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+*	Firmware update function
+*
+*/
+void firmware_buffer_init(void)
+{
+	if (!firmware_buffer_unlock())
+	{
+		return;
+	}
+
+	// Erase the 64k sectors of the slot
+	ul_rc = flash_erase_region(ul_test_page_addr, slot_end(slot_staging()));
+	if (ul_rc != FLASH_RC_OK)
+	{
+		printf("Buffer erase error %lu\n\r", (unsigned long)ul_rc);
+		return;
 	}
 	
 	return;
@@ -124,14 +245,13 @@ void firmware_buffer_init(void)
 */
 int firmware_check(void)
 {
-	unsigned long* firmware_pmem = (unsigned long*)FLASH_STORE;
-	unsigned long* buffer_pmem = (unsigned long*)FLASH_BUFFER;
+	uint32_t* firmware_pmem = (uint32_t*)slot_base(slot_active());
 	
 	if(*firmware_pmem == 0xFFFFFFFF)
 	{
 		// running firmware does not exist
 		
-		if(*buffer_pmem == 0xFFFFFFFF)
+		if(!slot_pending())
 		{
 			// update firmware does not exist
 			
@@ -141,7 +261,7 @@ int firmware_check(void)
 		{
 			// update firmware exists
 			
-			if(verification_check() == SUCCESS)
+			if(verification_check() == SUCCESS && slot_entry_ok(slot_staging()))
 			{
 				// firmware is valid
 			
@@ -159,7 +279,7 @@ int firmware_check(void)
 	{
 		// running firmware exists
 		
-		if(*buffer_pmem == 0xFFFFFFFF)
+		if(!slot_pending())
 		{
 			// update firmware does not exist
 			
@@ -169,7 +289,7 @@ int firmware_check(void)
 		{
 			// update firmware exists
 			
-			if(verification_check() == SUCCESS)
+			if(verification_check() == SUCCESS && slot_entry_ok(slot_staging()))
 			{
 				// firmware is valid
 			
@@ -188,72 +308,94 @@ int firmware_check(void)
 
 
 /*
-*	Firmware update function
+*	Set up the EFC and unlock the store for an update
 *
+*	The sectors are erased one at a time as firmware_update() gets to
+*	them.
 */
-void firmware_store_init(void)
+int firmware_store_init(void)
 {	
-	ul_test_page_addr = FLASH_STORE;
+	uint32_t store_end = slot_end(slot_active());
+	
+	ul_test_page_addr = slot_base(slot_active());
+	ul_test_page_end = store_end;
 	
 	/* Initialize flash: 6 wait states for flash writing. */
 	ul_rc = flash_init(FLASH_ACCESS_MODE_128, 6);
 	if (ul_rc != FLASH_RC_OK) {
 		printf("Firmware initialization error %lu\n\r", (unsigned long)ul_rc);
-		return;
+		return 0;
 	}
 	
 	// Unlock 8k lock regions (these should be unlocked by default)
 	uint32_t unlock_address = ul_test_page_addr;
-	while(unlock_address < FLASH_STORE_END)
+	while(unlock_address < store_end)
 	{
 		ul_rc = flash_unlock(unlock_address,
 		unlock_address + (4*IFLASH_PAGE_SIZE) - 1, 0, 0);
 		if (ul_rc != FLASH_RC_OK)
 		{
 			printf("Firmware unlock error %lu\n\r", (unsigned long)ul_rc);
-			return;
+			return 0;
 		}
 		
 		unlock_address += IFLASH_LOCK_REGION_SIZE;
 	}
+	return 1;
+}
 
-	// Erase 3 64k sectors
-	uint32_t erase_address = ul_test_page_addr;
-	while(erase_address < FLASH_STORE_END)
+/*
+*	Erase the 64k sectors from erase_address up to end_address
+*
+*	Runs from SRAM with interrupts enabled, so the USB stack keeps
+*	servicing the CDC port while each sector is erased.
+*/
+RAMFUNC
+uint32_t flash_erase_region(uint32_t erase_address, uint32_t end_address)
+{
+	uint32_t rc;
+	
+	while(erase_address < end_address)
 	{
-		ul_rc = flash_erase_sector(erase_address);
-		if (ul_rc != FLASH_RC_OK)
+		PERF_BEGIN(PERF_FLASH_ERASE);
+		rc = flash_erase_sector_start(erase_address);
+		if (rc == FLASH_RC_OK)
 		{
-			printf("Firmware erase error %lu\n\r", (unsigned long)ul_rc);
-			return;
+			rc = flash_wait_ready();
+		}
+		PERF_END(PERF_FLASH_ERASE);
+		if (rc != FLASH_RC_OK)
+		{
+			return rc;
 		}
 		erase_address += ERASE_SECTOR_SIZE;
 	}
 	
-	return;
+	return FLASH_RC_OK;
 }
 
 /*
-*	Write a page to flash memory
+*	Program the page already loaded into the write latch
 *
+*	This returns while the EFC is still busy. Callers stay in SRAM
+*	until flash_wait_ready() (or the next page write) has completed.
 */
-int flash_write_page(uint8_t *flash_page)
+RAMFUNC
+int flash_write_latched_page(void)
 {
-	if(ul_test_page_addr <= IFLASH_ADDR + IFLASH_SIZE - IFLASH_PAGE_SIZE)
+	if(ul_test_page_addr + IFLASH_PAGE_SIZE > ul_test_page_end)
 	{
-		ul_rc = flash_write(ul_test_page_addr, flash_page,
-		IFLASH_PAGE_SIZE, 0);
-	}
-	else
-	{
-		// Out of flash range
+		// Out of the region being written
 		return 0;
 	}
-
+	
+	PERF_BEGIN(PERF_FLASH_PROGRAM_START);
+	ul_rc = flash_program_latch_start(ul_test_page_addr);
+	PERF_END(PERF_FLASH_PROGRAM_START);
 	if (ul_rc != FLASH_RC_OK)
 	{
 		return 0;
-	}	
+	}
 	
 	ul_test_page_addr += IFLASH_PAGE_SIZE;
 	
@@ -266,7 +408,7 @@ int flash_write_page(uint8_t *flash_page)
 */
 int flash_write_page_s(uint8_t *flash_page, uint32_t address_s)
 {
-	if(address_s <= IFLASH_ADDR + IFLASH_SIZE - IFLASH_PAGE_SIZE)
+	if(address_s <= flash_end - IFLASH_PAGE_SIZE)
 	{
 		ul_rc = flash_write(address_s, flash_page,
 		IFLASH_PAGE_SIZE, 0);
@@ -288,40 +430,210 @@ int flash_write_page_s(uint8_t *flash_page, uint32_t address_s)
 /*
 *	Copies firmware from buffer the run location
 *
+*	The store is erased and copied one 64k sector at a time, and the
+*	manifest journals each sector once it is complete. An update cut
+*	short by a power loss is found again on the next boot, since the
+*	buffer still verifies, and carries on from the first sector that
+*	was not finished. Only the pages the image uses are copied.
+*
+*	With A/B slots the verified image is made the active slot instead,
+*	using the length and checksum verification_check() left in verify.
 */
 void firmware_update(void)
 {
-	uint32_t update_address = FLASH_STORE;
-	uint32_t buffer_address = FLASH_BUFFER;
+#if BIOS_AB_SLOTS
+	PERF_BEGIN(PERF_FIRMWARE_UPDATE);
+	if (!slot_activate(slot_staging(), verify.length, verify.found, 1))
+	{
+		printf("-F- Manifest programming error\n\r");
+	}
+	PERF_END(PERF_FIRMWARE_UPDATE);
+#else
+	uint32_t store = slot_base(slot_active());
+	uint32_t buffer = slot_base(slot_staging());
+	uint32_t sectors = slot_size(slot_active()) / ERASE_SECTOR_SIZE;
+	uint32_t sector, offset, end;
+	
+	PERF_BEGIN(PERF_FIRMWARE_UPDATE);
+	if (!firmware_store_init())
+	{
+		return;
+	}
 	
-	firmware_store_init();
+	sector = slot_copy_resume(verify.length, verify.found);
+	if (sector > 0)
+	{
+		TRACE_INFO("update resumed at sector %lu of %lu", sector, sectors);
+	}
 	
-	while(update_address < FLASH_STORE_END)
+	for (; sector < sectors; sector++)
 	{
-		ul_rc = flash_write(update_address, buffer_address, IFLASH_PAGE_SIZE, 0);
-		if (ul_rc != FLASH_RC_OK)
+		offset = sector * ERASE_SECTOR_SIZE;
+		if (!flash_region_blank(store + offset, store + offset + ERASE_SECTOR_SIZE))
+		{
+			ul_rc = flash_erase_region(store + offset, store + offset + ERASE_SECTOR_SIZE);
+			if (ul_rc != FLASH_RC_OK)
+			{
+				printf("Firmware erase error %lu\n\r", (unsigned long)ul_rc);
+				return;
+			}
+		}
+		
+		end = offset + ERASE_SECTOR_SIZE;
+		if (end > verify.length)
+		{
+			end = verify.length;
+		}
+		for (; offset < end; offset += IFLASH_PAGE_SIZE)
 		{
-			printf("-F- Flash programming error %lu\n\r", (unsigned long)ul_rc);
-			return;
+			ul_rc = flash_write_aligned(store + offset, (uint32_t *)(buffer + offset), IFLASH_PAGE_SIZE);
+			if (ul_rc != FLASH_RC_OK)
+			{
+				printf("-F- Flash programming error %lu\n\r", (unsigned long)ul_rc);
+				return;
+			}
+		}
+		
+		if (!slot_copy_record(verify.length, verify.found, sector + 1, sectors))
+		{
+			printf("-F- Manifest programming error\n\r");
 		}
-		update_address += IFLASH_PAGE_SIZE;
-		buffer_address += IFLASH_PAGE_SIZE;
 	}
-	return;
+	PERF_END(PERF_FIRMWARE_UPDATE);
+#endif
 }
 
 /*
 *	Handle firmware update through CLI
 *
+*	@return 1 if the image was received and written
 */
-void firmware_upload(void)
+int firmware_upload(void)
 {
-	firmware_buffer_init();
+	return firmware_receive(true);
+}
+
+/*
+*	Receive an image asked for through the mailbox, into a buffer that
+*	only has its used sectors erased
+*
+*/
+int firmware_upload_mailbox(void)
+{
+	return firmware_receive(false);
+}
+
+/*
+*	Receive an image straight into slot A via XModem ('upload direct')
+*
+*	For bench provisioning, where a failed upload is simply retried:
+*	there is no copy on the next reset and the image may fill both
+*	slots. Everything it can use is erased first, so an interrupted
+*	install leaves no firmware rather than part of one. The first
+*	INSTALL_VECTOR_WORDS of the vector table are held in RAM and left
+*	erased in flash until firmware_install_finish() has checked the
+*	rest in place.
+*
+*	@return 1 if the image was received and written
+*/
+int firmware_install(void)
+{
+	uint32_t base = slot_base(SLOT_A);
+	uint32_t end = slot_install_end();
+	uint32_t erase_start;
+	int ret;
+	
+	memset(&xmodem_stats, 0, sizeof(xmodem_stats));
+	perf_cycles_init();
+	erase_start = DWT->CYCCNT;
+	if (!flash_region_unlock(base, end) || !flash_region_prepare(base, end))
+	{
+		return 0;
+	}
+	xmodem_stats.erase_cycles = DWT->CYCCNT - erase_start;
+	
+	memset(install_vectors, 0xFF, sizeof(install_vectors));
+	install_page_addr = base;
+	ret = xmodem_xfer();
+	install_page_addr = 0;
+	if (!ret)
+	{
+		printf("Error: failed to write firmware to memory\r\n");
+	}
+	return ret;
+}
+
+/*
+*	Verify an installed image and write its vectors, which makes it the
+*	firmware that boots
+*
+*	The held words are added to the sum of the rest of the image in
+*	flash. The manifest record for the image goes first, then the
+*	vectors, and the whole image is checked once more in place. If
+*	anything fails, slot A is left without a vector table.
+*
+*	@return SUCCESS or FAILURE, with the image in verify
+*/
+int firmware_install_finish(void)
+{
+	uint32_t base = slot_base(SLOT_A);
+	uint32_t end = slot_install_end();
+	const uint8_t *held = (const uint8_t *)install_vectors;
+	const uint8_t *byte = (const uint8_t *)base;
+	struct verification_data rest;
+	uint32_t sum = 0;
+	
+	verification_scan(base + IFLASH_PAGE_SIZE, end, &rest);
+	for (int i = 0; i < IFLASH_PAGE_SIZE; i++)
+	{
+		sum += (i < sizeof(install_vectors)) ? held[i] : byte[i];
+	}
+	if (rest.length < 8 || *(const uint32_t *)(base + IFLASH_PAGE_SIZE + rest.length - 4) != 0
+		|| rest.calculated + sum != rest.found)
+	{
+		return FAILURE;		// Too short, no trailer or a bad checksum
+	}
+	if ((install_vectors[1] & ~1) >= STAGE1_BASE && (install_vectors[1] & ~1) < STAGE1_END)
+	{
+		return FAILURE;		// BIOS stage-1, which goes through the buffer
+	}
+	
+	if (slot_install(rest.length + IFLASH_PAGE_SIZE, rest.found)
+		&& install_vectors_write(base) == FLASH_RC_OK
+		&& verification_check_region(base, end) == SUCCESS)
+	{
+		return SUCCESS;
+	}
+	flash_erase_region(base, base + ERASE_SECTOR_SIZE);
+	return FAILURE;
+}
+
+/*
+*	Prepare the buffer and receive an image into it via XModem
+*
+*/
+static int firmware_receive(bool erase_all)
+{
+	uint32_t erase_start;
+	
+	memset(&xmodem_stats, 0, sizeof(xmodem_stats));
+	perf_cycles_init();
+	erase_start = DWT->CYCCNT;
+	if (erase_all)
+	{
+		firmware_buffer_init();
+	}
+	else
+	{
+		firmware_buffer_prepare();
+	}
+	xmodem_stats.erase_cycles = DWT->CYCCNT - erase_start;
 	if(!xmodem_xfer())	// Receive new firmware image via XModem
 	{
 		printf("Error: failed to write firmware to memory\r\n");
+		return 0;
 	}
-	return;
+	return 1;
 }
 
 /*
@@ -335,6 +647,26 @@ void restart(void)
 	while (1);
 }
 
+/*
+*	Put the clock tree and flash wait states back to their reset state,
+*	which is what the firmware's own clock setup starts from
+*
+*/
+static void clock_reset_state(void)
+{
+	if ((PMC->PMC_MCKR & PMC_MCKR_CSS_Msk) == PMC_MCKR_CSS_MAIN_CLK)
+	{
+		return;		// Still on the 4 MHz RC oscillator
+	}
+	
+	pmc_switch_mck_to_mainck(PMC_MCKR_PRES_CLK_1);
+	pmc_switch_mainck_to_fastrc(CKGR_MOR_MOSCRCF_4_MHz);
+	pmc_disable_pllack();
+	pmc_osc_disable_xtal(0);
+	SystemCoreClockUpdate();
+	system_init_flash(CHIP_FREQ_MAINCK_RC_4MHZ);	// Only once the clock is slow
+}
+
 /*
 *	Runs the firmware
 *
@@ -344,6 +676,7 @@ void firmware_run(void)
 	int i;
 	// Pointer to the Application Section
 	void (*firmware_code_entry)(void);
+	uint32_t firmware_base = slot_base(slot_active());
 	   
 	// Disable IRQ
 	__disable_irq();
@@ -356,15 +689,19 @@ void firmware_run(void)
 	__DSB();
 	__ISB();
 	
-	// Rebase the Stack Pointer
-	__set_MSP(*(uint32_t *) FLASH_STORE);
+	boot_time_mark(BOOT_JUMP);	// Before the clock switch
+	boot_handoff_finish();
+	clock_reset_state();
 	
 	// Change the vector table
-	SCB->VTOR = ((uint32_t)FLASH_STORE & SCB_VTOR_TBLOFF_Msk);
+	SCB->VTOR = ((uint32_t)firmware_base & SCB_VTOR_TBLOFF_Msk);
 
      // Load the Reset Handler address of the application
-     firmware_code_entry = (void (*)(void))(unsigned *)(*(unsigned *)(FLASH_STORE + 4));
+     firmware_code_entry = (void (*)(void))(unsigned *)(*(unsigned *)(firmware_base + 4));
 	 
+	// Rebase the Stack Pointer, last as the old stack is gone after it
+	__set_MSP(*(uint32_t *) firmware_base);
+	
 	// Barriers
 	__DSB();
 	__ISB();
@@ -378,7 +715,16 @@ void firmware_run(void)
 /*
 *	XModem transfer
 *
+*	The whole receive loop runs from SRAM, so blocks keep arriving and
+*	being acknowledged while the previous page is being programmed.
+*	Payload bytes are assembled into words and stored straight into the
+*	EFC write latch at their target address; no page is staged in RAM.
+*
+*	Session counters and timings are kept in xmodem_stats. The clock
+*	starts at the first byte, so the wait for the user to start the
+*	transfer on the host is not counted.
 */
+RAMFUNC
 int xmodem_xfer(void)
 {
 	char ch;
@@ -387,9 +733,24 @@ int xmodem_xfer(void)
 	int byte_ctr = 1;
 	int block_ctr = 0;
 	uint8_t xmodem_crc = 0;
-	
-	// Prepare shared_buffer for storing each page of data
-	memset(&shared_buffer, 0xFF, IFLASH_PAGE_SIZE);
+	uint32_t latch_word = 0;	// Word being assembled for the write latch
+	uint32_t pad_word = 0;		// Latched word holding pad_start
+	int pad_start = 0;			// Start of the trailing 0x1A run in the page
+	int block_start = 1;		// buff_ctr at the start of the block being received
+	int block_pad = 0;			// pad_start at the start of the block being received
+	int pos;
+	uint8_t block_num = 0;		// Block number of the block being received
+	uint8_t last_block = 0;		// Block number of the last accepted block
+	bool started = false;		// First byte received
+	bool rx_idle = false;		// Last poll found no data
+	bool reply_sent = false;	// Waiting for the block after an <ACK>/<NAK>
+	bool resync = false;		// Out of frame, dropping bytes until the sender is quiet
+	bool eot_pending = false;	// <EOT> received, waiting for the sender to go quiet
+	uint32_t now;
+	uint32_t session_start = 0;
+	uint32_t idle_start = 0;
+	uint32_t reply_time = 0;
+	uint32_t program_start;
 	
 	while(1)
 	{
@@ -397,73 +758,219 @@ int xmodem_xfer(void)
 		{
 			ch = udi_cdc_getc();
 			timeout_clock = 0;	// reset timeout clock
+			PERF_BEGIN(PERF_XMODEM_BYTE);
 			
-			// Check for <EOT>
+			now = DWT->CYCCNT;
+			if (!started)
+			{
+				session_start = now;
+				started = true;
+			}
+			else if (rx_idle)
+			{
+				xmodem_stats.usb_wait_cycles += now - idle_start;
+			}
+			rx_idle = false;
+			if (reply_sent)
+			{
+				now -= reply_time;
+				xmodem_stats.turnaround[now ? 31 - __CLZ(now) : 0]++;
+				reply_sent = false;
+			}
+			
+			// A 0x04 followed by more data was out of frame, not an <EOT>
+			if (eot_pending)
+			{
+				eot_pending = false;
+				resync = true;
+			}
+			
+			// The rest of a block that timed out, or a resend of it: wait
+			// for the timeout <NAK> and the clean resend that follows
+			if (resync)
+			{
+				PERF_END(PERF_XMODEM_BYTE);
+				continue;
+			}
+			
+			// Check for <EOT>, taken once the sender is quiet after it
 			if (byte_ctr == 1 && ch == X_EOT)	// Note: byte_ctr is cleared to 0 and incremented in the previous loop
 			{
-				printf("%c", X_ACK);	// Send final <ACK>
-				xmodem_clear_padding(&shared_buffer);	// strip the 0x1A fill bytes from the end of the last block
-				
-				// Send remaining data in buffer
-				if(!flash_write_page(&shared_buffer))
-				{
-					return 0;
-				}
-				
-				return 1;
+				eot_pending = true;
+				PERF_END(PERF_XMODEM_BYTE);
+				continue;
 			}
-			else if(block_ctr == 4)
+			if(block_ctr == 4)
 			{
 				// Write the previous page of data
-				if(!flash_write_page(&shared_buffer))
+				program_start = DWT->CYCCNT;
+				if(!flash_write_latched_page())
 				{
 					return 0;
 				}
+				xmodem_stats.program_cycles += DWT->CYCCNT - program_start;
 				
 				// Reset block counter
 				block_ctr = 0;
 				
 				// Reset buffer counter
 				buff_ctr = 1;
-				
-				// Clear buffer to 0xFF for next page of data
-				memset(&shared_buffer, 0xFF, IFLASH_PAGE_SIZE);
+				pad_start = 0;
+			}
+			
+			if (byte_ctr == 1)
+			{
+				if (ch != X_SOH)
+				{
+					resync = true;
+					PERF_END(PERF_XMODEM_BYTE);
+					continue;
+				}
+				block_start = buff_ctr;
+				block_pad = pad_start;
+				PERF_BEGIN(PERF_XMODEM_BLOCK);
+			}
+			else if (byte_ctr == 2)
+			{
+				block_num = ch;
+			}
+			else if (byte_ctr == 3 && (uint8_t)ch != (uint8_t)~block_num)
+			{
+				byte_ctr = 1;	// Not a block header
+				resync = true;
+				PERF_END(PERF_XMODEM_BYTE);
+				continue;
 			}
 			
 			// Check for end of block
 			if (byte_ctr == 132)
 			{
-				if (xmodem_crc == ch)		// Check CRC
+				if (xmodem_crc == ch && xmodem_stats.blocks > 0 && block_num == last_block)
+				{
+					udi_cdc_putc(X_ACK);	// Our <ACK> was lost, accept the block again
+					byte_ctr = 0;			// Start a new 128-byte block
+					buff_ctr = block_start;	// Discard the duplicate data
+					pad_start = block_pad;
+					xmodem_stats.duplicates++;
+				}
+				else if (xmodem_crc == ch)		// Check CRC
 				{
-					printf("%c", X_ACK);	// If the CRC is OK then send a <ACK>
+					udi_cdc_putc(X_ACK);	// If the CRC is OK then send a <ACK>
 					block_ctr++;			// Increment block count
 					byte_ctr = 0;			// Start a new 128-byte block
+					last_block = block_num;
+					xmodem_stats.blocks++;
+					xmodem_stats.bytes += 128;
 				}
 				else
 				{
-					printf("%c", X_NAK);	// If the CRC is incorrect then send a <NAK>
+					udi_cdc_putc(X_NAK);	// If the CRC is incorrect then send a <NAK>
 					byte_ctr = 0;			// Start a new 128-byte block
-					buff_ctr -= 128;		// Overwrite previous data
+					buff_ctr = block_start;	// Overwrite previous data
+					pad_start = block_pad;
+					xmodem_stats.naks++;
+					PERF_COUNT(PERF_XMODEM_NAK);
 				}
 				
 				xmodem_crc = 0;				// Reset CRC
+				reply_time = DWT->CYCCNT;
+				reply_sent = true;
+				PERF_END(PERF_XMODEM_BLOCK);
 			}
 
 			// Don't store the first 3 bytes <SOH>, <###>, <255-###>
 			if (byte_ctr > 3)
 			{
-				shared_buffer[buff_ctr-1] = ch;	// Store received data
+				pos = buff_ctr - 1;
+				if ((pos & 3) == 0)
+				{
+					latch_word = 0;
+				}
+				latch_word |= (uint32_t)(uint8_t)ch << (8 * (pos & 3));
+				if (ch != 0x1A)
+				{
+					pad_start = pos + 1;
+				}
+				
+				// Store each completed word in the latch
+				if ((pos & 3) == 3)
+				{
+					// The latch is busy until the previous page is programmed
+					if (pos == 3)
+					{
+						PERF_BEGIN(PERF_FLASH_WAIT);
+						program_start = DWT->CYCCNT;
+						if (flash_wait_ready() != FLASH_RC_OK)
+						{
+							return 0;
+						}
+						xmodem_stats.program_cycles += DWT->CYCCNT - program_start;
+						PERF_END(PERF_FLASH_WAIT);
+					}
+					if ((pad_start >> 2) == (pos >> 2))
+					{
+						pad_word = latch_word;
+					}
+					xmodem_latch_write(ul_test_page_addr + (pos & ~3), latch_word);
+				}
 				buff_ctr++;
 				xmodem_crc += ch;
 			}
 			
 			byte_ctr++;
+			PERF_END(PERF_XMODEM_BYTE);
+		}
+		if (!rx_idle)
+		{
+			idle_start = DWT->CYCCNT;
+			rx_idle = true;
 		}
 		timeout_clock++;
+		if (eot_pending && timeout_clock > XMODEM_EOT_POLLS)
+		{
+			udi_cdc_putc(X_ACK);	// Send final <ACK>
+			xmodem_stats.total_cycles = DWT->CYCCNT - session_start;
+			
+			// strip the 0x1A fill bytes from the end of the last block
+			if(!xmodem_clear_padding(pad_start, pad_word))
+			{
+				return 0;
+			}
+			
+			// Program the remaining data in the latch
+			program_start = DWT->CYCCNT;
+			if(!flash_write_latched_page())
+			{
+				return 0;
+			}
+			
+			// Don't return to code in flash until the last page is written
+			if(flash_wait_ready() != FLASH_RC_OK)
+			{
+				return 0;
+			}
+			xmodem_stats.program_cycles += DWT->CYCCNT - program_start;
+			
+			return 1;
+		}
 		if (timeout_clock > 1000000)	// Timeout, send <NAK>
 		{
-			printf("%c", X_NAK);
+			// Drop a partly received block, the sender starts it again
+			if (byte_ctr > 1)
+			{
+				byte_ctr = 1;
+				buff_ctr = block_start;
+				pad_start = block_pad;
+				xmodem_crc = 0;
+			}
+			resync = false;
+			udi_cdc_putc(X_NAK);
 			timeout_clock = 0;
+			if (started)
+			{
+				xmodem_stats.timeouts++;
+			}
+			PERF_COUNT(PERF_XMODEM_TIMEOUT);
 		}
 	}
 }
@@ -471,35 +978,294 @@ int xmodem_xfer(void)
 /*
 *	Remove XMODEM 0x1A padding at end of data
 *
+*	The received data only exists in the write latch, so the trailing run
+*	of 0x1A bytes starting at pad_start (and the unused rest of the page)
+*	is overwritten there with the erase value. pad_word holds the latched
+*	word that contains pad_start.
+*/
+RAMFUNC
+static int xmodem_clear_padding(int pad_start, uint32_t pad_word)
+{
+	int word = pad_start >> 2;
+	
+	if (flash_wait_ready() != FLASH_RC_OK)
+	{
+		return 0;
+	}
+	
+	// Keep the data bytes that share a word with the first padding byte
+	if (pad_start & 3)
+	{
+		xmodem_latch_write(ul_test_page_addr + word * 4, pad_word | (0xFFFFFFFF << (8 * (pad_start & 3))));
+		word++;
+	}
+	
+	// Write erase value
+	while (word < IFLASH_PAGE_SIZE / sizeof(uint32_t))
+	{
+		xmodem_latch_write(ul_test_page_addr + word * 4, 0xFFFFFFFF);
+		word++;
+	}
+	
+	return 1;	// Padding characters removed
+}
+
+/*
+*	Store a received word in the write latch, or in install_vectors if
+*	it is one firmware_install() holds back
+*
+*	A held word is latched as erased, so its page is programmed without it.
 */
-xmodem_clear_padding(uint8_t *buff)
+RAMFUNC
+static void xmodem_latch_write(uint32_t address, uint32_t data)
 {
-	int len = IFLASH_PAGE_SIZE;
+	if (install_page_addr != 0 && address - install_page_addr < sizeof(install_vectors))
+	{
+		install_vectors[(address - install_page_addr) / sizeof(uint32_t)] = data;
+		data = 0xFFFFFFFF;
+	}
+	flash_latch_write(address, data);
+}
+
+/*
+*	Program the held vectors into the first page of an installed image
+*
+*	The rest of the page was programmed with these words erased. The
+*	EFC can program an erased 128-bit block of a page on its own, so the
+*	page does not need erasing first.
+*/
+RAMFUNC
+static uint32_t install_vectors_write(uint32_t base)
+{
+	uint32_t rc = flash_wait_ready();
+	
+	if (rc != FLASH_RC_OK)
+	{
+		return rc;
+	}
+	for (int i = 0; i < INSTALL_VECTOR_WORDS; i++)
+	{
+		flash_latch_write(base + i * sizeof(uint32_t), install_vectors[i]);
+	}
+	rc = flash_program_latch_start(base);
+	if (rc == FLASH_RC_OK)
+	{
+		rc = flash_wait_ready();
+	}
+	return rc;
+}
+
+/*
+*	Wait for a byte from the host
+*
+*	@return the byte, or -1 after timeout_ms
+*/
+int cdc_getc_timeout(uint32_t timeout_ms)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t limit = (sysclk_get_cpu_hz() / 1000) * timeout_ms;
 	
-	// Overwrite the padding element in the buffer (zero-indexed)
-	while(len > 0)	// Move from end of buffer to beginning
+	while (DWT->CYCCNT - start < limit)
 	{
-		if(buff[len-1] != 0xFF && buff[len-1] != 0x1A)
+		if (udi_cdc_is_rx_ready())
 		{
-			return;
+			return udi_cdc_getc() & 0xFF;
 		}
-		else if(buff[len-1] == 0x1A)
+	}
+	return -1;
+}
+
+/*
+*	CRC-16/XMODEM (polynomial 0x1021), four bits at a time
+*
+*	@param crc - 0 to start, or the CRC of the data before
+*/
+uint16_t xmodem_crc16(uint16_t crc, const void *data, int length)
+{
+	static const uint16_t nibble[16] =
+	{
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+		0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+	};
+	const uint8_t *byte = (const uint8_t *)data;
+	
+	for (int i = 0; i < length; i++)
+	{
+		crc = (crc << 4) ^ nibble[(crc >> 12) ^ (byte[i] >> 4)];
+		crc = (crc << 4) ^ nibble[(crc >> 12) ^ (byte[i] & 0x0F)];
+	}
+	return crc;
+}
+
+/*
+*	Copy flash into a block, 16 bytes at a time
+*
+*	Each group of four words is one 128-bit line of the flash read
+*	path, so a line is fetched once whatever the wait states.
+*/
+static void xmodem_read_flash(uint32_t *data, uint32_t address, int length)
+{
+	const uint32_t *line = (const uint32_t *)address;
+	uint32_t w0, w1, w2, w3;
+	
+	for (int i = 0; i < length / 4; i += 4)
+	{
+		w0 = line[i];
+		w1 = line[i + 1];
+		w2 = line[i + 2];
+		w3 = line[i + 3];
+		data[i] = w0;
+		data[i + 1] = w1;
+		data[i + 2] = w2;
+		data[i + 3] = w3;
+	}
+}
+
+/*
+*	Send a flash range to the host with XModem
+*
+*	The BIOS is the sender. A receiver that starts with 'C' gets 1KB
+*	blocks (<STX>) with a CRC-16, one that starts with <NAK> gets 128
+*	byte blocks with the checksum. A block is sent again on a <NAK> or
+*	when no reply comes, up to XMODEM_RETRIES times; <CAN> from the
+*	host ends the transfer. Ranges are whole 128 byte blocks, so there
+*	is no padding in the last one.
+*
+*	@param start - first address, 16 byte aligned
+*	@param length - bytes, a multiple of 128
+*	@param stats - blocks, <NAK>s, timeouts and the transfer time
+*	@return 1 if the host acknowledged every block and the <EOT>
+*/
+int xmodem_send(uint32_t start, uint32_t length, struct xmodem_stats *stats)
+{
+	uint32_t data[XMODEM_1K / sizeof(uint32_t)];
+	uint8_t header[3];
+	uint8_t trailer[2];
+	uint32_t offset = 0;
+	uint32_t session_start, sent;
+	uint16_t crc;
+	uint8_t seq = 1;
+	int size, tries, reply;
+	bool crc_mode;
+	
+	memset(stats, 0, sizeof(*stats));
+	perf_cycles_init();
+	
+	// The receiver asks for the first block every few seconds
+	do
+	{
+		reply = cdc_getc_timeout(XMODEM_START_MS);
+	} while (reply >= 0 && reply != X_CRC && reply != X_NAK && reply != X_CAN);
+	if (reply != X_CRC && reply != X_NAK)
+	{
+		return 0;
+	}
+	crc_mode = (reply == X_CRC);
+	session_start = DWT->CYCCNT;
+	
+	while (offset < length)
+	{
+		size = (crc_mode && length - offset >= XMODEM_1K) ? XMODEM_1K : 128;
+		header[0] = (size == XMODEM_1K) ? X_STX : X_SOH;
+		header[1] = seq;
+		header[2] = 255 - seq;
+		xmodem_read_flash(data, start + offset, size);
+		if (crc_mode)
+		{
+			crc = xmodem_crc16(0, data, size);
+			trailer[0] = crc >> 8;
+			trailer[1] = crc & 0xFF;
+		}
+		else
+		{
+			trailer[0] = 0;
+			for (int i = 0; i < size; i++) trailer[0] += ((const uint8_t *)data)[i];
+		}
+		
+		for (tries = 0; ; tries++)
 		{
-			// Latch onto 0x1A
-			while(len > 0 && buff[len-1] == 0x1A)
+			if (tries == XMODEM_RETRIES)
 			{
-				// Write erase value
-				buff[len-1] = 0xFF;
-				len--;
+				udi_cdc_putc(X_CAN);
+				udi_cdc_putc(X_CAN);
+				return 0;
 			}
+			udi_cdc_write_buf(header, sizeof(header));
+			udi_cdc_write_buf(data, size);
+			udi_cdc_write_buf(trailer, crc_mode ? 2 : 1);
+			sent = DWT->CYCCNT;
+			do
+			{
+				reply = cdc_getc_timeout(XMODEM_REPLY_MS);
+			} while (reply == X_CRC);	// Repeated start request
+			sent = DWT->CYCCNT - sent;
+			stats->usb_wait_cycles += sent;
+			stats->turnaround[sent ? 31 - __CLZ(sent) : 0]++;
 			
-			return;
+			if (reply == X_ACK) break;
+			if (reply == X_CAN) return 0;
+			if (reply < 0)
+			{
+				stats->timeouts++;
+			}
+			else
+			{
+				stats->naks++;
+			}
 		}
-		
-		len--;
+		stats->blocks++;
+		stats->bytes += size;
+		offset += size;
+		seq++;
+	}
+	
+	for (tries = 0; tries < XMODEM_RETRIES; tries++)
+	{
+		udi_cdc_putc(X_EOT);
+		if (cdc_getc_timeout(XMODEM_REPLY_MS) == X_ACK)
+		{
+			stats->total_cycles = DWT->CYCCNT - session_start;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+*	Print the statistics of the last XModem upload
+*
+*/
+void xmodem_stats_dump(void)
+{
+	uint32_t cyc_per_us = sysclk_get_cpu_hz() / 1000000;
+	uint32_t total_us = xmodem_stats.total_cycles / cyc_per_us;
+	
+	printf("\r\n");
+	printf("Upload statistics\r\n");
+	printf("-------------------------------------------\r\n");
+	printf("%-24s %12lu\r\n", "Bytes received", (unsigned long)xmodem_stats.bytes);
+	printf("%-24s %12lu\r\n", "Blocks accepted", (unsigned long)xmodem_stats.blocks);
+	printf("%-24s %12lu\r\n", "Checksum NAKs", (unsigned long)xmodem_stats.naks);
+	printf("%-24s %12lu\r\n", "Timeouts", (unsigned long)xmodem_stats.timeouts);
+	printf("%-24s %12lu\r\n", "Duplicate blocks", (unsigned long)xmodem_stats.duplicates);
+	printf("%-24s %12lu us\r\n", "Transfer time", (unsigned long)total_us);
+	printf("%-24s %12lu us\r\n", "Erase", (unsigned long)(xmodem_stats.erase_cycles / cyc_per_us));
+	printf("%-24s %12lu us\r\n", "Flash program/wait", (unsigned long)(xmodem_stats.program_cycles / cyc_per_us));
+	printf("%-24s %12lu us\r\n", "USB wait", (unsigned long)(xmodem_stats.usb_wait_cycles / cyc_per_us));
+	if (total_us > 0)
+	{
+		printf("%-24s %12lu KB/s\r\n", "Throughput",
+		(unsigned long)(((uint64_t)xmodem_stats.bytes * 1000000 / 1024) / total_us));
 	}
 	
-	return;	// Padding characters removed
+	printf("\r\nBlock turnaround (<ACK>/<NAK> to next block)\r\n");
+	for (int b = 0; b < XMODEM_HIST_BUCKETS; b++)
+	{
+		if (xmodem_stats.turnaround[b] == 0) continue;
+		printf("  >= %10lu cyc (%8lu us): %lu\r\n", (unsigned long)(1UL << b),
+		(unsigned long)((1UL << b) / cyc_per_us), (unsigned long)xmodem_stats.turnaround[b]);
+	}
+	printf("\r\n");
 }
 
 /*
@@ -522,31 +1288,74 @@ int write_verification(uint32_t location, uint64_t value)
 	return 0;
 }
 
+/*
+*	Verify the firmware in the update buffer
+*
+*/
 int verification_check(void)
 {
-	char* fw_end_pmem	= (char*)FLASH_BUFFER_END;	// Buffer pointer to store the last address
-	char* fw_step_pmem  = (char*)FLASH_BUFFER;		// Buffer pointer to the starting address
+	return verification_check_region(slot_base(slot_staging()), slot_end(slot_staging()));
+}
+
+/*
+*	Verify the firmware image held between region_start and region_end
+*
+*/
+int verification_check_region(uint32_t region_start, uint32_t region_end)
+{
+	int ret;
+	
+	uint32_t start_cycles = DWT->CYCCNT;
+	
+	boot_time_mark(BOOT_VERIFY_START);
+	PERF_BEGIN(PERF_VERIFICATION);
+	ret = verification_scan(region_start, region_end, &verify);
+	PERF_END(PERF_VERIFICATION);
+	verify.cycles = DWT->CYCCNT - start_cycles;
+	boot_time_mark(BOOT_VERIFY_END);
+	
+	TRACE("image %08x-%08x; %lu bytes", region_start, region_start + verify.length, verify.length);
+	TRACE("CRC sum:   %04x", verify.calculated);
+	TRACE("CRC found: %04x", verify.found);
+	return ret;
+}
+
+/*
+*	Sum the image held between region_start and region_end and compare
+*	it with the checksum in its trailer
+*
+*	Only reads flash and writes *result, so the firmware can call it
+*	through the service table (see services.h).
+*/
+int verification_scan(uint32_t region_start, uint32_t region_end, struct verification_data *result)
+{
+	const char* fw_end_pmem	= (const char*)region_end;	// Buffer pointer to store the last address
+	const char* fw_step_pmem  = (const char*)region_start;	// Buffer pointer to the starting address
 	uint32_t crc_sum	= 0;						// Store CRC sum
 	uint8_t	 pad_error	= 0;						// Set when padding is not found
 	
 	/* Add all bytes of the uploaded firmware */
 	// Decrement the pointer until the previous address has data in it (not 0xFF)
-	while(*(fw_end_pmem-1) == '\xFF' && fw_end_pmem > FLASH_BUFFER)
+	while(fw_end_pmem > (const char*)region_start && *(fw_end_pmem-1) == '\xFF')
 	{
 		fw_end_pmem--;
 	}
+	
+	if (fw_end_pmem - (const char*)region_start < 8)
+	{
+		// Blank, or too short to hold the checksum and padding
+		result->calculated = 0;
+		result->found = 0xFFFFFFFF;
+		result->length = fw_end_pmem - (const char*)region_start;
+		return FAILURE;
+	}
 
 	for(int sig=1; sig<=4; sig++)
 	{
-		if(*(fw_end_pmem-sig) != NULL)
+		if(*(fw_end_pmem-sig) != 0)
 		{
-			TRACE("signature padding %d not found - last address: %08x", sig, fw_end_pmem);
 			pad_error = 1;
 		}
-		else
-		{
-			TRACE("signature padding %d found", sig);
-		}
 	}
 	
 	// Start summing all bytes
@@ -569,25 +1378,17 @@ int verification_check(void)
 		}
 	}
 	
-	TRACE("fw_step_pmem %08x; fw_end_pmem %08x;", fw_step_pmem, fw_end_pmem);
-	
-	// Update structure entry
-	TRACE("CRC sum:   %04x", crc_sum);
-	verify.calculated = crc_sum;
+	result->calculated = crc_sum;
 	
 	/* Compare with last 4 bytes of firmware */
 	// Get last 4 bytes of firmware	(4-byte CRC, 4-byte padding)
-	verify.found = *(uint32_t*)(fw_end_pmem - 8);
-	
-	TRACE("CRC found: %04x", verify.found);
+	result->found = *(const uint32_t*)(fw_end_pmem - 8);
+	result->length = (uint32_t)fw_end_pmem - region_start;
 	
 	// Compare calculated and found CRC
-	if(verify.found == verify.calculated)
-	{
-		return SUCCESS;	
-	}
-	else
+	if(result->found == result->calculated)
 	{
-		return FAILURE;
+		return SUCCESS;
 	}
-}
\ No newline at end of file
+	return FAILURE;
+}
@@ -34,33 +34,76 @@
 
 void get_serial(uint32_t *uid_buf);
 int firmware_check(void);
-void firmware_upload(void);
+int firmware_upload(void);
+int firmware_upload_mailbox(void);
+int firmware_install(void);
+int firmware_install_finish(void);
 void firmware_update(void);
 void firmware_run(void);
 void restart(void);
-int flash_write_page(uint8_t *flash_page);
+int flash_write_latched_page(void);
 void firmware_buffer_init(void);
-void firmware_store_init(void);
+int firmware_buffer_prepare(void);
+int flash_region_blank(uint32_t start_address, uint32_t end_address);
+int flash_records_unlock(uint32_t start, uint32_t end);
+int firmware_store_init(void);
+uint32_t flash_erase_region(uint32_t erase_address, uint32_t end_address);
 int xmodem_xfer(void);
-void xmodem_clear_padding(uint8_t *buff);
+void xmodem_stats_dump(void);
+
+struct verification_data
+{
+	uint32_t calculated;	// Last 4 bytes from summed data
+	uint32_t found;			// 4 bytes at the end of uploaded firmware
+	uint32_t cycles;		// Time taken by the last check
+	uint32_t length;		// Image bytes including the checksum and padding
+};
 
 // Verification testing commands
+//#define VERIFICATION_TEST_VALUE	0x4E5000ECCF020046
+#define VERIFICATION_TEST_VALUE		0x58460001FEF04E4EULL	// Reversed for testing
 int write_verification(uint32_t location, uint64_t value);
 int verification_check(void);
+int verification_check_region(uint32_t region_start, uint32_t region_end);
+int verification_scan(uint32_t region_start, uint32_t region_end, struct verification_data *result);
 
-struct verification_data
+#define XMODEM_HIST_BUCKETS	32	// One bucket per power of two cycles
+
+struct xmodem_stats
 {
-	uint32_t calculated;	// Last 4 bytes from summed data
-	uint32_t found;			// 4 bytes at the end of uploaded firmware
+	uint32_t bytes;			// Payload bytes accepted
+	uint32_t blocks;		// Blocks accepted
+	uint32_t naks;			// Blocks rejected on checksum
+	uint32_t timeouts;		// Timeout <NAK>s sent once the transfer started
+	uint32_t duplicates;	// Retransmitted blocks that were already accepted
+	uint32_t erase_cycles;	// Erasing the buffer region before the transfer
+	uint32_t program_cycles;	// Starting page writes and waiting for the EFC
+	uint32_t usb_wait_cycles;	// Polling with no data from the host
+	uint32_t total_cycles;	// First byte to final <ACK>
+	uint32_t turnaround[XMODEM_HIST_BUCKETS];	// <ACK>/<NAK> to next block
 };
 
+int xmodem_send(uint32_t start, uint32_t length, struct xmodem_stats *stats);
+uint16_t xmodem_crc16(uint16_t crc, const void *data, int length);
+int cdc_getc_timeout(uint32_t timeout_ms);
+
+#define X_SOH 0x01
+#define X_STX 0x02
 #define X_EOT 0x04
 #define X_ACK 0x06
 #define X_NAK 0x15
+#define X_CAN 0x18
+#define X_CRC 'C'		// Receiver start request for CRC-16 blocks
+
+#define XMODEM_1K			1024
+#define XMODEM_RETRIES		10
+#define XMODEM_START_MS		30000	// Wait for the host to start receiving
+#define XMODEM_REPLY_MS		3000
+#define XMODEM_EOT_POLLS	20000	// Quiet receive polls that confirm an <EOT>, a few ms
 
 #define ERASE_SECTOR_SIZE	65536
+#define INSTALL_VECTOR_WORDS	4	// Vector table words 'upload direct' writes last, one 128-bit block
 //#define NEW_FW_BASE			(IFLASH_ADDR + (5*IFLASH_NB_OF_PAGES/8)*IFLASH_PAGE_SIZE)
-#define NEW_FW_MAX_SIZE		196608
 
 #define SUCCESS 0
 #define FAILURE 1
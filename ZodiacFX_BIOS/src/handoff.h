@@ -0,0 +1,82 @@
+/**
+ * @file
+ * handoff.h
+ *
+ * the boot handoff block definitions shared with the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#include <stdint.h>
+
+/*
+*	The BIOS leaves this block in the top 256 bytes of SRAM before it
+*	jumps to the firmware. This header only depends on stdint.h so the
+*	firmware can use it as it is. The firmware must keep the block out
+*	of its own RAM (end its linker ram region at HANDOFF_ADDR) or copy
+*	it before the C runtime starts.
+*
+*	Check magic, version and checksum before using it. A newer BIOS
+*	only appends fields and bumps the version; size covers what it
+*	wrote.
+*/
+#define HANDOFF_ADDR		0x2001FF00
+#define HANDOFF_SIZE		0x100
+#define HANDOFF_MAGIC		0x5A464848	// "ZFHH"
+#define HANDOFF_VERSION		1
+#define HANDOFF_MARKS		16
+
+// Boot paths
+#define HANDOFF_PATH_RUN	2		// Checked, no valid update in the buffer
+#define HANDOFF_PATH_UPDATE	1		// Update verified and copied into place
+#define HANDOFF_PATH_FAST	3		// Straight from reset, nothing checked
+
+// Flags
+#define HANDOFF_SERIAL_VALID	(1 << 0)	// serial[] holds the chip unique ID
+#define HANDOFF_IMAGE_VERIFIED	(1 << 1)	// image_* describe the running image
+#define HANDOFF_TRIAL_BOOT		(1 << 2)	// Unconfirmed A/B update, see mailbox.h
+
+struct boot_handoff
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;				// Bytes written by the BIOS
+	uint32_t flags;
+	uint32_t reset_cause;		// RSTC_SR RSTTYP: 0 general, 1 backup, 2 watchdog, 3 software, 4 user
+	uint32_t boot_path;
+	char bios_version[8];		// NUL terminated
+	uint32_t image_length;		// Bytes including the checksum and padding
+	uint32_t image_checksum;	// Byte sum held in the image trailer
+	uint32_t serial[4];
+	uint32_t boot_marked;		// Bit per boot mark that was reached
+	uint32_t boot_us[HANDOFF_MARKS];	// Microseconds from reset, BOOT_MARK_LIST order
+	uint32_t checksum;			// ~(sum of the words before it)
+};
+
+#endif /* HANDOFF_H_ */
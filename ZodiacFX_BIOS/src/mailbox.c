@@ -0,0 +1,69 @@
+/**
+ * @file
+ * mailbox.c
+ *
+ * the GPBR mailbox functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+#include <asf.h>
+#include "conf_bios.h"
+#include "mailbox.h"
+
+/*
+*	Check for a request without taking it
+*
+*	Only reads GPBR, so it is safe before the C runtime is set up.
+*/
+int mailbox_pending(void)
+{
+	return (GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND] & MAILBOX_MAGIC_MSK) == MAILBOX_MAGIC;
+}
+
+/*
+*	Take the request left by the firmware and clear the mailbox
+*
+*/
+int mailbox_take(struct mailbox_request *request)
+{
+	uint32_t command = GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND];
+	
+	if ((command & MAILBOX_MAGIC_MSK) != MAILBOX_MAGIC)
+	{
+		return 0;
+	}
+	
+	request->command = command & 0xFF;
+	request->protocol = (command >> 8) & 0xFF;
+	request->size = GPBR->SYS_GPBR[MAILBOX_GPBR_SIZE];
+	request->checksum = GPBR->SYS_GPBR[MAILBOX_GPBR_CHECKSUM];
+	
+	GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND] = 0;
+	GPBR->SYS_GPBR[MAILBOX_GPBR_SIZE] = 0;
+	GPBR->SYS_GPBR[MAILBOX_GPBR_CHECKSUM] = 0;
+	return 1;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file
+ * mailbox.h
+ *
+ * the GPBR mailbox definitions shared with the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#include <stdint.h>
+
+/*
+*	The firmware asks the BIOS for something on the next reset through
+*	the General Purpose Backup Registers, which keep their contents over
+*	a soft reset. Write the size and checksum first, the command word
+*	last, then reset with rstc_start_software_reset(). The BIOS clears
+*	the mailbox when it takes the request, so a failed request is not
+*	repeated on the following reset.
+*
+*	This header only depends on stdint.h so the firmware can use it as
+*	it is.
+*/
+#define MAILBOX_GPBR_COMMAND	0	// MAILBOX_COMMAND(), 0 when empty
+#define MAILBOX_GPBR_SIZE		1	// Expected image bytes, 0 if not known
+#define MAILBOX_GPBR_CHECKSUM	2	// Expected image byte sum, 0 if not known
+#define MAILBOX_GPBR_TRIAL		3	// Trial boot count, see below
+
+#define MAILBOX_MAGIC			0x4D420000	// "MB" in the top half
+#define MAILBOX_MAGIC_MSK		0xFFFF0000
+#define MAILBOX_COMMAND(cmd, protocol)	(MAILBOX_MAGIC | ((protocol) << 8) | (cmd))
+
+// Commands
+#define MAILBOX_CMD_UPLOAD		1	// Receive an image straight after reset
+#define MAILBOX_CMD_ROLLBACK	2	// Go back to the image the last update replaced
+#define MAILBOX_CMD_STAGE1		3	// Install the BIOS stage-1 image staged in a slot
+
+/*
+*	MAILBOX_CMD_STAGE1 is taken by stage-0 (see stage0.h), not the BIOS:
+*	stage a stage-1 image in a slot through the service table, then ask
+*	for it with MAILBOX_COMMAND(MAILBOX_CMD_STAGE1, 0). Size and checksum
+*	are not used, stage-0 checks the image trailer.
+*/
+
+// Upload protocols
+#define MAILBOX_PROTO_XMODEM	0
+
+/*
+*	With A/B slots a new image runs on trial. The BIOS counts its boots
+*	in MAILBOX_GPBR_TRIAL and goes back to the image it replaced after
+*	BIOS_TRIAL_BOOTS of them, unless the firmware has confirmed it by
+*	writing MAILBOX_TRIAL_CONFIRM there; the BIOS records the
+*	confirmation on the next reset. The handoff block flags trial boots
+*	(HANDOFF_TRIAL_BOOT). The count lives in the backup domain, so a
+*	power cycle without VBAT starts it again.
+*/
+#define MAILBOX_TRIAL_MAGIC		0x54520000	// "TR" in the top half, boots counted below
+#define MAILBOX_TRIAL_CONFIRM	0x544F4B21	// "TOK!"
+
+struct mailbox_request
+{
+	uint8_t command;
+	uint8_t protocol;
+	uint32_t size;
+	uint32_t checksum;
+};
+
+int mailbox_pending(void);
+int mailbox_take(struct mailbox_request *request);
+
+#endif /* MAILBOX_H_ */
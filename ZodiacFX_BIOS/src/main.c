@@ -34,12 +34,23 @@
 
 #include "cmd_line.h"
 #include "flash.h"
+#include "perf.h"
+#include "boot.h"
+#include "mailbox.h"
+#include "slot.h"
+#include "partition.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "dfu.h"
 
 // Global variables
 int charcount, charcount_last;
 uint32_t uid_buf[4];
+extern struct verification_data verify;
 
-bool bios_debug = 0;
+// Exception vectors are fetched from SRAM so the USB interrupt can still
+// be taken while the EFC is busy with the flash plane the BIOS runs from
+static uint32_t ram_vector_table[16 + PERIPH_COUNT_IRQn] COMPILER_ALIGNED(256);
 
 /*
 *	This function is where bad code goes to die!
@@ -51,6 +62,25 @@ void HardFault_Handler(void)
 	while(1);
 }
 
+/*
+*	Copy the vector table to SRAM and switch VTOR over to it
+*
+*/
+static void vector_table_relocate(void)
+{
+	uint32_t *flash_vectors = (uint32_t *)(SCB->VTOR & SCB_VTOR_TBLOFF_Msk);
+	
+	for(int i = 0; i < 16 + PERIPH_COUNT_IRQn; i++)
+	{
+		ram_vector_table[i] = flash_vectors[i];
+	}
+	
+	__DSB();
+	SCB->VTOR = ((uint32_t)ram_vector_table & SCB_VTOR_TBLOFF_Msk);
+	__DSB();
+	__ISB();
+}
+
 /*
 *	Main program loop
 *
@@ -58,21 +88,76 @@ void HardFault_Handler(void)
 int main (void)
 {	 
 	int flash_check = -1;
-	unsigned long* firmware_pmem = (unsigned long*)FLASH_STORE;
-	unsigned long* buffer_pmem = (unsigned long*)FLASH_BUFFER;
+	uint32_t check_cycles, update_cycles = 0;
+	struct mailbox_request mailbox;
+	int mailbox_upload = 0;
+	int rollback = 0;
 	
-	flash_check = firmware_check();		// Check buffer and firmware regions
+	boot_time_mark(BOOT_MAIN);
+	perf_init();	// Start the cycle counter for the profiling probes
+	trace_init();
+	partition_init();	// Slot layout for this part, written on the first boot
+	
+	// Requests from the firmware: an upload goes ahead whatever is
+	// installed, a rollback is done before the check
+	if (mailbox_take(&mailbox))
+	{
+		rollback = (mailbox.command == MAILBOX_CMD_ROLLBACK);
+		mailbox_upload = (mailbox.command == MAILBOX_CMD_UPLOAD);
+	}
+	
+	if (!mailbox_upload)
+	{
+		// A pending update is verified and copied, or a rollback checked,
+		// at full clock speed. firmware_run() puts the reset clocks back
+		// before the jump
+		if (slot_pending() || slot_trial() || rollback)
+		{
+			boot_time_mark(BOOT_SYSCLK);
+			sysclk_init();
+		}
+		
+		if (rollback)
+		{
+			slot_rollback();
+		}
+		else
+		{
+			slot_trial_boot();	// Count a boot of an unconfirmed update
+		}
+		
+		boot_time_mark(BOOT_CHECK_START);
+		check_cycles = DWT->CYCCNT;
+		flash_check = firmware_check();		// Check buffer and firmware regions
+		check_cycles = DWT->CYCCNT - check_cycles;
+		boot_time_mark(BOOT_CHECK_END);
+	}
 	
 	switch(flash_check)
 	{
 		case SKIP:
+			telemetry_log_boot(SKIP, check_cycles, 0, slot_pending());
 			break;
 		case UPDATE:
+			boot_time_mark(BOOT_UPDATE_START);
+			update_cycles = DWT->CYCCNT;
 			firmware_update();
+			update_cycles = DWT->CYCCNT - update_cycles;
+			boot_time_mark(BOOT_UPDATE_END);
+			telemetry_log_boot(UPDATE, check_cycles, update_cycles, 0);
+#if !BIOS_AB_SLOTS
+			boot_time_mark(BOOT_ERASE_START);
 			firmware_buffer_init();	// Clear update buffer
+			boot_time_mark(BOOT_ERASE_END);
+#endif
+			get_serial(uid_buf);
+			boot_handoff_begin(UPDATE, uid_buf, &verify);
 			firmware_run();
 			break;
 		case RUN:
+			telemetry_log_boot(RUN, check_cycles, 0, slot_pending());
+			get_serial(uid_buf);
+			boot_handoff_begin(RUN, uid_buf, NULL);
 			firmware_run();
 			break;		
 	}
@@ -85,20 +170,29 @@ int main (void)
 	cCommand[0] = '\0';
 	charcount = 0;
 	
-	sysclk_init();
+	boot_time_mark(BOOT_CLI);	// Before the clock switch
+	if ((PMC->PMC_MCKR & PMC_MCKR_CSS_Msk) != PMC_MCKR_CSS_PLLA_CLK)
+	{
+		sysclk_init();
+	}
 	board_init();
 
 	wdt_init(WDT, wdt_mode, timeout_value, timeout_value);
 	wdt_disable(WDT);
 
+	vector_table_relocate(); // Serve interrupts from SRAM during flash writes
 	irq_initialize_vectors(); // Initialize interrupt vector table support.
 	cpu_irq_enable(); // Enable interrupts
 	stdio_usb_init();
 	
-	bios_debug = 1;
+	if (mailbox_upload)
+	{
+		upload_mailbox(&mailbox);	// Only returns if the upload failed
+	}
 	
 	while(1)
 	{
 		task_command(cCommand, cCommand_last);
+		dfu_task();		// Flash writes for DFU downloads
 	}
 }
@@ -0,0 +1,196 @@
+/**
+ * @file
+ * partition.c
+ *
+ * the flash partition table
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "partition.h"
+#include "trace.h"
+
+#define DESCRIPTOR_WORDS	16
+
+// Global variables
+uint32_t flash_end = IFLASH_ADDR + IFLASH_SIZE;
+
+// The conf_bios.h layout, used until a table has been written
+static const struct partition_table partition_default =
+{
+	.magic = PARTITION_MAGIC,
+	.version = PARTITION_VERSION,
+	.flash_size = IFLASH_SIZE,
+	.base = { FLASH_STORE, FLASH_BUFFER },
+	.size = { FLASH_STORE_END - FLASH_STORE, FLASH_BUFFER_END - FLASH_BUFFER },
+};
+
+// Internal Functions
+static uint32_t partition_checksum(const struct partition_table *table);
+static int partition_valid(const struct partition_table *table);
+static int partition_blank(void);
+static uint32_t partition_flash_size(void);
+
+/*
+*	Sum every word of a table before the checksum
+*
+*/
+static uint32_t partition_checksum(const struct partition_table *table)
+{
+	const uint32_t *word = (const uint32_t *)table;
+	uint32_t sum = 0;
+	
+	for (int i = 0; i < offsetof(struct partition_table, checksum) / sizeof(uint32_t); i++)
+	{
+		sum += word[i];
+	}
+	return sum;
+}
+
+/*
+*	Check a table's checksum and that its slots are whole sectors,
+*	above the BIOS, in flash and apart
+*
+*/
+static int partition_valid(const struct partition_table *table)
+{
+	uint32_t end = IFLASH_ADDR + table->flash_size;
+	
+	if (table->magic != PARTITION_MAGIC || table->version != PARTITION_VERSION
+		|| table->checksum != partition_checksum(table))
+	{
+		return 0;
+	}
+	for (int i = 0; i < PARTITION_COUNT; i++)
+	{
+		if (table->base[i] < FLASH_STORE || table->base[i] >= end || table->size[i] == 0
+			|| table->base[i] % ERASE_SECTOR_SIZE != 0 || table->size[i] % ERASE_SECTOR_SIZE != 0
+			|| table->size[i] > end - table->base[i])
+		{
+			return 0;
+		}
+	}
+	return table->base[0] + table->size[0] <= table->base[1]
+		|| table->base[1] + table->size[1] <= table->base[0];
+}
+
+static int partition_blank(void)
+{
+	const uint32_t *word = (const uint32_t *)PARTITION_BASE;
+	
+	for (int i = 0; i < sizeof(struct partition_table) / sizeof(uint32_t); i++)
+	{
+		if (word[i] != 0xFFFFFFFF) return 0;
+	}
+	return 1;
+}
+
+/*
+*	Size of the flash from the EFC descriptor, 0 if it can't be read
+*
+*/
+static uint32_t partition_flash_size(void)
+{
+	uint32_t descriptor[DESCRIPTOR_WORDS];
+	
+	if (flash_get_descriptor(IFLASH_ADDR, descriptor, DESCRIPTOR_WORDS) < 3 || descriptor[2] != IFLASH_PAGE_SIZE)
+	{
+		return 0;
+	}
+	return flash_get_page_count(descriptor) * IFLASH_PAGE_SIZE;
+}
+
+/*
+*	The table in use: the one in flash if it is valid, the conf_bios.h
+*	layout if not
+*
+*/
+const struct partition_table *partition_table(void)
+{
+	const struct partition_table *table = (const struct partition_table *)PARTITION_BASE;
+	
+	return partition_valid(table) ? table : &partition_default;
+}
+
+/*
+*	Read the table, writing one for this part if there is none yet
+*
+*/
+void partition_init(void)
+{
+	uint32_t page[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
+	struct partition_table *table = (struct partition_table *)page;
+	uint32_t flash_size, size;
+	
+	if (!partition_valid((const struct partition_table *)PARTITION_BASE) && partition_blank())
+	{
+		flash_size = partition_flash_size();
+		size = ((IFLASH_ADDR + flash_size - FLASH_STORE) / 2) & ~(ERASE_SECTOR_SIZE - 1);
+		if (flash_size >= FLASH_BUFFER_END - IFLASH_ADDR && size > 0)
+		{
+			memset(page, 0xFF, sizeof(page));
+			table->magic = PARTITION_MAGIC;
+			table->version = PARTITION_VERSION;
+			table->flash_size = flash_size;
+			table->base[0] = FLASH_STORE;
+			table->size[0] = size;
+			table->base[1] = FLASH_STORE + size;
+			table->size[1] = size;
+			table->checksum = partition_checksum(table);
+			TRACE_INFO("partition table: %lu KB flash, %lu KB slots", flash_size / 1024, size / 1024);
+			if (!flash_records_unlock(PARTITION_BASE, PARTITION_BASE + IFLASH_PAGE_SIZE)
+				|| flash_write_aligned(PARTITION_BASE, page, IFLASH_PAGE_SIZE) != FLASH_RC_OK)
+			{
+				TRACE_ERROR("partition table write error");
+			}
+		}
+	}
+	
+	flash_end = IFLASH_ADDR + partition_table()->flash_size;
+}
+
+/*
+*	Show the partition table
+*
+*/
+void partition_dump(void)
+{
+	const struct partition_table *table = partition_table();
+	
+	printf("Partition table %s, %lu KB of flash\r\n",
+	(table == &partition_default) ? "not written, using the built in layout" : "in flash",
+	(unsigned long)(table->flash_size / 1024));
+	for (int i = 0; i < PARTITION_COUNT; i++)
+	{
+		printf("  Slot %c  %08lx - %08lx  %lu KB\r\n", 'A' + i, (unsigned long)table->base[i],
+		(unsigned long)(table->base[i] + table->size[i]), (unsigned long)(table->size[i] / 1024));
+	}
+}
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * partition.h
+ *
+ * the flash partition table
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#ifndef PARTITION_H_
+#define PARTITION_H_
+
+#include <stdint.h>
+
+/*
+*	The partition table says where the two firmware slots are. It sits
+*	in one page at PARTITION_BASE and is written once, the first time
+*	this BIOS boots: the flash size comes from the EFC descriptor and
+*	everything from FLASH_STORE to the end of flash is split into two
+*	slots of whole 64KB sectors. On a SAM4E8 that is the 192KB slots of
+*	conf_bios.h, on a SAM4E16 the slots are 448KB each.
+*
+*	A table is never rewritten: the slots it describes hold the images
+*	the manifest records, which a new layout would lose. Until there
+*	is a valid one the conf_bios.h layout is used. partition_table()
+*	only reads flash, so it is safe before the C runtime is set up and
+*	from the service table.
+*/
+#define PARTITION_MAGIC		0x54524150	// "PART"
+#define PARTITION_VERSION	1
+#define PARTITION_COUNT		2
+
+struct partition_table
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flash_size;				// Bytes, from the EFC descriptor
+	uint32_t base[PARTITION_COUNT];		// Slot A (run) and slot B (buffer)
+	uint32_t size[PARTITION_COUNT];		// Whole 64KB sectors
+	uint32_t checksum;					// Sum of the words above
+};
+
+// The end of flash for the RAMFUNC page writes
+extern uint32_t flash_end;
+
+void partition_init(void);
+const struct partition_table *partition_table(void);
+void partition_dump(void);
+
+#endif /* PARTITION_H_ */
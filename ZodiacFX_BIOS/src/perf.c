@@ -0,0 +1,120 @@
+/**
+ * @file
+ * perf.c
+ *
+ * This file contains the profiling probe functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "perf.h"
+
+#if BIOS_PERF
+
+// Global variables
+struct perf_probe perf_probes[PERF_PROBE_COUNT];
+
+// Local Variables
+static const char * const perf_probe_names[PERF_PROBE_COUNT] =
+{
+#define PERF_PROBE_NAME(id, name) name,
+	PERF_PROBE_LIST(PERF_PROBE_NAME)
+#undef PERF_PROBE_NAME
+};
+
+#endif
+
+/*
+*	Start the cycle counter and clear all probes
+*
+*/
+void perf_init(void)
+{
+	perf_cycles_init();
+	perf_clear();
+}
+
+/*
+*	Clear all probes
+*
+*/
+void perf_clear(void)
+{
+#if BIOS_PERF
+	memset(perf_probes, 0, sizeof(perf_probes));
+#endif
+}
+
+/*
+*	Print per-probe totals, counts and min/max
+*
+*/
+void perf_dump(void)
+{
+#if BIOS_PERF
+	printf("\r\n");
+	printf("%-20s %10s %14s %10s %10s\r\n", "Probe", "Count", "Total(kcyc)", "Min(cyc)", "Max(cyc)");
+	printf("------------------------------------------------------------------\r\n");
+	for (int i = 0; i < PERF_PROBE_COUNT; i++)
+	{
+		struct perf_probe *probe = &perf_probes[i];
+		
+		printf("%-20s %10lu %14lu %10lu %10lu\r\n", perf_probe_names[i],
+		(unsigned long)probe->count, (unsigned long)(probe->total / 1000),
+		(unsigned long)probe->min, (unsigned long)probe->max);
+	}
+	printf("\r\nCPU clock: %lu Hz\r\n\r\n", (unsigned long)sysclk_get_cpu_hz());
+#else
+	printf("Profiling probes are not built in (BIOS_PERF)\r\n");
+#endif
+}
+
+/*
+*	Print the non-empty histogram buckets of each timed probe
+*
+*/
+void perf_dump_hist(void)
+{
+#if BIOS_PERF
+	for (int i = 0; i < PERF_PROBE_COUNT; i++)
+	{
+		struct perf_probe *probe = &perf_probes[i];
+		
+		if (probe->total == 0) continue;
+		printf("\r\n%s\r\n", perf_probe_names[i]);
+		for (int b = 0; b < PERF_HIST_BUCKETS; b++)
+		{
+			if (probe->hist[b] == 0) continue;
+			printf("  >= %10lu cyc: %lu\r\n", (unsigned long)(1UL << b), (unsigned long)probe->hist[b]);
+		}
+	}
+	printf("\r\n");
+#else
+	printf("Profiling probes are not built in (BIOS_PERF)\r\n");
+#endif
+}
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * perf.h
+ *
+ * This file contains the profiling probe definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include "conf_bios.h"
+
+/*
+*	Profiling probes, X(id, name)
+*
+*	Timed probes record count, total, min, max and a log2 histogram of
+*	the cycles between PERF_BEGIN() and PERF_END(). PERF_COUNT() only
+*	increments the count.
+*
+*	Page writes return once the EFC has started, so "flash program
+*	start" is only the command; the programming itself is counted in
+*	"flash busy wait". "xmodem byte" times every received byte, which
+*	slows the receive loop, and the table takes about 1.4KB of SRAM, so
+*	the probes are off unless BIOS_PERF is set.
+*/
+#define PERF_PROBE_LIST(X) \
+	X(PERF_XMODEM_BYTE,		"xmodem byte") \
+	X(PERF_XMODEM_BLOCK,	"xmodem block") \
+	X(PERF_XMODEM_NAK,		"xmodem nak") \
+	X(PERF_XMODEM_TIMEOUT,	"xmodem timeout") \
+	X(PERF_FLASH_WAIT,		"flash busy wait") \
+	X(PERF_FLASH_PROGRAM_START,	"flash program start") \
+	X(PERF_FLASH_ERASE,		"flash erase sector") \
+	X(PERF_VERIFICATION,	"verification check") \
+	X(PERF_FIRMWARE_UPDATE,	"firmware update")
+
+enum perf_probe_id
+{
+#define PERF_PROBE_ENUM(id, name) id,
+	PERF_PROBE_LIST(PERF_PROBE_ENUM)
+#undef PERF_PROBE_ENUM
+	PERF_PROBE_COUNT
+};
+
+#define PERF_HIST_BUCKETS	32	// One bucket per power of two cycles
+
+struct perf_probe
+{
+	uint32_t count;
+	uint32_t start;
+	uint64_t total;
+	uint32_t min;
+	uint32_t max;
+	uint32_t hist[PERF_HIST_BUCKETS];
+};
+
+void perf_init(void);
+void perf_clear(void);
+void perf_dump(void);
+void perf_dump_hist(void);
+
+/*
+*	Start the DWT cycle counter
+*
+*/
+static __always_inline void perf_cycles_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+#if BIOS_PERF
+
+extern struct perf_probe perf_probes[PERF_PROBE_COUNT];
+
+static __always_inline void perf_begin(enum perf_probe_id id)
+{
+	perf_probes[id].start = DWT->CYCCNT;
+}
+
+static __always_inline void perf_end(enum perf_probe_id id)
+{
+	struct perf_probe *probe = &perf_probes[id];
+	uint32_t cycles = DWT->CYCCNT - probe->start;
+	
+	probe->count++;
+	probe->total += cycles;
+	if (probe->count == 1 || cycles < probe->min) probe->min = cycles;
+	if (cycles > probe->max) probe->max = cycles;
+	probe->hist[cycles ? 31 - __CLZ(cycles) : 0]++;
+}
+
+#define PERF_BEGIN(id)	perf_begin(id)
+#define PERF_END(id)	perf_end(id)
+#define PERF_COUNT(id)	(perf_probes[id].count++)
+
+#else
+
+#define PERF_BEGIN(id)
+#define PERF_END(id)
+#define PERF_COUNT(id)
+
+#endif /* BIOS_PERF */
+
+#endif /* PERF_H_ */
@@ -0,0 +1,275 @@
+/**
+ * @file
+ * services.c
+ *
+ * the BIOS service table, called by the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#include <asf.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "services.h"
+#include "slot.h"
+#include "partition.h"
+
+// Internal Functions
+static uint32_t svc_page_program(uint32_t address, const uint32_t *page);
+static uint32_t svc_sector_erase(uint32_t address);
+static uint32_t svc_image_verify(uint32_t start, uint32_t end, struct bios_image *image);
+static uint32_t svc_slot_status(uint32_t slot, struct bios_image *image);
+static uint32_t svc_stage_begin(struct bios_stage *stage);
+static uint32_t svc_stage_write_page(struct bios_stage *stage, const uint32_t *page);
+static uint32_t svc_command(uint32_t command, uint32_t address);
+static int svc_in_buffer(uint32_t address, uint32_t length);
+
+// Global variables
+const struct bios_services bios_services __attribute__ ((section (".services"), used)) =
+{
+	.magic = BIOS_SERVICES_MAGIC,
+	.version = BIOS_SERVICES_VERSION,
+	.size = sizeof(struct bios_services),
+	.page_program = svc_page_program,
+	.sector_erase = svc_sector_erase,
+	.image_verify = svc_image_verify,
+	.slot_status = svc_slot_status,
+	.stage_begin = svc_stage_begin,
+	.stage_write_page = svc_stage_write_page,
+};
+
+/*
+*	Run an EFC command through the IAP function in ROM
+*
+*	The flash can't be read while the EFC is busy, and the BIOS RAM
+*	functions are gone once the firmware is running, so the command is
+*	issued and waited for from ROM.
+*
+*	PRIMASK is saved on the stack rather than with cpu_irq_save(),
+*	which keeps its state in a BIOS global.
+*/
+static uint32_t svc_command(uint32_t command, uint32_t address)
+{
+	uint32_t (*iap_perform_command)(uint32_t, uint32_t);
+	uint32_t primask;
+	uint32_t status;
+	
+	iap_perform_command = (uint32_t (*)(uint32_t, uint32_t)) *((uint32_t *)CHIP_FLASH_IAP_ADDRESS);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	status = iap_perform_command(0, EEFC_FCR_FKEY_PASSWD
+		| EEFC_FCR_FARG((address - IFLASH_ADDR) / IFLASH_PAGE_SIZE) | EEFC_FCR_FCMD(command));
+	__set_PRIMASK(primask);
+	
+	if (status & (EEFC_FSR_FLOCKE | EEFC_FSR_FCMDE | EEFC_FSR_FLERR))
+	{
+		return BIOS_SVC_FLASH;
+	}
+	return BIOS_SVC_OK;
+}
+
+/*
+*	Check that length bytes at address are inside the update buffer
+*
+*	The buffer is refused while the running image spans into it.
+*/
+static int svc_in_buffer(uint32_t address, uint32_t length)
+{
+	uint32_t start = slot_base(slot_staging());
+	uint32_t end = slot_end(slot_staging());
+	
+	return !slot_spanned() && address >= start && address < end && length <= end - address;
+}
+
+/*
+*	Program one erased page of the update buffer
+*
+*/
+static uint32_t svc_page_program(uint32_t address, const uint32_t *page)
+{
+	uint32_t *latch = (uint32_t *)address;
+	
+	if (!svc_in_buffer(address, IFLASH_PAGE_SIZE) || address % IFLASH_PAGE_SIZE)
+	{
+		return BIOS_SVC_RANGE;
+	}
+	
+	// Load the write latch through the page addresses
+	for (int i = 0; i < IFLASH_PAGE_SIZE / sizeof(uint32_t); i++)
+	{
+		latch[i] = page[i];
+	}
+	return svc_command(EFC_FCMD_WP, address);
+}
+
+/*
+*	Erase one 64KB sector of the update buffer
+*
+*/
+static uint32_t svc_sector_erase(uint32_t address)
+{
+	if (!svc_in_buffer(address, ERASE_SECTOR_SIZE) || address % ERASE_SECTOR_SIZE)
+	{
+		return BIOS_SVC_RANGE;
+	}
+	
+	return svc_command(EFC_FCMD_ES, address);
+}
+
+/*
+*	Check the image held between start and end, as verification_check()
+*	does for the update buffer
+*
+*/
+static uint32_t svc_image_verify(uint32_t start, uint32_t end, struct bios_image *image)
+{
+	struct verification_data result;
+	int ret;
+	
+	if (start < IFLASH_ADDR || end > IFLASH_ADDR + partition_table()->flash_size || start >= end)
+	{
+		return BIOS_SVC_RANGE;
+	}
+	
+	ret = verification_scan(start, end, &result);
+	if (image != NULL)
+	{
+		image->length = result.length;
+		image->calculated = result.calculated;
+		image->found = result.found;
+	}
+	return (ret == SUCCESS) ? BIOS_SVC_OK : BIOS_SVC_BAD_IMAGE;
+}
+
+/*
+*	Report whether a slot is empty or holds a good image
+*
+*/
+static uint32_t svc_slot_status(uint32_t slot, struct bios_image *image)
+{
+	uint32_t start, end;
+	
+	switch (slot)
+	{
+		case BIOS_SLOT_STORE:
+			start = slot_base(slot_active());
+			end = slot_spanned() ? slot_install_end() : slot_end(slot_active());
+			break;
+		case BIOS_SLOT_BUFFER:
+			start = slot_base(slot_staging());
+			end = slot_end(slot_staging());
+			break;
+		default:
+			return BIOS_SLOT_INVALID;
+	}
+	
+	if (*(const uint32_t *)start == 0xFFFFFFFF)
+	{
+		if (image != NULL)
+		{
+			image->length = 0;
+		}
+		return BIOS_SLOT_EMPTY;
+	}
+	if (svc_image_verify(start, end, image) != BIOS_SVC_OK)
+	{
+		return BIOS_SLOT_INVALID;
+	}
+	return BIOS_SLOT_VALID;
+}
+
+/*
+*	Get the update buffer ready for a new image
+*
+*	Like firmware_buffer_prepare(), only the sectors that are not blank
+*	are erased.
+*/
+static uint32_t svc_stage_begin(struct bios_stage *stage)
+{
+	uint32_t start = slot_base(slot_staging());
+	uint32_t end = slot_end(slot_staging());
+	uint32_t rc;
+	
+	if (slot_spanned())
+	{
+		return BIOS_SVC_RANGE;	// The running image fills the buffer too
+	}
+	
+	for (uint32_t address = start; address < end; address += IFLASH_LOCK_REGION_SIZE)
+	{
+		rc = svc_command(EFC_FCMD_CLB, address);
+		if (rc != BIOS_SVC_OK)
+		{
+			return rc;
+		}
+	}
+	
+	for (uint32_t sector = start; sector < end; sector += ERASE_SECTOR_SIZE)
+	{
+		if (flash_region_blank(sector, sector + ERASE_SECTOR_SIZE))
+		{
+			continue;
+		}
+		rc = svc_sector_erase(sector);
+		if (rc != BIOS_SVC_OK)
+		{
+			return rc;
+		}
+	}
+	
+	stage->next = start;
+	stage->end = end;
+	return BIOS_SVC_OK;
+}
+
+/*
+*	Write the next page of an image into the update buffer
+*
+*	The firmware equivalent of the XModem page writes, with the write
+*	address kept in *stage. The image is copied into place on the next
+*	reset if it verifies.
+*/
+static uint32_t svc_stage_write_page(struct bios_stage *stage, const uint32_t *page)
+{
+	uint32_t rc;
+	
+	if (stage->next < slot_base(slot_staging()) || stage->end > slot_end(slot_staging()))
+	{
+		return BIOS_SVC_RANGE;
+	}
+	if (stage->next >= stage->end)
+	{
+		return BIOS_SVC_FULL;
+	}
+	
+	rc = svc_page_program(stage->next, page);
+	if (rc == BIOS_SVC_OK)
+	{
+		stage->next += IFLASH_PAGE_SIZE;
+	}
+	return rc;
+}
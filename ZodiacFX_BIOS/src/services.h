@@ -0,0 +1,110 @@
+/**
+ * @file
+ * services.h
+ *
+ * the BIOS service table, called by the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#ifndef SERVICES_H_
+#define SERVICES_H_
+
+#include <stdint.h>
+
+/*
+*	The BIOS keeps a table of its flash and image routines at a fixed
+*	address so the firmware can stage an update without carrying its own
+*	copies. This header only depends on stdint.h so the firmware can use
+*	it as it is:
+*
+*		const struct bios_services *bios = (const struct bios_services *)BIOS_SERVICES_ADDR;
+*		if (bios->magic == BIOS_SERVICES_MAGIC && bios->version >= 1) ...
+*
+*	A newer BIOS only appends entries and bumps the version; size covers
+*	the table it has. Older BIOS releases have no table, so check the
+*	magic first.
+*
+*	The routines run from flash, use only the stack and never touch BIOS
+*	RAM, which belongs to the firmware once it is running. Page program
+*	and sector erase go through the IAP function in ROM with interrupts
+*	disabled, and return when the EFC has finished. The flash wait states
+*	must be at least 6 (the Flash Mode Register is left as the caller set
+*	it). Only the update buffer can be changed, and not while the
+*	running image spans into it; the running firmware, the BIOS and its
+*	records are refused.
+*/
+#define BIOS_SERVICES_ADDR		0x00418F00	// Top of BIOS stage-1, updated with it
+#define BIOS_SERVICES_MAGIC		0x5A465356	// "ZFSV"
+#define BIOS_SERVICES_VERSION	1
+
+// Return codes
+#define BIOS_SVC_OK			0
+#define BIOS_SVC_RANGE		1	// Outside the update buffer, not aligned, or in use
+#define BIOS_SVC_FLASH		2	// The EFC reported an error
+#define BIOS_SVC_BAD_IMAGE	3	// No image, or its checksum does not match
+#define BIOS_SVC_FULL		4	// The staging region is full
+
+// Slots
+#define BIOS_SLOT_STORE		0	// The firmware that runs
+#define BIOS_SLOT_BUFFER	1	// The update buffer (staging slot), installed on the next reset
+
+// Slot states
+#define BIOS_SLOT_EMPTY		0
+#define BIOS_SLOT_VALID		1
+#define BIOS_SLOT_INVALID	2
+
+struct bios_image
+{
+	uint32_t length;		// Bytes including the checksum and padding
+	uint32_t calculated;	// Byte sum of the image
+	uint32_t found;			// Checksum held in the image trailer
+};
+
+// Staging writer state, kept by the caller
+struct bios_stage
+{
+	uint32_t next;			// Address of the next page
+	uint32_t end;
+};
+
+struct bios_services
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			// Bytes in this table
+	
+	// Version 1
+	uint32_t (*page_program)(uint32_t address, const uint32_t *page);	// One 512 byte page, erased first
+	uint32_t (*sector_erase)(uint32_t address);		// 64KB sector, sector aligned
+	uint32_t (*image_verify)(uint32_t start, uint32_t end, struct bios_image *image);
+	uint32_t (*slot_status)(uint32_t slot, struct bios_image *image);	// Returns a slot state
+	uint32_t (*stage_begin)(struct bios_stage *stage);	// Erase the update buffer where needed
+	uint32_t (*stage_write_page)(struct bios_stage *stage, const uint32_t *page);
+};
+
+#endif /* SERVICES_H_ */
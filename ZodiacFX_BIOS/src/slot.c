@@ -0,0 +1,643 @@
+/**
+ * @file
+ * slot.c
+ *
+ * the firmware slot and manifest functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "slot.h"
+#include "mailbox.h"
+#include "partition.h"
+
+// Internal Functions
+static const struct slot_manifest *manifest_page(int index);
+static uint32_t manifest_checksum(const struct slot_manifest *record);
+static int manifest_valid(const struct slot_manifest *record);
+static int manifest_blank(int index);
+static int manifest_newest(void);
+static int manifest_write(int index, struct slot_manifest *record);
+static int manifest_append(struct slot_manifest *record);
+static int manifest_confirm(void);
+static int manifest_image_intact(uint32_t base, uint32_t end, uint32_t length, uint32_t sum);
+
+/*
+*	Record in page 'index' of the manifest, counted across both halves
+*
+*/
+static const struct slot_manifest *manifest_page(int index)
+{
+	return (const struct slot_manifest *)(MANIFEST_BASE + index * IFLASH_PAGE_SIZE);
+}
+
+/*
+*	Sum every word of a record before the checksum
+*
+*/
+static uint32_t manifest_checksum(const struct slot_manifest *record)
+{
+	const uint32_t *word = (const uint32_t *)record;
+	uint32_t sum = 0;
+	
+	for (int i = 0; i < offsetof(struct slot_manifest, checksum) / sizeof(uint32_t); i++)
+	{
+		sum += word[i];
+	}
+	return sum;
+}
+
+static int manifest_valid(const struct slot_manifest *record)
+{
+	return record->magic == MANIFEST_MAGIC && record->checksum == manifest_checksum(record)
+		&& record->active < SLOT_COUNT;
+}
+
+/*
+*	Check that the record area of a page is still erased
+*
+*/
+static int manifest_blank(int index)
+{
+	const uint32_t *word = (const uint32_t *)manifest_page(index);
+	
+	for (int i = 0; i < sizeof(struct slot_manifest) / sizeof(uint32_t); i++)
+	{
+		if (word[i] != 0xFFFFFFFF) return 0;
+	}
+	return 1;
+}
+
+/*
+*	Page holding the newest valid record, -1 if there is none
+*
+*/
+static int manifest_newest(void)
+{
+	const struct slot_manifest *record;
+	int newest = -1;
+	
+	for (int i = 0; i < 2 * MANIFEST_HALF_PAGES; i++)
+	{
+		record = manifest_page(i);
+		if (manifest_valid(record) && (newest < 0 || record->seq > manifest_page(newest)->seq))
+		{
+			newest = i;
+		}
+	}
+	return newest;
+}
+
+/*
+*	Program a record into an erased page of the manifest
+*
+*/
+static int manifest_write(int index, struct slot_manifest *record)
+{
+	uint32_t page[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
+	
+	record->magic = MANIFEST_MAGIC;
+	record->checksum = manifest_checksum(record);
+	memset(page, 0xFF, sizeof(page));
+	memcpy(page, record, sizeof(*record));
+	
+	if (flash_write_aligned((uint32_t)manifest_page(index), page, IFLASH_PAGE_SIZE) != FLASH_RC_OK)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+/*
+*	Append a record after the newest one, moving to the other half when
+*	the current half is full
+*
+*	The newest record stays valid until the new one is written, so a
+*	power cut at any point leaves one of them in place.
+*/
+static int manifest_append(struct slot_manifest *record)
+{
+	int newest = manifest_newest();
+	int next = newest + 1;
+	
+	if (!flash_records_unlock(MANIFEST_BASE, MANIFEST_END))
+	{
+		return 0;
+	}
+	record->seq = (newest < 0) ? 1 : manifest_page(newest)->seq + 1;
+	if (newest >= 0 && next % MANIFEST_HALF_PAGES != 0 && manifest_blank(next))
+	{
+		return manifest_write(next, record);
+	}
+	
+	next = (newest >= 0 && newest < MANIFEST_HALF_PAGES) ? MANIFEST_HALF_PAGES : 0;
+	if (flash_erase_page((uint32_t)manifest_page(next), IFLASH_ERASE_PAGES_8) != FLASH_RC_OK)
+	{
+		return 0;
+	}
+	return manifest_write(next, record);
+}
+
+/*
+*	Clear the trial flag of the active image
+*
+*/
+static int manifest_confirm(void)
+{
+	struct slot_manifest record;
+	
+	memcpy(&record, manifest_page(manifest_newest()), sizeof(record));
+	record.flags &= ~MANIFEST_TRIAL;
+	return manifest_append(&record);
+}
+
+/*
+*	Check that an image a record describes is still in place, by its
+*	length and the checksum in its trailer, without summing it again
+*
+*/
+static int manifest_image_intact(uint32_t base, uint32_t end, uint32_t length, uint32_t sum)
+{
+	const uint8_t *image = (const uint8_t *)base;
+	
+	return length >= 8 && length <= end - base
+		&& *(const uint32_t *)(image + length - 8) == sum
+		&& (length == end - base || image[length] == 0xFF);
+}
+
+/*
+*	First address of a slot
+*
+*/
+uint32_t slot_base(int slot)
+{
+	return partition_table()->base[slot];
+}
+
+/*
+*	Address after the end of a slot
+*
+*/
+uint32_t slot_end(int slot)
+{
+	const struct partition_table *table = partition_table();
+	
+	return table->base[slot] + table->size[slot];
+}
+
+/*
+*	Largest image a slot can hold
+*
+*/
+uint32_t slot_size(int slot)
+{
+	return partition_table()->size[slot];
+}
+
+/*
+*	Address after the end of the space 'upload direct' can fill
+*
+*	An installed image starts at slot A and may run on into slot B when
+*	the partition table puts B straight after A.
+*/
+uint32_t slot_install_end(void)
+{
+	return (slot_base(SLOT_B) == slot_end(SLOT_A)) ? slot_end(SLOT_B) : slot_end(SLOT_A);
+}
+
+/*
+*	Slot the firmware runs from
+*
+*/
+int slot_active(void)
+{
+#if BIOS_AB_SLOTS
+	int newest = manifest_newest();
+	
+	if (newest >= 0)
+	{
+		return manifest_page(newest)->active;
+	}
+#endif
+	return SLOT_A;
+}
+
+/*
+*	Slot uploads are written to
+*
+*/
+int slot_staging(void)
+{
+	return (slot_active() == SLOT_A) ? SLOT_B : SLOT_A;
+}
+
+/*
+*	Check for an update waiting in the staging slot
+*
+*	Without BIOS_AB_SLOTS anything in the buffer is an update. With them
+*	the staging slot normally holds the image the last switch replaced;
+*	it is recognised by the length and checksum the manifest recorded
+*	for it, without summing it again.
+*/
+int slot_pending(void)
+{
+	int staging = slot_staging();
+	const uint32_t *base = (const uint32_t *)slot_base(staging);
+	
+	if (*base == 0xFFFFFFFF || slot_spanned())
+	{
+		return 0;	// Empty, or the end of an installed image
+	}
+	if (slot_holds_stage1(staging))
+	{
+		return 0;	// Installed by stage-0, not copied into the store
+	}
+	
+#if BIOS_AB_SLOTS
+	int newest = manifest_newest();
+	
+	if (newest >= 0)
+	{
+		const struct slot_manifest *record = manifest_page(newest);
+		
+		if (manifest_image_intact(slot_base(staging), slot_end(staging),
+			record->length[staging], record->sum[staging]))
+		{
+			return 0;	// Still the image the last switch left there
+		}
+	}
+#endif
+	return 1;
+}
+
+/*
+*	Check whether the running image fills slot A and runs on into B
+*
+*/
+int slot_spanned(void)
+{
+	int newest = manifest_newest();
+	const struct slot_manifest *record;
+	
+	if (newest < 0)
+	{
+		return 0;
+	}
+	record = manifest_page(newest);
+	return (record->flags & MANIFEST_SPAN) && record->active == SLOT_A
+		&& manifest_image_intact(slot_base(SLOT_A), slot_install_end(),
+		record->length[SLOT_A], record->sum[SLOT_A]);
+}
+
+/*
+*	Check whether a slot holds a BIOS stage-1 image, linked to run from
+*	STAGE1_BASE (see stage0.h)
+*
+*/
+int slot_holds_stage1(int slot)
+{
+	const uint32_t *vectors = (const uint32_t *)slot_base(slot);
+	uint32_t reset_handler = vectors[1] & ~1;
+	
+	return vectors[0] != 0xFFFFFFFF && reset_handler >= STAGE1_BASE && reset_handler < STAGE1_END;
+}
+
+/*
+*	Check that the image in a slot was linked to run from the slot it
+*	will boot from
+*
+*	Without BIOS_AB_SLOTS images always run from the store, wherever
+*	they are staged, and only BIOS stage-1 images are refused.
+*/
+int slot_entry_ok(int slot)
+{
+#if BIOS_AB_SLOTS
+	const uint32_t *vectors = (const uint32_t *)slot_base(slot);
+	uint32_t reset_handler = vectors[1] & ~1;
+	
+	return reset_handler >= slot_base(slot) && reset_handler < slot_end(slot);
+#else
+	return !slot_holds_stage1(slot);
+#endif
+}
+
+/*
+*	Make a verified image the one that runs
+*
+*	The record keeps what it knows of the other slot. The first record
+*	written has nothing to copy, so the other slot is checked here to
+*	recognise what it holds on the following boots.
+*
+*	@param slot - slot holding the image
+*	@param length - image bytes, from verification_check_region()
+*	@param sum - checksum in the image trailer
+*	@param trial - 1 for a new image, which runs on trial
+*/
+int slot_activate(int slot, uint32_t length, uint32_t sum, int trial)
+{
+	struct slot_manifest record;
+	struct verification_data other;
+	int newest = manifest_newest();
+	int other_slot = (slot == SLOT_A) ? SLOT_B : SLOT_A;
+	
+	if (newest >= 0)
+	{
+		memcpy(&record, manifest_page(newest), sizeof(record));
+	}
+	else
+	{
+		memset(&record, 0, sizeof(record));
+		verification_scan(slot_base(other_slot), slot_end(other_slot), &other);
+		record.length[other_slot] = other.length;
+		record.sum[other_slot] = other.found;
+	}
+	
+	record.active = slot;
+	record.length[slot] = length;
+	record.sum[slot] = sum;
+	record.flags = trial ? MANIFEST_TRIAL : 0;
+	GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL] = 0;	// Count from the first boot of this image
+	return manifest_append(&record);
+}
+
+/*
+*	An upload into the staging slot has verified
+*
+*	With A/B slots it is made active straight away: at boot, an image
+*	uploaded again over the one it replaced could not be told from it.
+*	Without them the next boot copies it into the store as before. A
+*	BIOS stage-1 image is left for stage-0, which is asked to install it
+*	on the next reset.
+*/
+int slot_upload_done(uint32_t length, uint32_t sum)
+{
+	if (slot_holds_stage1(slot_staging()))
+	{
+		GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND] = MAILBOX_COMMAND(MAILBOX_CMD_STAGE1, 0);
+		return 1;
+	}
+#if BIOS_AB_SLOTS
+	if (!slot_entry_ok(slot_staging()))
+	{
+		return 0;
+	}
+	return slot_activate(slot_staging(), length, sum, 1);
+#else
+	return 1;
+#endif
+}
+
+/*
+*	Record an image installed in place by 'upload direct'
+*
+*	Written just before the image's vectors, so slot A still reads
+*	as empty until the image is complete. With it, the end of an image
+*	too big for slot A is not taken for an update on the next boots,
+*	in either slot mode. The image is not on trial.
+*/
+int slot_install(uint32_t length, uint32_t sum)
+{
+	struct slot_manifest record;
+	
+	memset(&record, 0, sizeof(record));
+	record.active = SLOT_A;
+	record.length[SLOT_A] = length;
+	record.sum[SLOT_A] = sum;
+	record.flags = (length > slot_size(SLOT_A)) ? MANIFEST_SPAN : 0;
+	GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL] = 0;
+	return manifest_append(&record);
+}
+
+/*
+*	Store sectors that already hold the image in the buffer, from an
+*	update that was cut short, or 0 to start from the beginning
+*
+*	@param length - image bytes, from verification_check()
+*	@param sum - checksum in the image trailer
+*/
+uint32_t slot_copy_resume(uint32_t length, uint32_t sum)
+{
+	int newest = manifest_newest();
+	const struct slot_manifest *record;
+	
+	if (newest < 0)
+	{
+		return 0;
+	}
+	record = manifest_page(newest);
+	if (!(record->flags & MANIFEST_COPY) || record->length[slot_staging()] != length
+		|| record->sum[slot_staging()] != sum || record->copied > slot_size(slot_active()) / ERASE_SECTOR_SIZE)
+	{
+		return 0;
+	}
+	return record->copied;
+}
+
+/*
+*	Journal a store sector the update has finished
+*
+*	The record for the last sector says the store holds the image.
+*
+*	@param copied - sectors done, counted from the start of the store
+*	@param sectors - sectors in the store
+*/
+int slot_copy_record(uint32_t length, uint32_t sum, uint32_t copied, uint32_t sectors)
+{
+	struct slot_manifest record;
+	
+	memset(&record, 0, sizeof(record));
+	record.active = slot_active();
+	if (copied < sectors)
+	{
+		record.flags = MANIFEST_COPY;
+		record.length[slot_staging()] = length;
+		record.sum[slot_staging()] = sum;
+		record.copied = copied;
+	}
+	else
+	{
+		record.length[slot_active()] = length;
+		record.sum[slot_active()] = sum;
+	}
+	return manifest_append(&record);
+}
+
+/*
+*	Check whether the active image is still on trial
+*
+*/
+int slot_trial(void)
+{
+#if BIOS_AB_SLOTS
+	int newest = manifest_newest();
+	
+	return newest >= 0 && (manifest_page(newest)->flags & MANIFEST_TRIAL);
+#else
+	return 0;
+#endif
+}
+
+/*
+*	Count a boot of an image on trial
+*
+*	Records the firmware's confirmation if it left one, otherwise rolls
+*	back once the image has had BIOS_TRIAL_BOOTS boots. An image with
+*	nothing to go back to is kept and confirmed.
+*/
+int slot_trial_boot(void)
+{
+	uint32_t trial = GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL];
+	uint32_t boots = 1;
+	
+	if (!slot_trial())
+	{
+		return SLOT_TRIAL_NONE;
+	}
+	
+	if (trial == MAILBOX_TRIAL_CONFIRM)
+	{
+		GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL] = 0;
+		manifest_confirm();
+		return SLOT_TRIAL_CONFIRMED;
+	}
+	
+	if ((trial & MAILBOX_MAGIC_MSK) == MAILBOX_TRIAL_MAGIC)
+	{
+		boots = (trial & ~MAILBOX_MAGIC_MSK) + 1;
+	}
+	if (boots <= BIOS_TRIAL_BOOTS)
+	{
+		GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL] = MAILBOX_TRIAL_MAGIC | boots;
+		return SLOT_TRIAL_COUNTED;
+	}
+	
+	GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL] = 0;
+	if (slot_rollback())
+	{
+		return SLOT_TRIAL_ROLLED_BACK;
+	}
+	manifest_confirm();
+	return SLOT_TRIAL_CONFIRMED;
+}
+
+/*
+*	Go back to the image the last update replaced
+*
+*	That image is still in the staging slot unless an upload has been
+*	started since. It is checked in full before the switch, which is a
+*	single manifest record.
+*/
+int slot_rollback(void)
+{
+#if BIOS_AB_SLOTS
+	int previous = slot_staging();
+	struct verification_data image;
+	
+	if (*(const uint32_t *)slot_base(previous) == 0xFFFFFFFF || slot_pending())
+	{
+		return 0;	// Nothing kept, or a new image that never ran
+	}
+	if (verification_scan(slot_base(previous), slot_end(previous), &image) != SUCCESS
+		|| !slot_entry_ok(previous))
+	{
+		return 0;
+	}
+	return slot_activate(previous, image.length, image.found, 0);
+#else
+	return 0;
+#endif
+}
+
+/*
+*	Show both slots and the manifest
+*
+*/
+void slot_dump(void)
+{
+	int active = slot_active();
+	int newest = manifest_newest();
+	int spanned = slot_spanned();
+	struct verification_data image;
+	
+	printf("\r\n");
+	partition_dump();
+	printf("\r\n");
+	printf("Slot  Base      Image bytes  Checksum  State\r\n");
+	printf("-------------------------------------------------\r\n");
+	for (int slot = SLOT_A; slot < SLOT_COUNT; slot++)
+	{
+		if (*(const uint32_t *)slot_base(slot) == 0xFFFFFFFF)
+		{
+			printf("%c     %08lx  %11s  %8s  %s\r\n", 'A' + slot, (unsigned long)slot_base(slot),
+			"-", "-", (slot == active) ? "active, empty" : "staging, empty");
+			continue;
+		}
+		if (spanned && slot != active)
+		{
+			printf("%c     %08lx  %11s  %8s  %s\r\n", 'A' + slot, (unsigned long)slot_base(slot),
+			"-", "-", "staging, end of the installed image");
+			continue;
+		}
+		verification_scan(slot_base(slot), (spanned ? slot_install_end() : slot_end(slot)), &image);
+		printf("%c     %08lx  %11lu  %08lx  %s%s%s\r\n", 'A' + slot, (unsigned long)slot_base(slot),
+		(unsigned long)image.length, (unsigned long)image.found,
+		(slot == active) ? "active" : "staging",
+		(image.found == image.calculated) ? "" : ", bad checksum",
+		(slot != active && slot_pending()) ? ", pending" : (slot_holds_stage1(slot) ? ", BIOS stage-1" : ""));
+	}
+	printf("\r\n");
+#if BIOS_AB_SLOTS
+	if (newest >= 0)
+	{
+		printf("Manifest record %lu in page %d\r\n", (unsigned long)manifest_page(newest)->seq, newest);
+		if (slot_trial())
+		{
+			uint32_t trial = GPBR->SYS_GPBR[MAILBOX_GPBR_TRIAL];
+			
+			printf("Slot %c is on trial, %lu of %d boots used%s\r\n", 'A' + active,
+			(unsigned long)(((trial & MAILBOX_MAGIC_MSK) == MAILBOX_TRIAL_MAGIC) ? trial & ~MAILBOX_MAGIC_MSK : 0),
+			BIOS_TRIAL_BOOTS, (trial == MAILBOX_TRIAL_CONFIRM) ? ", confirmed" : "");
+		}
+	}
+	else
+	{
+		printf("Manifest empty, slot A is active\r\n");
+	}
+#else
+	printf("A/B slots are off: updates are staged in B and copied into A\r\n");
+	if (newest >= 0 && (manifest_page(newest)->flags & MANIFEST_COPY))
+	{
+		printf("An update stopped after %lu of its sectors were copied, the next reset carries on\r\n",
+		(unsigned long)manifest_page(newest)->copied);
+	}
+#endif
+	printf("\r\n");
+}
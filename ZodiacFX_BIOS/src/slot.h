@@ -0,0 +1,125 @@
+/**
+ * @file
+ * slot.h
+ *
+ * the firmware slot and manifest functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#ifndef SLOT_H_
+#define SLOT_H_
+
+#include "conf_bios.h"
+#include "partition.h"
+
+/*
+*	The two firmware regions are slots, laid out by the partition table
+*	(see partition.h). Without BIOS_AB_SLOTS the store (slot A) is always
+*	the one that runs and the buffer (slot B) is where uploads are
+*	staged, to be copied into the store on the next reset.
+*
+*	With BIOS_AB_SLOTS either slot can run. The manifest log at
+*	MANIFEST_BASE records the active slot and the image each slot held
+*	when it was written. An upload goes to the other (staging) slot and
+*	on the next reset, once it verifies, a new manifest record makes it
+*	the active slot: there is no copy, and the image it replaces stays
+*	in the staging slot until the next upload. Images must be linked to
+*	run from the slot they are uploaded to.
+*
+*	A new image starts on trial and goes back to the one it replaced
+*	unless the firmware confirms it (see mailbox.h). A rollback, by
+*	trial, the 'rollback' command or MAILBOX_CMD_ROLLBACK, is a single
+*	manifest record.
+*
+*	'upload direct' installs an image in place in slot A, in either
+*	mode, and the image may carry on through slot B. Its manifest record
+*	has MANIFEST_SPAN set while it does, so the end of the image is not
+*	taken for an update. The next upload erases it.
+*
+*	Without BIOS_AB_SLOTS the manifest is also the journal of the copy
+*	into the store: firmware_update() adds a MANIFEST_COPY record as
+*	each sector is finished, so a copy cut short by a power loss carries
+*	on where it stopped.
+*
+*	The manifest is written like the telemetry log: two halves, one
+*	record per page, the other half erased when the current one is full.
+*	The functions that only look at the slots (slot_base() to
+*	slot_entry_ok(), and slot_trial()) only read flash, so they are safe
+*	before the C runtime is set up.
+*/
+#define SLOT_A		0	// Partition 0, FLASH_STORE by default
+#define SLOT_B		1	// Partition 1, FLASH_BUFFER by default
+#define SLOT_COUNT	PARTITION_COUNT
+
+#define MANIFEST_HALF_PAGES	((MANIFEST_END - MANIFEST_BASE) / 2 / IFLASH_PAGE_SIZE)
+#define MANIFEST_MAGIC		0x4D4E4631	// "MNF1"
+
+// Manifest flags
+#define MANIFEST_TRIAL		(1 << 0)	// The active image is not confirmed yet
+#define MANIFEST_SPAN		(1 << 1)	// The active image runs on into slot B
+#define MANIFEST_COPY		(1 << 2)	// An update is being copied into the store
+
+// slot_trial_boot() results
+#define SLOT_TRIAL_NONE			0
+#define SLOT_TRIAL_COUNTED		1
+#define SLOT_TRIAL_CONFIRMED	2
+#define SLOT_TRIAL_ROLLED_BACK	3
+
+struct slot_manifest
+{
+	uint32_t magic;
+	uint32_t seq;					// Increases by one per record written
+	uint32_t active;				// Slot the firmware runs from
+	uint32_t length[SLOT_COUNT];	// Image bytes each slot held, 0 for none
+	uint32_t sum[SLOT_COUNT];		// Checksum in each image's trailer
+	uint32_t flags;
+	uint32_t copied;				// Store sectors done, while MANIFEST_COPY is set
+	uint32_t checksum;				// Sum of the words above
+};
+
+uint32_t slot_base(int slot);
+uint32_t slot_end(int slot);
+uint32_t slot_size(int slot);
+uint32_t slot_install_end(void);
+int slot_active(void);
+int slot_staging(void);
+int slot_pending(void);
+int slot_spanned(void);
+int slot_holds_stage1(int slot);
+int slot_entry_ok(int slot);
+int slot_activate(int slot, uint32_t length, uint32_t sum, int trial);
+int slot_upload_done(uint32_t length, uint32_t sum);
+int slot_install(uint32_t length, uint32_t sum);
+uint32_t slot_copy_resume(uint32_t length, uint32_t sum);
+int slot_copy_record(uint32_t length, uint32_t sum, uint32_t copied, uint32_t sectors);
+int slot_trial(void);
+int slot_trial_boot(void);
+int slot_rollback(void);
+void slot_dump(void);
+
+#endif /* SLOT_H_ */
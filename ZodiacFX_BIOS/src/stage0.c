@@ -0,0 +1,355 @@
+/**
+ * @file
+ * stage0.c
+ *
+ * the immutable first stage of the BIOS
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#include <asf.h>
+#include "conf_bios.h"
+#include "stage0.h"
+#include "flash.h"
+#include "mailbox.h"
+#include "handoff.h"
+#include "partition.h"
+
+#define STAGE0 __attribute__ ((section (".stage0")))
+
+// Internal Functions
+static void stage0_fault(void);
+static int stage0_is_stage1(uint32_t base);
+static int stage0_image(uint32_t base, uint32_t end, uint32_t *length);
+static int stage0_partition_valid(const struct partition_table *table);
+static uint32_t stage0_source(uint32_t *length);
+static uint32_t stage0_command(uint32_t command, uint32_t page);
+static int stage0_program(uint32_t address, uint32_t source, uint32_t length);
+static int stage0_compare(uint32_t start, uint32_t end, uint32_t source);
+static int stage0_install(uint32_t source, uint32_t length);
+static void stage0_start(void);
+
+// Vector table at the start of flash, stage-1 has its own
+const void * const stage0_vectors[STAGE0_VECTORS] __attribute__ ((section (".stage0_vectors"), used)) =
+{
+	(void *)HANDOFF_ADDR,	// Stack below the handoff block
+	(void *)stage0_reset,
+	(void *)stage0_fault,	// NMI
+	(void *)stage0_fault,	// Hard fault
+	(void *)stage0_fault,	// Memory management
+	(void *)stage0_fault,	// Bus fault
+	(void *)stage0_fault,	// Usage fault
+};
+
+/*
+*	Faults before stage-1 is running
+*
+*/
+STAGE0
+static void stage0_fault(void)
+{
+	while(1);
+}
+
+/*
+*	Check that flash at base starts with a stage-1 vector table
+*
+*	Stage-1 images are told from firmware images by their reset handler,
+*	which is inside the stage-1 region.
+*
+*	@param base - start of the region to check
+*/
+STAGE0
+static int stage0_is_stage1(uint32_t base)
+{
+	const uint32_t *vectors = (const uint32_t *)base;
+	uint32_t reset_handler = vectors[1] & ~1;
+	
+	return vectors[0] != 0xFFFFFFFF && reset_handler >= STAGE1_BASE && reset_handler < STAGE1_END;
+}
+
+/*
+*	Check the checksum of a stage-1 image in a slot
+*
+*	The image format is the firmware's, a byte sum and four zero bytes
+*	after the last byte. Stage-0 can't use verification_scan() in
+*	stage-1, so this is a copy of it that only looks as far as the
+*	largest stage-1 image.
+*
+*	@param base - slot start
+*	@param end - slot end
+*	@param length - image bytes, without the trailer
+*/
+STAGE0
+static int stage0_image(uint32_t base, uint32_t end, uint32_t *length)
+{
+	const uint8_t *image = (const uint8_t *)base;
+	const uint8_t *last = (const uint8_t *)end;
+	const uint8_t *byte;
+	uint32_t sum = 0;
+	
+	if (end - base > STAGE1_END - STAGE1_BASE + 8)
+	{
+		last = image + (STAGE1_END - STAGE1_BASE + 8);
+	}
+	while (last > image && last[-1] == 0xFF) last--;
+	
+	if (last - image < 8 || last - image - 8 > STAGE1_END - STAGE1_BASE
+		|| *(const uint32_t *)(last - 4) != 0)
+	{
+		return 0;
+	}
+	for (byte = image; byte < last - 8; byte++) sum += *byte;
+	
+	*length = last - image - 8;
+	return sum == *(const uint32_t *)(last - 8);
+}
+
+/*
+*	Check a partition table as partition_valid() does
+*
+*	A copy, for the same reason as stage0_image(): the checksum, and
+*	slots of whole sectors above the BIOS, in flash and apart.
+*
+*	@param table - the table in flash
+*/
+STAGE0
+static int stage0_partition_valid(const struct partition_table *table)
+{
+	const uint32_t *word = (const uint32_t *)table;
+	uint32_t end = IFLASH_ADDR + table->flash_size;
+	uint32_t sum = 0;
+	
+	if (table->magic != PARTITION_MAGIC || table->version != PARTITION_VERSION) return 0;
+	for (int i = 0; i < offsetof(struct partition_table, checksum) / sizeof(uint32_t); i++)
+	{
+		sum += word[i];
+	}
+	if (table->checksum != sum) return 0;
+	for (int i = 0; i < PARTITION_COUNT; i++)
+	{
+		if (table->base[i] < FLASH_STORE || table->base[i] >= end || table->size[i] == 0
+			|| table->base[i] % ERASE_SECTOR_SIZE != 0 || table->size[i] % ERASE_SECTOR_SIZE != 0
+			|| table->size[i] > end - table->base[i])
+		{
+			return 0;
+		}
+	}
+	return table->base[0] + table->size[0] <= table->base[1]
+		|| table->base[1] + table->size[1] <= table->base[0];
+}
+
+/*
+*	Find a verified stage-1 image in one of the firmware slots
+*
+*	The slots come from the partition table if it is valid, as in
+*	partition_table(), else from conf_bios.h. The staging slot is
+*	normally B, so it is looked at first.
+*
+*	@param length - image bytes of the one found
+*/
+STAGE0
+static uint32_t stage0_source(uint32_t *length)
+{
+	const struct partition_table *table = (const struct partition_table *)PARTITION_BASE;
+	uint32_t buffer = FLASH_BUFFER, buffer_end = FLASH_BUFFER_END;
+	uint32_t store = FLASH_STORE, store_end = FLASH_STORE_END;
+	
+	if (stage0_partition_valid(table))
+	{
+		store = table->base[0];
+		store_end = store + table->size[0];
+		buffer = table->base[1];
+		buffer_end = buffer + table->size[1];
+	}
+	
+	if (stage0_is_stage1(buffer) && stage0_image(buffer, buffer_end, length))
+	{
+		return buffer;
+	}
+	if (stage0_is_stage1(store) && stage0_image(store, store_end, length))
+	{
+		return store;
+	}
+	return 0;
+}
+
+/*
+*	Run an EFC command through the IAP function in ROM
+*
+*	@param command - EFC_FCMD_*
+*	@param page - command argument, a page number for the ones used here
+*/
+STAGE0
+static uint32_t stage0_command(uint32_t command, uint32_t page)
+{
+	uint32_t (*iap_perform_command)(uint32_t, uint32_t);
+	
+	iap_perform_command = (uint32_t (*)(uint32_t, uint32_t)) *((uint32_t *)CHIP_FLASH_IAP_ADDRESS);
+	return iap_perform_command(0, EEFC_FCR_FKEY_PASSWD | EEFC_FCR_FARG(page) | EEFC_FCR_FCMD(command))
+		& (EEFC_FSR_FLOCKE | EEFC_FSR_FCMDE | EEFC_FSR_FLERR);
+}
+
+/*
+*	Program one stage-1 page from the image
+*
+*	@param address - page address in the stage-1 region
+*	@param source - start of the image
+*	@param length - image bytes, the rest of a last page is left erased
+*/
+STAGE0
+static int stage0_program(uint32_t address, uint32_t source, uint32_t length)
+{
+	volatile uint32_t *latch = (volatile uint32_t *)address;
+	const uint32_t *word = (const uint32_t *)(source + (address - STAGE1_BASE));
+	uint32_t offset = address - STAGE1_BASE;
+	int i;
+	
+	for (i = 0; i < IFLASH_PAGE_SIZE / 4; i++)
+	{
+		latch[i] = (offset + i * 4 < length) ? word[i] : 0xFFFFFFFF;
+	}
+	return stage0_command(EFC_FCMD_WP, (address - IFLASH_ADDR) / IFLASH_PAGE_SIZE) == 0;
+}
+
+/*
+*	Compare part of the stage-1 region with the image
+*
+*/
+STAGE0
+static int stage0_compare(uint32_t start, uint32_t end, uint32_t source)
+{
+	const uint32_t *flash = (const uint32_t *)start;
+	const uint32_t *word = (const uint32_t *)(source + (start - STAGE1_BASE));
+	
+	while ((uint32_t)flash < end)
+	{
+		if (*flash++ != *word++) return 0;
+	}
+	return 1;
+}
+
+/*
+*	Copy a verified stage-1 image into place
+*
+*	The region is erased 16 pages at a time, 8 for the last 4KB it
+*	shares with the slot manifest's sector, and programmed from its
+*	second page on. The first page, with the vector table, goes in last
+*	once the rest compares equal, so a copy cut short leaves no stage-1
+*	and stage-0 starts it again from the source on the next reset.
+*
+*	@param source - slot holding the image
+*	@param length - image bytes
+*/
+STAGE0
+static int stage0_install(uint32_t source, uint32_t length)
+{
+	uint32_t address;
+	uint32_t end = STAGE1_BASE + ((length + IFLASH_PAGE_SIZE - 1) & ~(IFLASH_PAGE_SIZE - 1));
+	
+	stage0_command(EFC_FCMD_SLB, 0);	// Lock stage-0, only the ERASE pin clears it
+	
+	for (address = STAGE1_BASE; address < STAGE1_END; address += (address + 8192 <= STAGE1_END) ? 8192 : 4096)
+	{
+		uint32_t page = (address - IFLASH_ADDR) / IFLASH_PAGE_SIZE;
+		
+		stage0_command(EFC_FCMD_CLB, page);
+		if (stage0_command(EFC_FCMD_EPA, page | ((address + 8192 <= STAGE1_END) ? 2 : 1)))
+		{
+			return 0;
+		}
+	}
+	
+	for (address = STAGE1_BASE + IFLASH_PAGE_SIZE; address < end; address += IFLASH_PAGE_SIZE)
+	{
+		if (!stage0_program(address, source, length)) return 0;
+	}
+	if (!stage0_compare(STAGE1_BASE + IFLASH_PAGE_SIZE, STAGE1_BASE + length, source))
+	{
+		return 0;
+	}
+	
+	return stage0_program(STAGE1_BASE, source, length)
+		&& stage0_compare(STAGE1_BASE, STAGE1_BASE + IFLASH_PAGE_SIZE, source);
+}
+
+/*
+*	Start stage-1 as if from reset
+*
+*/
+STAGE0
+static void stage0_start(void)
+{
+	const uint32_t *vectors = (const uint32_t *)STAGE1_BASE;
+	void (*reset_handler)(void) = (void (*)(void))vectors[1];
+	
+	SCB->VTOR = (STAGE1_BASE & SCB_VTOR_TBLOFF_Msk);
+	__set_MSP(vectors[0]);
+	__DSB();
+	__ISB();
+	reset_handler();
+}
+
+/*
+*	Reset handler
+*
+*	A normal boot reads one backup register and two words of flash
+*	before the jump. The request is cleared before the copy: if the
+*	copy is cut short stage-1 is missing, which starts it again.
+*/
+STAGE0
+void stage0_reset(void)
+{
+	uint32_t request = GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND];
+	uint32_t source, length, fmr;
+	
+	if (request == MAILBOX_COMMAND(MAILBOX_CMD_STAGE1, 0) || !stage0_is_stage1(STAGE1_BASE))
+	{
+		if (request == MAILBOX_COMMAND(MAILBOX_CMD_STAGE1, 0))
+		{
+			GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND] = 0;
+		}
+		source = stage0_source(&length);
+		if (source != 0)
+		{
+			fmr = EFC->EEFC_FMR;
+			EFC->EEFC_FMR = (fmr & ~EEFC_FMR_FWS_Msk) | EEFC_FMR_FWS(6);
+			if (stage0_install(source, length))
+			{
+				// Don't leave it to be taken for a firmware update
+				stage0_command(EFC_FCMD_ES, (source - IFLASH_ADDR) / IFLASH_PAGE_SIZE);
+			}
+			EFC->EEFC_FMR = fmr;
+		}
+	}
+	
+	if (stage0_is_stage1(STAGE1_BASE))
+	{
+		stage0_start();
+	}
+	while(1);	// No stage-1 and none to install, needs SAM-BA or JTAG
+}
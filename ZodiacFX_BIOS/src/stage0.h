@@ -0,0 +1,57 @@
+/**
+ * @file
+ * stage0.h
+ *
+ * the immutable first stage of the BIOS
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+
+
+#ifndef STAGE0_H_
+#define STAGE0_H_
+
+/*
+*	The BIOS is in two stages. Stage-0 is the first 8KB of flash (the
+*	first small sector, STAGE1_BASE down to IFLASH_ADDR) and is never
+*	written after the board is programmed. It checks that stage-1 has a
+*	vector table and jumps to it, which is all it does on a normal boot.
+*
+*	Stage-1, from STAGE1_BASE to STAGE1_END, is the rest of the BIOS and
+*	is updated like firmware: the image is uploaded into the staging
+*	slot and verified, and MAILBOX_CMD_STAGE1 asks stage-0 to copy it
+*	into place on the next reset. Stage-0 also copies it when stage-1 is
+*	missing, so a copy cut short by a power loss is started again.
+*
+*	Stage-0 runs on the reset clock with only its own code: it doesn't
+*	call into stage-1 or the C library, and keeps everything it uses in
+*	the .stage0 sections.
+*/
+#define STAGE0_VECTORS	16		// Core exceptions only, stage-0 enables no interrupts
+
+void stage0_reset(void);
+
+#endif /* STAGE0_H_ */
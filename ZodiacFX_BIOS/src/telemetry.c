@@ -0,0 +1,318 @@
+/**
+ * @file
+ * telemetry.c
+ *
+ * This file contains the persistent telemetry log functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "telemetry.h"
+#include "boot.h"
+
+// Global variables
+extern struct verification_data verify;
+
+// Internal Functions
+static uint32_t telemetry_checksum(const struct telemetry_record *record);
+static const struct telemetry_record *telemetry_page(int index);
+static int telemetry_valid(const struct telemetry_record *record);
+static int telemetry_blank(int index);
+static void telemetry_fold(struct telemetry_record *sum, const struct telemetry_record *record);
+static int telemetry_write(int index, struct telemetry_record *record);
+static int telemetry_append(struct telemetry_record *record);
+
+/*
+*	Sum every word of a record before the checksum
+*
+*/
+static uint32_t telemetry_checksum(const struct telemetry_record *record)
+{
+	const uint32_t *word = (const uint32_t *)record;
+	uint32_t sum = 0;
+	
+	for (int i = 0; i < offsetof(struct telemetry_record, checksum) / sizeof(uint32_t); i++)
+	{
+		sum += word[i];
+	}
+	return sum;
+}
+
+/*
+*	Record in page 'index' of the log, counted across both halves
+*
+*/
+static const struct telemetry_record *telemetry_page(int index)
+{
+	return (const struct telemetry_record *)(TELEMETRY_BASE + index * IFLASH_PAGE_SIZE);
+}
+
+static int telemetry_valid(const struct telemetry_record *record)
+{
+	return record->magic == TELEMETRY_MAGIC && record->checksum == telemetry_checksum(record);
+}
+
+/*
+*	Check that the record area of a page is still erased
+*
+*/
+static int telemetry_blank(int index)
+{
+	const uint32_t *word = (const uint32_t *)telemetry_page(index);
+	
+	for (int i = 0; i < sizeof(struct telemetry_record) / sizeof(uint32_t); i++)
+	{
+		if (word[i] != 0xFFFFFFFF) return 0;
+	}
+	return 1;
+}
+
+/*
+*	Add a record's counters into a summary record
+*
+*/
+static void telemetry_fold(struct telemetry_record *sum, const struct telemetry_record *record)
+{
+	sum->events += record->events;
+	for (int i = 0; i < 3; i++)
+	{
+		sum->path_count[i] += record->path_count[i];
+	}
+	sum->check_us += record->check_us;
+	sum->verify_us += record->verify_us;
+	sum->update_us += record->update_us;
+	sum->upload_bytes += record->upload_bytes;
+	sum->upload_ms += record->upload_ms;
+	sum->naks += record->naks;
+	sum->timeouts += record->timeouts;
+	sum->duplicates += record->duplicates;
+	sum->errors += record->errors;
+}
+
+/*
+*	Program a record into an erased page of the log
+*
+*/
+static int telemetry_write(int index, struct telemetry_record *record)
+{
+	uint32_t page[IFLASH_PAGE_SIZE / sizeof(uint32_t)];
+	
+	record->magic = TELEMETRY_MAGIC;
+	record->checksum = telemetry_checksum(record);
+	memset(page, 0xFF, sizeof(page));
+	memcpy(page, record, sizeof(*record));
+	
+	if (flash_write_aligned((uint32_t)telemetry_page(index), page, IFLASH_PAGE_SIZE) != FLASH_RC_OK)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+/*
+*	Append a record after the newest one, compacting the older half when
+*	the current half is full
+*
+*/
+static int telemetry_append(struct telemetry_record *record)
+{
+	struct telemetry_record summary;
+	const struct telemetry_record *page;
+	int newest = -1;
+	uint32_t seq = 0;
+	int next, half, i;
+	
+	if (!flash_records_unlock(TELEMETRY_BASE, TELEMETRY_END))
+	{
+		return 0;
+	}
+	for (i = 0; i < 2 * TELEMETRY_HALF_PAGES; i++)
+	{
+		page = telemetry_page(i);
+		if (telemetry_valid(page) && (newest < 0 || page->seq > seq))
+		{
+			newest = i;
+			seq = page->seq;
+		}
+	}
+	
+	next = newest + 1;
+	if (newest >= 0 && next % TELEMETRY_HALF_PAGES != 0 && telemetry_blank(next))
+	{
+		record->seq = seq + 1;
+		return telemetry_write(next, record);
+	}
+	
+	// Start the other half, keeping what it held as one summary record
+	half = (newest < TELEMETRY_HALF_PAGES) ? 1 : 0;
+	if (newest < 0)
+	{
+		half = 0;
+	}
+	next = half * TELEMETRY_HALF_PAGES;
+	
+	memset(&summary, 0, sizeof(summary));
+	summary.type = TELEMETRY_SUMMARY;
+	for (i = next; i < next + TELEMETRY_HALF_PAGES; i++)
+	{
+		if (telemetry_valid(telemetry_page(i)))
+		{
+			telemetry_fold(&summary, telemetry_page(i));
+		}
+	}
+	
+	if (flash_erase_page((uint32_t)telemetry_page(next), IFLASH_ERASE_PAGES_16) != FLASH_RC_OK)
+	{
+		return 0;
+	}
+	
+	if (summary.events > 0)
+	{
+		summary.seq = ++seq;
+		if (!telemetry_write(next++, &summary))
+		{
+			return 0;
+		}
+	}
+	
+	record->seq = seq + 1;
+	return telemetry_write(next, record);
+}
+
+/*
+*	Log the boot path and how long the boot decision took
+*
+*	@param boot_path - SKIP, UPDATE or RUN
+*	@param check_cycles - cycles spent in firmware_check()
+*	@param update_cycles - cycles spent in firmware_update(), 0 if not run
+*	@param errors - failed checks or flash errors during the boot
+*/
+void telemetry_log_boot(int boot_path, uint32_t check_cycles, uint32_t update_cycles, uint32_t errors)
+{
+	struct telemetry_record record;
+	uint32_t cyc_per_us = boot_cpu_hz() / 1000000;
+	
+	memset(&record, 0, sizeof(record));
+	record.type = TELEMETRY_BOOT;
+	record.boot_path = boot_path;
+	record.events = 1;
+	record.path_count[boot_path] = 1;
+	record.check_us = check_cycles / cyc_per_us;
+	if (boot_path != RUN)
+	{
+		record.verify_us = verify.cycles / cyc_per_us;
+	}
+	record.update_us = update_cycles / cyc_per_us;
+	record.errors = errors;
+	telemetry_append(&record);
+}
+
+/*
+*	Log the statistics of an upload from the command line
+*
+*	@param stats - statistics of the finished transfer
+*	@param errors - failed transfers or verification
+*/
+void telemetry_log_upload(const struct xmodem_stats *stats, uint32_t errors)
+{
+	struct telemetry_record record;
+	uint32_t cyc_per_us = boot_cpu_hz() / 1000000;
+	
+	memset(&record, 0, sizeof(record));
+	record.type = TELEMETRY_UPLOAD;
+	record.events = 1;
+	record.verify_us = verify.cycles / cyc_per_us;
+	record.upload_bytes = stats->bytes;
+	record.upload_ms = stats->total_cycles / cyc_per_us / 1000;
+	record.naks = stats->naks;
+	record.timeouts = stats->timeouts;
+	record.duplicates = stats->duplicates;
+	record.errors = errors;
+	telemetry_append(&record);
+}
+
+/*
+*	Stream the log out as CSV, oldest record first
+*
+*/
+void telemetry_dump(void)
+{
+	static const char * const type_names[] = {"", "boot", "upload", "summary"};
+	const struct telemetry_record *record;
+	uint32_t last = 0;
+	int first = 1;
+	
+	printf("\r\nseq,type,events,skip,update,run,check_us,verify_us,update_us,"
+	"upload_bytes,upload_ms,naks,timeouts,duplicates,errors\r\n");
+	while (1)
+	{
+		const struct telemetry_record *oldest = NULL;
+		
+		for (int i = 0; i < 2 * TELEMETRY_HALF_PAGES; i++)
+		{
+			record = telemetry_page(i);
+			if (!telemetry_valid(record) || record->type > TELEMETRY_SUMMARY) continue;
+			if (!first && record->seq <= last) continue;
+			if (oldest == NULL || record->seq < oldest->seq) oldest = record;
+		}
+		if (oldest == NULL) break;
+		
+		printf("%lu,%s,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+		(unsigned long)oldest->seq, type_names[oldest->type], oldest->events,
+		(unsigned long)oldest->path_count[SKIP], (unsigned long)oldest->path_count[UPDATE],
+		(unsigned long)oldest->path_count[RUN], (unsigned long)oldest->check_us,
+		(unsigned long)oldest->verify_us, (unsigned long)oldest->update_us,
+		(unsigned long)oldest->upload_bytes, (unsigned long)oldest->upload_ms,
+		(unsigned long)oldest->naks, (unsigned long)oldest->timeouts,
+		(unsigned long)oldest->duplicates, (unsigned long)oldest->errors);
+		last = oldest->seq;
+		first = 0;
+	}
+	printf("\r\n");
+}
+
+/*
+*	Erase the whole log
+*
+*/
+int telemetry_clear(void)
+{
+	if (!flash_records_unlock(TELEMETRY_BASE, TELEMETRY_END))
+	{
+		return 0;
+	}
+	for (uint32_t addr = TELEMETRY_BASE; addr < TELEMETRY_END; addr += TELEMETRY_HALF_SIZE)
+	{
+		if (flash_erase_page(addr, IFLASH_ERASE_PAGES_16) != FLASH_RC_OK)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file
+ * telemetry.h
+ *
+ * This file contains the persistent telemetry log definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "flash.h"
+
+/*
+*	The telemetry log is two halves of TELEMETRY_HALF_SIZE bytes at
+*	TELEMETRY_BASE, one record per flash page. When the current half is
+*	full, the records in the other (older) half are folded into a single
+*	summary record, that half is erased with the summary as its first
+*	record, and appending continues there.
+*/
+#define TELEMETRY_HALF_SIZE		((TELEMETRY_END - TELEMETRY_BASE) / 2)
+#define TELEMETRY_HALF_PAGES	(TELEMETRY_HALF_SIZE / IFLASH_PAGE_SIZE)
+#define TELEMETRY_MAGIC			0x544C4D31	// "TLM1"
+
+#define TELEMETRY_BOOT		1
+#define TELEMETRY_UPLOAD	2
+#define TELEMETRY_SUMMARY	3
+
+struct telemetry_record
+{
+	uint32_t magic;
+	uint32_t seq;			// Increases by one per record written
+	uint8_t type;
+	uint8_t boot_path;		// SKIP, UPDATE or RUN for boot records
+	uint16_t events;		// Boots/uploads folded into this record
+	uint32_t path_count[3];	// Boots taking each path (SKIP, UPDATE, RUN)
+	uint32_t check_us;		// firmware_check()
+	uint32_t verify_us;		// verification_check()
+	uint32_t update_us;		// firmware_update()
+	uint32_t upload_bytes;
+	uint32_t upload_ms;
+	uint32_t naks;
+	uint32_t timeouts;
+	uint32_t duplicates;
+	uint32_t errors;		// Failed verifications and flash errors
+	uint32_t checksum;		// Sum of the words above
+};
+
+void telemetry_log_boot(int boot_path, uint32_t check_cycles, uint32_t update_cycles, uint32_t errors);
+void telemetry_log_upload(const struct xmodem_stats *stats, uint32_t errors);
+void telemetry_dump(void);
+int telemetry_clear(void);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,292 @@
+/**
+ * @file
+ * trace.c
+ *
+ * This file contains the binary trace ring functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <stdarg.h>
+#include <string.h>
+#include "conf_bios.h"
+#include "trace.h"
+
+// Global variables
+struct trace_ring trace_ring __attribute__ ((section (".noinit")));
+
+// Linker symbols (flash.ld)
+extern const char _srodata[], _erodata[];
+extern const uint32_t __build_id_start[], __build_id_end[];
+
+// Local Variables
+static trace_sink_t trace_sink;
+static volatile bool trace_cdc_open;
+
+// Internal Functions
+static uint32_t trace_build_id(void);
+static int trace_fmt_valid(const char *fmt);
+
+/*
+*	Initialise the trace ring
+*
+*	The ring lives in .noinit, so records from before a soft reset are
+*	kept for post-mortem decoding unless the ring header is invalid or
+*	was written by another build.
+*/
+void trace_init(void)
+{
+	if (trace_ring.magic != TRACE_RING_MAGIC || trace_ring.build != trace_build_id())
+	{
+		trace_clear();
+	}
+#if TRACE_SINK_CDC
+	trace_set_sink(trace_sink_cdc);
+#elif TRACE_SINK_ITM
+	trace_set_sink(trace_sink_itm);
+#endif
+}
+
+/*
+*	Empty the trace ring
+*
+*/
+void trace_clear(void)
+{
+	memset(&trace_ring, 0, sizeof(trace_ring));
+	trace_ring.magic = TRACE_RING_MAGIC;
+	trace_ring.build = trace_build_id();
+}
+
+/*
+*	Return the first word of the GNU build id, or 0 if none was linked in
+*
+*	The note is a 12 byte header and "GNU\0", then the id itself.
+*/
+static uint32_t trace_build_id(void)
+{
+	if (__build_id_end - __build_id_start < 5)
+	{
+		return 0;
+	}
+	return __build_id_start[4];
+}
+
+/*
+*	Check that a format id points into this image's .rodata
+*
+*	@param fmt - format id from a trace record
+*/
+static int trace_fmt_valid(const char *fmt)
+{
+	return fmt >= _srodata && fmt < _erodata;
+}
+
+/*
+*	Set the sink that is handed every record as it is written
+*
+*	@param sink - sink function, or NULL for the ring only
+*/
+void trace_set_sink(trace_sink_t sink)
+{
+	trace_sink = sink;
+}
+
+/*
+*	Append a record to the trace ring
+*
+*	Runs from SRAM so trace calls are safe in the flash write path.
+*
+*	@param level - trace level
+*	@param fmt - printf style format string, used as the format id
+*	@param nargs - number of arguments that follow
+*/
+RAMFUNC
+void trace_record(uint8_t level, const char *fmt, int nargs, ...)
+{
+	struct trace_record *record;
+	irqflags_t flags;
+	va_list ap;
+	
+	flags = cpu_irq_save();
+	record = &trace_ring.records[trace_ring.head % TRACE_RING_LEN];
+	trace_ring.head++;
+	cpu_irq_restore(flags);
+	
+	record->fmt = fmt;
+	record->timestamp = DWT->CYCCNT;
+	record->level = level;
+	record->nargs = nargs;
+	va_start(ap, nargs);
+	for (int i = 0; i < nargs && i < TRACE_MAX_ARGS; i++)
+	{
+		record->args[i] = va_arg(ap, uint32_t);
+	}
+	va_end(ap);
+	
+	if (trace_sink != NULL)
+	{
+		trace_sink(record);
+	}
+}
+
+/*
+*	Sink: copy each record out through ITM stimulus port 1
+*
+*	Only writes while a debugger has enabled the ITM and the port.
+*/
+RAMFUNC
+void trace_sink_itm(const struct trace_record *record)
+{
+	const uint32_t *word = (const uint32_t *)record;
+	
+	if (!(ITM->TCR & ITM_TCR_ITMENA_Msk) || !(ITM->TER & (1UL << 1)))
+	{
+		return;
+	}
+	
+	for (int i = 0; i < sizeof(struct trace_record) / sizeof(uint32_t); i++)
+	{
+		while (ITM->PORT[1].u32 == 0);
+		ITM->PORT[1].u32 = word[i];
+	}
+}
+
+/*
+*	Sink: copy each record out through the second CDC port
+*
+*	Records go out as they are in the ring, for tools/trace_decode.py.
+*	Only whole records are written, and only while the host has the port
+*	open, so a record that does not fit the USB buffer is dropped rather
+*	than stalling the caller.
+*/
+RAMFUNC
+void trace_sink_cdc(const struct trace_record *record)
+{
+	if (!trace_cdc_open || udi_cdc_multi_get_free_tx_buffer(TRACE_CDC_PORT) < sizeof(struct trace_record))
+	{
+		return;
+	}
+	udi_cdc_multi_write_buf(TRACE_CDC_PORT, record, sizeof(struct trace_record));
+}
+
+/*
+*	Trace port enabled by the host (UDI_CDC_ENABLE_EXT in conf_usb.h)
+*
+*	This and the two callbacks below run in the USB interrupt, so they
+*	stay in SRAM like the USB stack.
+*/
+RAMFUNC
+bool trace_cdc_enable(void)
+{
+	trace_cdc_open = false;
+	return true;
+}
+
+/*
+*	Trace port disabled by the host
+*
+*/
+RAMFUNC
+void trace_cdc_disable(void)
+{
+	trace_cdc_open = false;
+}
+
+/*
+*	Host opened or closed the trace port (DTR)
+*
+*	@param set - DTR state
+*/
+RAMFUNC
+void trace_cdc_set_dtr(bool set)
+{
+	trace_cdc_open = set;
+}
+
+/*
+*	Decode and print the trace ring, oldest record first
+*
+*/
+void trace_dump(void)
+{
+	uint32_t first = 0;
+	
+	if (trace_ring.head > TRACE_RING_LEN)
+	{
+		first = trace_ring.head - TRACE_RING_LEN;
+	}
+	
+	printf("\r\n");
+	for (uint32_t n = first; n < trace_ring.head; n++)
+	{
+		struct trace_record *record = &trace_ring.records[n % TRACE_RING_LEN];
+		
+		printf("[%10lu] ", (unsigned long)record->timestamp);
+		if (trace_fmt_valid(record->fmt))
+		{
+			printf(record->fmt, record->args[0], record->args[1], record->args[2], record->args[3]);
+		}
+		else
+		{
+			printf("<unknown format %08lx>", (unsigned long)record->fmt);
+			for (int i = 0; i < record->nargs && i < TRACE_MAX_ARGS; i++)
+			{
+				printf(" %08lx", (unsigned long)record->args[i]);
+			}
+		}
+		printf("\r\n");
+	}
+	printf("\r\n%lu records, %lu kept\r\n\r\n", (unsigned long)trace_ring.head,
+	(unsigned long)(trace_ring.head - first));
+}
+
+/*
+*	Print the trace ring as hex words for tools/trace_decode.py
+*
+*/
+void trace_dump_raw(void)
+{
+	uint32_t first = 0;
+	
+	if (trace_ring.head > TRACE_RING_LEN)
+	{
+		first = trace_ring.head - TRACE_RING_LEN;
+	}
+	
+	printf("\r\nTRACE-RAW %lu\r\n", (unsigned long)(trace_ring.head - first));
+	for (uint32_t n = first; n < trace_ring.head; n++)
+	{
+		const uint32_t *word = (const uint32_t *)&trace_ring.records[n % TRACE_RING_LEN];
+		
+		for (int i = 0; i < sizeof(struct trace_record) / sizeof(uint32_t); i++)
+		{
+			printf("%08lx ", (unsigned long)word[i]);
+		}
+		printf("\r\n");
+	}
+	printf("TRACE-END\r\n\r\n");
+}
@@ -1,4 +1,100 @@
-extern bool bios_debug;
-#define TRACE(fmt, ...) if (bios_debug) { printf(fmt "\r\n", ## __VA_ARGS__); }
-// build with this instead, to disable trace for performance.
-// #define TRACE(...) ;
+/**
+ * @file
+ * trace.h
+ *
+ * This file contains the binary trace ring definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "conf_bios.h"
+
+/*
+*	Trace calls record the address of their format string and the raw
+*	arguments into a ring in .noinit SRAM; nothing is formatted until the
+*	ring is decoded by the 'trace' command or tools/trace_decode.py.
+*	A ring left by a different build is cleared at start up, since its
+*	format ids point into that build's .rodata.
+*	Levels above TRACE_LEVEL (conf_bios.h) are compiled out.
+*/
+#define TRACE_LEVEL_NONE	0
+#define TRACE_LEVEL_ERROR	1
+#define TRACE_LEVEL_INFO	2
+#define TRACE_LEVEL_DEBUG	3
+
+#define TRACE_MAX_ARGS		4
+#define TRACE_RING_LEN		128		// Records kept in the ring
+#define TRACE_RING_MAGIC	0x54524331	// "TRC1"
+#define TRACE_CDC_PORT		1		// CDC port of the trace sink, see usb_desc.c
+
+struct trace_record
+{
+	const char *fmt;		// Format id (address of the format string)
+	uint32_t timestamp;		// DWT cycle count
+	uint8_t level;
+	uint8_t nargs;
+	uint16_t reserved;
+	uint32_t args[TRACE_MAX_ARGS];
+};
+
+struct trace_ring
+{
+	uint32_t magic;
+	uint32_t build;			// Build id of the image that wrote the ring
+	uint32_t head;			// Total records written, the ring index is head % TRACE_RING_LEN
+	struct trace_record records[TRACE_RING_LEN];
+};
+
+typedef void (*trace_sink_t)(const struct trace_record *record);
+
+void trace_init(void);
+void trace_clear(void);
+void trace_set_sink(trace_sink_t sink);
+void trace_record(uint8_t level, const char *fmt, int nargs, ...);
+void trace_dump(void);
+void trace_dump_raw(void);
+void trace_sink_itm(const struct trace_record *record);
+void trace_sink_cdc(const struct trace_record *record);
+bool trace_cdc_enable(void);
+void trace_cdc_disable(void);
+void trace_cdc_set_dtr(bool set);
+
+#define TRACE_NARGS(...) TRACE_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define TRACE_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+
+#define TRACE_AT(level, fmt, ...) \
+	do { \
+		if ((level) <= TRACE_LEVEL) \
+			trace_record((level), (fmt), TRACE_NARGS(__VA_ARGS__), ## __VA_ARGS__); \
+	} while (0)
+
+#define TRACE_ERROR(fmt, ...)	TRACE_AT(TRACE_LEVEL_ERROR, fmt, ## __VA_ARGS__)
+#define TRACE_INFO(fmt, ...)	TRACE_AT(TRACE_LEVEL_INFO, fmt, ## __VA_ARGS__)
+#define TRACE(fmt, ...)			TRACE_AT(TRACE_LEVEL_DEBUG, fmt, ## __VA_ARGS__)
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * udi_dfu.c
+ *
+ * This file contains the DFU interface of the USB device stack
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include "udi_dfu.h"
+#include "dfu.h"
+
+// Internal Functions
+static bool udi_dfu_enable(void);
+static void udi_dfu_disable(void);
+static bool udi_dfu_setup(void);
+static uint8_t udi_dfu_getsetting(void);
+
+UDC_DESC_STORAGE udi_api_t udi_api_dfu = {
+	.enable = udi_dfu_enable,
+	.disable = udi_dfu_disable,
+	.setup = udi_dfu_setup,
+	.getsetting = udi_dfu_getsetting,
+	.sof_notify = NULL,
+};
+
+static bool udi_dfu_enable(void)
+{
+	dfu_reset();
+	return true;
+}
+
+static void udi_dfu_disable(void)
+{
+	dfu_reset();
+}
+
+/*
+*	Pass a class request on to the DFU state machine
+*
+*	udd_g_ctrlreq.req already has its 16-bit fields in CPU order.
+*/
+static bool udi_dfu_setup(void)
+{
+	struct dfu_request req;
+	uint8_t *payload;
+	uint16_t length;
+	
+	if (Udd_setup_type() != USB_REQ_TYPE_CLASS)
+	{
+		return false;
+	}
+	req.bmRequestType = udd_g_ctrlreq.req.bmRequestType;
+	req.bRequest = udd_g_ctrlreq.req.bRequest;
+	req.wValue = udd_g_ctrlreq.req.wValue;
+	req.wIndex = udd_g_ctrlreq.req.wIndex;
+	req.wLength = udd_g_ctrlreq.req.wLength;
+	if (Udd_setup_is_in() != ((req.bRequest == DFU_UPLOAD) || (req.bRequest == DFU_GETSTATUS)
+		|| (req.bRequest == DFU_GETSTATE)))
+	{
+		return false;
+	}
+	if (!dfu_setup(&req, &payload, &length))
+	{
+		return false;
+	}
+	udd_g_ctrlreq.payload = payload;
+	udd_g_ctrlreq.payload_size = length;
+	udd_g_ctrlreq.callback = dfu_setup_done;
+	return true;
+}
+
+static uint8_t udi_dfu_getsetting(void)
+{
+	return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file
+ * udi_dfu.h
+ *
+ * This file contains the DFU interface of the USB device stack
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef UDI_DFU_H_
+#define UDI_DFU_H_
+
+#include "conf_usb.h"
+#include "usb_protocol.h"
+#include "udc_desc.h"
+#include "udi.h"
+#include "dfu.h"
+
+#define USB_DT_DFU_FUNCTIONAL	0x21
+#define DFU_CLASS_APP_SPECIFIC	0xFE
+#define DFU_SUBCLASS			0x01
+#define DFU_PROTOCOL_DFU_MODE	0x02
+
+COMPILER_PACK_SET(1)
+
+// DFU functional descriptor
+typedef struct {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bmAttributes;
+	le16_t wDetachTimeOut;
+	le16_t wTransferSize;
+	le16_t bcdDFUVersion;
+} usb_dfu_func_desc_t;
+
+// DFU interface descriptors
+typedef struct {
+	usb_iface_desc_t iface;
+	usb_dfu_func_desc_t func;
+} udi_dfu_desc_t;
+
+COMPILER_PACK_RESET()
+
+// Content of the DFU interface descriptors, no endpoints besides control
+#define UDI_DFU_DESC { \
+	.iface.bLength				= sizeof(usb_iface_desc_t),\
+	.iface.bDescriptorType		= USB_DT_INTERFACE,\
+	.iface.bInterfaceNumber		= UDI_DFU_IFACE_NUMBER,\
+	.iface.bAlternateSetting	= 0,\
+	.iface.bNumEndpoints		= 0,\
+	.iface.bInterfaceClass		= DFU_CLASS_APP_SPECIFIC,\
+	.iface.bInterfaceSubClass	= DFU_SUBCLASS,\
+	.iface.bInterfaceProtocol	= DFU_PROTOCOL_DFU_MODE,\
+	.iface.iInterface			= 0,\
+	.func.bLength				= sizeof(usb_dfu_func_desc_t),\
+	.func.bDescriptorType		= USB_DT_DFU_FUNCTIONAL,\
+	.func.bmAttributes			= DFU_ATTRIBUTES,\
+	.func.wDetachTimeOut		= LE16(DFU_DETACH_MS),\
+	.func.wTransferSize			= LE16(DFU_TRANSFER_SIZE),\
+	.func.bcdDFUVersion			= LE16(0x0110),\
+	}
+
+extern UDC_DESC_STORAGE udi_api_t udi_api_dfu;
+
+#endif /* UDI_DFU_H_ */
@@ -0,0 +1,396 @@
+/**
+ * @file
+ * boot_bench.c
+ *
+ * This file contains the boot time benchmark
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <ctype.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "boot.h"
+#include "sim.h"
+
+#define BENCH_MAX_SIZES		8
+#define BENCH_MAX_IMAGE		(FLASH_BUFFER_END - FLASH_BUFFER)	// The default update buffer
+
+enum bench_image_kind
+{
+	IMAGE_NONE,
+	IMAGE_VALID,
+	IMAGE_CORRUPT,
+};
+
+/*
+*	One boot path: what is in FLASH_STORE and FLASH_BUFFER at reset.
+*	Sized paths are run once per image size, for the buffer image.
+*/
+struct bench_path
+{
+	const char *name;
+	enum bench_image_kind store;
+	enum bench_image_kind buffer;
+	int sized;
+};
+
+// Global variables
+int bios_main(void);
+
+// Local Variables
+static const struct bench_path paths[] =
+{
+	{ "skip",			IMAGE_NONE,		IMAGE_NONE,		0 },
+	{ "skip_invalid",	IMAGE_NONE,		IMAGE_CORRUPT,	1 },
+	{ "run",			IMAGE_VALID,	IMAGE_NONE,		0 },
+	{ "run_invalid",	IMAGE_VALID,	IMAGE_CORRUPT,	1 },
+	{ "update",			IMAGE_NONE,		IMAGE_VALID,	1 },
+	{ "replace",		IMAGE_VALID,	IMAGE_VALID,	1 },
+};
+static const char * const mark_ids[BOOT_MARK_COUNT] =
+{
+#define BENCH_MARK_ID(id, name) #id,
+	BOOT_MARK_LIST(BENCH_MARK_ID)
+#undef BENCH_MARK_ID
+};
+static jmp_buf boot_end;
+static double cycles_per_byte = 6;	// Target cost of the verification byte loops
+static double cycles_per_ns;
+static int repeats = 5;
+static int json;
+
+// Internal Functions
+static void bench_image(uint8_t *image, uint32_t size, uint32_t seed, int corrupt);
+static double bench_calibrate(void);
+static void bench_boot(const struct bench_path *path, uint32_t size, struct boot_times *times);
+static void bench_run(const struct bench_path *path, uint32_t size);
+static const char *mark_column(int mark);
+static void usage(const char *name);
+
+/*
+*	Build a firmware image with the checksum and padding that
+*	verification_check() expects, or with one byte changed after the
+*	checksum was taken
+*/
+static void bench_image(uint8_t *image, uint32_t size, uint32_t seed, int corrupt)
+{
+	uint32_t sum = 0;
+	uint32_t body = size - 8;
+	
+	for (uint32_t i = 0; i < body; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		image[i] = (seed >> 16) % 0xFF;		// Never 0xFF, so nothing is stripped
+		sum += image[i];
+	}
+	memcpy(image + body, &sum, 4);
+	memset(image + body + 4, 0, 4);
+	if (corrupt)
+	{
+		image[body / 2] ^= 0x01;
+	}
+}
+
+/*
+*	Target cycles per host nanosecond, from a byte sum loop like the one
+*	in verification_check_region() and the target cost of one byte
+*/
+static double bench_calibrate(void)
+{
+	static uint8_t data[BENCH_MAX_IMAGE];
+	volatile uint32_t result;
+	double best = 0;
+	
+	memset(data, 0x5A, sizeof(data));
+	for (int pass = 0; pass < 20; pass++)
+	{
+		struct timespec t0, t1;
+		const uint8_t *p = data;
+		uint32_t sum = 0;
+		double ns;
+		
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+		while (p < data + sizeof(data))
+		{
+			sum += *p;
+			p++;
+		}
+		result = sum;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+		ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		if (best == 0 || ns < best) best = ns;
+	}
+	(void)result;
+	return cycles_per_byte * sizeof(data) / best;
+}
+
+/*
+*	Column name for a mark, BOOT_VERIFY_END -> verify_end_us
+*
+*/
+static const char *mark_column(int mark)
+{
+	static char column[BOOT_MARK_COUNT][32];
+	const char *id = mark_ids[mark] + strlen("BOOT_");
+	int i;
+	
+	for (i = 0; id[i] != '\0' && i < sizeof(column[0]) - 4; i++)
+	{
+		column[mark][i] = tolower((unsigned char)id[i]);
+	}
+	strcpy(column[mark] + i, "_us");
+	return column[mark];
+}
+
+/*
+*	Boot from reset with the path's images in flash
+*
+*/
+static void bench_boot(const struct bench_path *path, uint32_t size, struct boot_times *times)
+{
+	static uint8_t image[BENCH_MAX_IMAGE];
+	
+	sim_flash_reset();
+	if (path->store != IMAGE_NONE)
+	{
+		bench_image(image, 64 * 1024, 1, path->store == IMAGE_CORRUPT);
+		sim_flash_fill(FLASH_STORE, image, 64 * 1024);
+	}
+	if (path->buffer != IMAGE_NONE)
+	{
+		bench_image(image, size, 2, path->buffer == IMAGE_CORRUPT);
+		sim_flash_fill(FLASH_BUFFER, image, size);
+	}
+	
+	// Power-on: fresh RAM, then Reset_Handler
+	sim_restore();
+	sim_firmware_exit = &boot_end;
+	sim_clock_cpu(cycles_per_ns);
+	if (setjmp(boot_end) == 0)
+	{
+		boot_time_reset();
+		boot_fast_path();
+		bios_main();
+	}
+	sim_firmware_exit = NULL;
+	*times = *boot_times_current();
+}
+
+/*
+*	Boot the path a few times and print the time from the previous mark
+*	to each mark that was reached, for the fastest boot
+*/
+static void bench_run(const struct bench_path *path, uint32_t size)
+{
+	struct boot_times best = { 0 }, times;
+	const struct boot_times *t = &best;
+	const char *end;
+	uint32_t last_us = 0;
+	
+	for (int i = 0; i < repeats; i++)
+	{
+		bench_boot(path, size, &times);
+		if (i == 0 || times.last_us < best.last_us) best = times;
+	}
+	end = (t->marked & (1 << BOOT_JUMP)) ? "jump" : "cli";
+	if (json)
+	{
+		fprintf(stdout, "{\"path\":\"%s\",\"image_bytes\":%u,\"end\":\"%s\",\"total_us\":%u",
+		path->name, path->sized ? size : 0, end, t->last_us);
+	}
+	else
+	{
+		fprintf(stdout, "%s,%u,%s,%u", path->name, path->sized ? size : 0, end, t->last_us);
+	}
+	for (int i = BOOT_RESET + 1; i < BOOT_MARK_COUNT; i++)
+	{
+		int reached = t->marked & (1 << i);
+		
+		if (json)
+		{
+			if (reached) fprintf(stdout, ",\"%s\":%u", mark_column(i), t->us[i] - last_us);
+		}
+		else
+		{
+			if (reached) fprintf(stdout, ",%u", t->us[i] - last_us);
+			else fprintf(stdout, ",");
+		}
+		if (reached) last_us = t->us[i];
+	}
+	fprintf(stdout, json ? "}\n" : "\n");
+	fflush(stdout);
+}
+
+/*
+*	The BIOS has reached its command loop; the boot is over
+*
+*/
+bool udi_cdc_is_rx_ready(void)
+{
+	longjmp(boot_end, 1);
+}
+
+int udi_cdc_getc(void)
+{
+	return 0;
+}
+
+iram_size_t udi_cdc_read_no_polling(void *buf, iram_size_t size)
+{
+	return 0;
+}
+
+iram_size_t udi_cdc_write_buf(const void *buf, iram_size_t size)
+{
+	return 0;
+}
+
+int udi_cdc_putc(int value)
+{
+	return 1;
+}
+
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port)
+{
+	return 0;
+}
+
+iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void *buf, iram_size_t size)
+{
+	return size;
+}
+
+int sim_cdc_printf(const char *fmt, ...)
+{
+	return 0;
+}
+
+void sim_cdc_flush(void)
+{
+}
+
+/*
+*	Print the command line usage
+*
+*/
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	"usage: %s [-j] [-n kb,kb,...] [-r repeats] [-K cycles] [-T a,b,c]\n"
+	"  -j          JSON lines instead of CSV\n"
+	"  -n          buffer image sizes in KB (default 64,128,192)\n"
+	"  -r          boots per row, the fastest is reported (default 5)\n"
+	"  -K          target cycles per byte of the verification loops (default 6)\n"
+	"  -T          flash page program, page erase and sector erase costs in us\n"
+	"Flash operations cost their modelled time. Code in between is charged\n"
+	"at its host CPU time, scaled by a byte loop calibrated against -K.\n",
+	name);
+}
+
+/*
+*	Boot each path and print one row per path and image size
+*
+*/
+int main(int argc, char **argv)
+{
+	uint32_t sizes[BENCH_MAX_SIZES] = { 64, 128, 192 };
+	int size_count = 3;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "jn:r:K:T:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				json = 1;
+				break;
+			case 'n':
+				size_count = 0;
+				for (char *tok = strtok(optarg, ","); tok && size_count < BENCH_MAX_SIZES; tok = strtok(NULL, ","))
+				{
+					sizes[size_count++] = strtoul(tok, NULL, 0);
+				}
+				break;
+			case 'r':
+				repeats = strtoul(optarg, NULL, 0);
+				if (repeats < 1) repeats = 1;
+				break;
+			case 'K':
+				cycles_per_byte = strtod(optarg, NULL);
+				break;
+			case 'T':
+				if (sscanf(optarg, "%u,%u,%u", &sim_flash_timing.program_us,
+					&sim_flash_timing.erase_pages_us, &sim_flash_timing.erase_sector_us) != 3)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	for (int i = 0; i < size_count; i++)
+	{
+		if (sizes[i] * 1024 > BENCH_MAX_IMAGE || sizes[i] < 1)
+		{
+			fprintf(stderr, "boot_bench: %u KB does not fit the update buffer\n", sizes[i]);
+			return 1;
+		}
+	}
+	
+	sim_clock_virtual();
+	if (!sim_flash_open(NULL))
+	{
+		fprintf(stderr, "boot_bench: cannot map flash at %08x\n", SIM_FLASH_ADDR);
+		return 1;
+	}
+	cycles_per_ns = bench_calibrate();
+	sim_snapshot();
+	
+	if (!json)
+	{
+		fprintf(stdout, "path,image_bytes,end,total_us");
+		for (int i = BOOT_RESET + 1; i < BOOT_MARK_COUNT; i++)
+		{
+			fprintf(stdout, ",%s", mark_column(i));
+		}
+		fprintf(stdout, "\n");
+	}
+	for (int p = 0; p < sizeof(paths) / sizeof(paths[0]); p++)
+	{
+		for (int i = 0; i < (paths[p].sized ? size_count : 1); i++)
+		{
+			bench_run(&paths[p], sizes[i] * 1024);
+		}
+	}
+	return sim_flash_violations() ? 2 : 0;
+}
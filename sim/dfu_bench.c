@@ -0,0 +1,519 @@
+/**
+ * @file
+ * dfu_bench.c
+ *
+ * This file contains the DFU benchmark and protocol checks
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "slot.h"
+#include "dfu.h"
+#include "sim.h"
+
+#define BENCH_MAX_SIZES		8
+#define BENCH_MAX_IMAGE		(FLASH_BUFFER_END - FLASH_BUFFER + 2 * IFLASH_PAGE_SIZE)
+#define BENCH_STALL			-1
+#define BENCH_IFACE			4		// UDI_DFU_IFACE_NUMBER
+#define DFU_REQ_IN			0xA1	// Class request to the interface, device to host
+#define DFU_REQ_OUT			0x21
+
+// Host side of one run, times in nanoseconds
+struct bench_result
+{
+	uint32_t transfers;			// Control transfers
+	uint32_t early_polls;		// GETSTATUS sent before the device was done
+	uint64_t slack_ns;			// Host waiting after the device was done
+};
+
+/*
+*	The restart after each download puts .data and .bss back to how they
+*	were at power-on, so the host keeps its state on the heap
+*/
+struct bench_host
+{
+	struct bench_result result;
+	uint32_t violations;		// Found before a restart
+	int failures;
+};
+
+// Global variables
+extern struct dfu_stats dfu_stats;
+extern jmp_buf sim_reset_point;
+
+// Local Variables
+static uint32_t transfer_ns = 1000000;		// Host scheduling, one frame per transfer
+static uint32_t packet_ns = 53000;			// One 64 byte control packet
+static struct bench_host *host;
+
+// Internal Functions
+static void bench_image(uint8_t *image, uint32_t size, uint32_t seed, int corrupt);
+static int control(uint8_t type, uint8_t request, uint16_t value, uint16_t length, void *data);
+static int host_getstatus(struct dfu_status *status);
+static int host_download(const uint8_t *image, uint32_t size, uint32_t block_size, int manifest);
+static uint32_t host_upload(uint8_t *data, uint32_t max);
+static uint32_t host_wait_restart(void);
+static void bench_run(const char *name, uint32_t size, int dirty);
+static void bench_upload(uint32_t size);
+static void check(const char *name, int ok);
+static void bench_checks(void);
+static void usage(const char *name);
+
+/*
+*	Build a firmware image with the checksum and padding that
+*	verification_check() expects, or with one byte changed after the
+*	checksum was taken
+*/
+static void bench_image(uint8_t *image, uint32_t size, uint32_t seed, int corrupt)
+{
+	uint32_t sum = 0;
+	uint32_t body = size - 8;
+	
+	for (uint32_t i = 0; i < body; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		image[i] = (seed >> 16) % 0xFF;		// Never 0xFF, so nothing is stripped
+		sum += image[i];
+	}
+	memcpy(image + body, &sum, 4);
+	memset(image + body + 4, 0, 4);
+	if (corrupt)
+	{
+		image[body / 2] ^= 0x01;
+	}
+}
+
+/*
+*	One control transfer through the DFU interface: SETUP, the data
+*	stage and the status stage, as udi_dfu.c passes them on
+*
+*	@return bytes in the data stage, or BENCH_STALL
+*/
+static int control(uint8_t type, uint8_t request, uint16_t value, uint16_t length, void *data)
+{
+	struct dfu_request req = { type, request, value, BENCH_IFACE, length };
+	uint8_t *payload;
+	uint16_t size;
+	
+	host->result.transfers++;
+	sim_clock_advance(transfer_ns);
+	if (!dfu_setup(&req, &payload, &size))
+	{
+		return BENCH_STALL;
+	}
+	if (type & 0x80)
+	{
+		memcpy(data, payload, size);
+	}
+	else
+	{
+		memcpy(payload, data, size);
+	}
+	sim_clock_advance((uint64_t)(size + 63) / 64 * packet_ns);
+	dfu_setup_done();
+	return size;
+}
+
+/*
+*	GETSTATUS, then the host sleeps for bwPollTimeout while the main
+*	loop does the flash work the request handed over
+*
+*/
+static int host_getstatus(struct dfu_status *status)
+{
+	uint64_t replied, done, poll_ns;
+	
+	if (control(DFU_REQ_IN, DFU_GETSTATUS, 0, sizeof(*status), status) != sizeof(*status))
+	{
+		return 0;
+	}
+	if (status->bState == DFU_STATE_MANIFEST_WAIT_RESET)
+	{
+		return 1;	// The device restarts from here
+	}
+	replied = sim_time_ns();
+	dfu_task();
+	done = sim_time_ns();
+	poll_ns = (status->bwPollTimeout[0] | status->bwPollTimeout[1] << 8
+		| status->bwPollTimeout[2] << 16) * 1000000ULL;
+	if (done > replied + poll_ns)
+	{
+		// A real device would have answered the next poll with dfuDNBUSY
+		host->result.early_polls++;
+	}
+	else
+	{
+		host->result.slack_ns += replied + poll_ns - done;
+		sim_clock_advance(replied + poll_ns - done);
+	}
+	return 1;
+}
+
+/*
+*	Download an image the way dfu-util does: DNLOAD a block, then
+*	GETSTATUS until dfuDNLOAD-IDLE, and a zero-length DNLOAD at the end
+*
+*	@return the final bState, or DFU_STATE_ERROR
+*/
+static int host_download(const uint8_t *image, uint32_t size, uint32_t block_size, int manifest)
+{
+	struct dfu_status status;
+	uint32_t offset = 0;
+	uint16_t block_num = 0;
+	uint32_t length;
+	
+	do
+	{
+		length = (size - offset < block_size) ? size - offset : block_size;
+		if (length == 0 && !manifest)
+		{
+			break;
+		}
+		if (control(DFU_REQ_OUT, DFU_DNLOAD, block_num++, length, (void *)(image + offset)) == BENCH_STALL)
+		{
+			return DFU_STATE_ERROR;
+		}
+		offset += length;
+		do
+		{
+			if (!host_getstatus(&status) || status.bStatus != DFU_STATUS_OK)
+			{
+				return DFU_STATE_ERROR;
+			}
+		} while (status.bState == DFU_STATE_DNBUSY || status.bState == DFU_STATE_MANIFEST
+			|| status.bState == DFU_STATE_MANIFEST_SYNC);
+	} while (length > 0);
+	return status.bState;
+}
+
+/*
+*	Upload until the device sends a short block
+*
+*	@return the bytes received
+*/
+static uint32_t host_upload(uint8_t *data, uint32_t max)
+{
+	uint32_t offset = 0;
+	uint16_t block_num = 0;
+	int length;
+	
+	do
+	{
+		length = control(DFU_REQ_IN, DFU_UPLOAD, block_num++, DFU_TRANSFER_SIZE, data + offset);
+		if (length == BENCH_STALL)
+		{
+			return 0;
+		}
+		offset += length;
+	} while (length == DFU_TRANSFER_SIZE && offset + DFU_TRANSFER_SIZE <= max);
+	return offset;
+}
+
+/*
+*	Run the main loop until the BIOS restarts, which it does by itself
+*	DFU_RESET_MS after a manifest
+*
+*	@return microseconds to the restart, 0 if there was none
+*/
+static uint32_t host_wait_restart(void)
+{
+	volatile uint64_t start = sim_time_ns();
+	
+	host->violations += sim_flash_violations();
+	if (setjmp(sim_reset_point) == 0)
+	{
+		while (sim_time_ns() - start < 10ULL * DFU_RESET_MS * 1000000)
+		{
+			sim_clock_advance(100000);
+			dfu_task();
+		}
+		return 0;
+	}
+	sysclk_init();	// sim_restore() left the core on the RC oscillator
+	return (sim_time_ns() - start) / 1000;
+}
+
+/*
+*	Download one image and print its result row
+*
+*	A dirty run starts with the staging slot full of an older image,
+*	so every sector is erased before the first page.
+*/
+static void bench_run(const char *name, uint32_t size, int dirty)
+{
+	static uint8_t image[BENCH_MAX_IMAGE];
+	uint32_t staging = slot_base(slot_staging());
+	uint32_t cyc_per_us = sysclk_get_cpu_hz() / 1000000;
+	const char *status = "ok";
+	struct dfu_stats stats;
+	uint64_t start, wall_us;
+	uint32_t restart_us = 0;
+	int state;
+	
+	sim_flash_reset();
+	if (dirty)
+	{
+		memset(image, 0x55, slot_size(slot_staging()));
+		sim_flash_fill(staging, image, slot_size(slot_staging()));
+	}
+	bench_image(image, size, size, 0);
+	dfu_reset();
+	memset(&host->result, 0, sizeof(host->result));
+	
+	start = sim_time_ns();
+	state = host_download(image, size, DFU_TRANSFER_SIZE, 1);
+	wall_us = (sim_time_ns() - start) / 1000;
+	stats = dfu_stats;	// Before the restart clears it
+	if (state != DFU_STATE_MANIFEST_WAIT_RESET)
+	{
+		status = "dfu_error";
+	}
+	else if (memcmp((const void *)(uintptr_t)staging, image, size) != 0
+		|| verification_check_region(staging, slot_end(slot_staging())) != SUCCESS)
+	{
+		status = "verify_failed";
+	}
+	else if ((restart_us = host_wait_restart()) == 0)
+	{
+		status = "no_restart";
+	}
+	check(name, strcmp(status, "ok") == 0);
+	
+	fprintf(stdout, "%s,%u,%s,%llu,%.1f,%u,%u,%u,%llu,%u,%u,%u,%u\n",
+	name, size, status, (unsigned long long)wall_us,
+	wall_us ? size * 1000000.0 / 1024 / wall_us : 0.0,
+	host->result.transfers, stats.busy, host->result.early_polls,
+	(unsigned long long)(host->result.slack_ns / 1000),
+	stats.erase_cycles / cyc_per_us, stats.program_cycles / cyc_per_us,
+	stats.verify_cycles / cyc_per_us, restart_us);
+	fflush(stdout);
+}
+
+/*
+*	Read the active image back and print its result row
+*
+*/
+static void bench_upload(uint32_t size)
+{
+	static uint8_t image[BENCH_MAX_IMAGE];
+	static uint8_t data[BENCH_MAX_IMAGE];
+	uint32_t received;
+	uint64_t start, wall_us;
+	int ok;
+	
+	sim_flash_reset();
+	bench_image(image, size, size, 0);
+	sim_flash_fill(slot_base(slot_active()), image, size);
+	dfu_reset();
+	memset(&host->result, 0, sizeof(host->result));
+	
+	start = sim_time_ns();
+	received = host_upload(data, sizeof(data));
+	wall_us = (sim_time_ns() - start) / 1000;
+	ok = received == size && memcmp(data, image, size) == 0 && dfu_state() == DFU_STATE_IDLE;
+	check("upload", ok);
+	
+	fprintf(stdout, "upload,%u,%s,%llu,%.1f,%u,0,0,0,0,0,0,0\n",
+	size, ok ? "ok" : "mismatch", (unsigned long long)wall_us,
+	wall_us ? size * 1000000.0 / 1024 / wall_us : 0.0, host->result.transfers);
+	fflush(stdout);
+}
+
+static void check(const char *name, int ok)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "dfu_bench: check failed: %s\n", name);
+		host->failures++;
+	}
+}
+
+/*
+*	Requests out of turn, errors and the ways back to dfuIDLE
+*
+*/
+static void bench_checks(void)
+{
+	static uint8_t image[BENCH_MAX_IMAGE];
+	struct dfu_status status;
+	uint8_t state;
+	int ok;
+	
+	sim_flash_reset();
+	dfu_reset();
+	
+	ok = control(DFU_REQ_IN, DFU_GETSTATE, 0, 1, &state) == 1 && state == DFU_STATE_IDLE;
+	check("getstate_idle", ok);
+	
+	ok = control(DFU_REQ_OUT, DFU_DNLOAD, 0, 0, NULL) == BENCH_STALL
+		&& host_getstatus(&status) && status.bState == DFU_STATE_ERROR
+		&& status.bStatus == DFU_STATUS_ERR_STALLEDPKT;
+	check("manifest_without_image", ok);
+	
+	ok = control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL) == 0 && dfu_state() == DFU_STATE_IDLE;
+	check("clrstatus", ok);
+	
+	ok = control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL) == BENCH_STALL;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("clrstatus_without_error", ok);
+	
+	ok = control(DFU_REQ_OUT, DFU_DNLOAD, 0, DFU_TRANSFER_SIZE * 2, image) == BENCH_STALL;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("block_too_big", ok);
+	
+	ok = control(DFU_REQ_OUT, DFU_DETACH, DFU_DETACH_MS, 0, NULL) == BENCH_STALL;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("detach", ok);
+	
+	bench_image(image, 4096, 1, 0);
+	ok = host_download(image, 4096, DFU_TRANSFER_SIZE, 0) == DFU_STATE_DNLOAD_IDLE && dfu_active()
+		&& control(DFU_REQ_IN, DFU_UPLOAD, 0, DFU_TRANSFER_SIZE, image) == BENCH_STALL
+		&& dfu_state() == DFU_STATE_ERROR;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("upload_during_download", ok);
+	
+	ok = host_download(image, 4096, DFU_TRANSFER_SIZE, 0) == DFU_STATE_DNLOAD_IDLE
+		&& control(DFU_REQ_OUT, DFU_ABORT, 0, 0, NULL) == 0 && dfu_state() == DFU_STATE_IDLE && !dfu_active();
+	check("abort", ok);
+	
+	// Blocks that do not divide the page still fill whole pages
+	bench_image(image, 65536, 2, 0);
+	ok = host_download(image, 65536, 300, 1) == DFU_STATE_MANIFEST_WAIT_RESET
+		&& memcmp((const void *)(uintptr_t)slot_base(slot_staging()), image, 65536) == 0;
+	check("short_blocks", ok);
+	check("short_blocks_restart", host_wait_restart() != 0);
+	
+	sim_flash_reset();
+	dfu_reset();
+	bench_image(image, 65536, 3, 1);
+	ok = host_download(image, 65536, DFU_TRANSFER_SIZE, 1) == DFU_STATE_ERROR
+		&& host_getstatus(&status) && status.bStatus == DFU_STATUS_ERR_VERIFY;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("bad_checksum", ok);
+	
+	bench_image(image, slot_size(slot_staging()) + IFLASH_PAGE_SIZE, 4, 0);
+	ok = host_download(image, slot_size(slot_staging()) + IFLASH_PAGE_SIZE, DFU_TRANSFER_SIZE, 1) == DFU_STATE_ERROR
+		&& host_getstatus(&status) && status.bStatus == DFU_STATUS_ERR_ADDRESS;
+	control(DFU_REQ_OUT, DFU_CLRSTATUS, 0, 0, NULL);
+	check("image_too_big", ok);
+}
+
+/*
+*	Print the command line usage
+*
+*/
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	"usage: %s [-n kb,kb,...] [-t us] [-p us] [-T a,b,c]\n"
+	"  -n          image sizes in KB (default 64,128,192)\n"
+	"  -t          host time per control transfer (default 1000)\n"
+	"  -p          time per 64 byte control packet (default 53)\n"
+	"  -T          flash page program, page erase and sector erase costs in us\n"
+	"The protocol checks run first and failures are reported on stderr.\n"
+	"Each size is then downloaded to a blank and to a dirty staging slot,\n"
+	"and uploaded back from the active slot.\n",
+	name);
+}
+
+/*
+*	Run the checks and the downloads, one CSV row per run
+*
+*/
+int main(int argc, char **argv)
+{
+	uint32_t sizes[BENCH_MAX_SIZES] = { 64, 128, 192 };
+	int size_count = 3;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "n:t:p:T:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				size_count = 0;
+				for (char *tok = strtok(optarg, ","); tok && size_count < BENCH_MAX_SIZES; tok = strtok(NULL, ","))
+				{
+					sizes[size_count++] = strtoul(tok, NULL, 0);
+				}
+				break;
+			case 't':
+				transfer_ns = strtoul(optarg, NULL, 0) * 1000;
+				break;
+			case 'p':
+				packet_ns = strtoul(optarg, NULL, 0) * 1000;
+				break;
+			case 'T':
+				if (sscanf(optarg, "%u,%u,%u", &sim_flash_timing.program_us,
+					&sim_flash_timing.erase_pages_us, &sim_flash_timing.erase_sector_us) != 3)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	
+	sim_clock_virtual();
+	if (!sim_flash_open(NULL))
+	{
+		fprintf(stderr, "dfu_bench: cannot map flash at %08x\n", SIM_FLASH_ADDR);
+		return 1;
+	}
+	sysclk_init();
+	host = calloc(1, sizeof(*host));
+	sim_snapshot();		// Power-on RAM for the restarts
+	for (int i = 0; i < size_count; i++)
+	{
+		if (sizes[i] * 1024 > slot_size(slot_staging()) || sizes[i] < 1)
+		{
+			fprintf(stderr, "dfu_bench: %u KB does not fit the staging slot\n", sizes[i]);
+			return 1;
+		}
+	}
+	
+	bench_checks();
+	fprintf(stdout, "run,image_bytes,result,wall_us,kbps,transfers,busy_replies,early_polls,"
+	"poll_slack_us,erase_us,program_us,verify_us,restart_us\n");
+	for (int i = 0; i < size_count; i++)
+	{
+		bench_run("blank", sizes[i] * 1024, 0);
+		bench_run("dirty", sizes[i] * 1024, 1);
+		bench_upload(sizes[i] * 1024);
+	}
+	if (host->violations + sim_flash_violations())
+	{
+		return 2;
+	}
+	return host->failures ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file
+ * asf.h
+ *
+ * This file stands in for the ASF headers in the host simulator build
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef ASF_H_
+#define ASF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+/*
+*	Only what the BIOS sources use is provided. Peripheral registers are
+*	plain structs, the flash, clock and USB CDC functions are implemented
+*	by the board model in sim/.
+*/
+
+// Compiler
+#define RAMFUNC
+#define COMPILER_ALIGNED(a)	__attribute__ ((aligned (a)))
+#ifndef __always_inline
+#define __always_inline		inline __attribute__ ((__always_inline__))
+#endif
+#define __no_inline			__attribute__ ((__noinline__))
+#define UNUSED(v)			(void)(v)
+
+// stdio goes to the CDC endpoint, as with stdio_usb on the target
+#define printf sim_cdc_printf
+
+// Core
+#define PERIPH_COUNT_IRQn	47
+
+typedef struct
+{
+	uint32_t CTRL;
+	uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+	uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct
+{
+	union
+	{
+		uint8_t u8;
+		uint16_t u16;
+		uint32_t u32;
+	} PORT[32];
+	uint32_t TER;
+	uint32_t TCR;
+} ITM_Type;
+
+typedef struct
+{
+	uint32_t VTOR;
+} SCB_Type;
+
+typedef struct
+{
+	uint32_t ICER[8];
+	uint32_t ICPR[8];
+} NVIC_Type;
+
+DWT_Type *sim_dwt(void);
+extern CoreDebug_Type sim_core_debug;
+extern ITM_Type sim_itm;
+extern SCB_Type sim_scb;
+extern NVIC_Type sim_nvic;
+
+#define DWT			(sim_dwt())
+#define CoreDebug	(&sim_core_debug)
+#define ITM			(&sim_itm)
+#define SCB			(&sim_scb)
+#define NVIC		(&sim_nvic)
+
+#define DWT_CTRL_CYCCNTENA_Msk			(1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk		(1UL << 24)
+#define ITM_TCR_ITMENA_Msk				(1UL << 0)
+#define SCB_VTOR_TBLOFF_Msk				(0x1FFFFFFUL << 7)
+
+static inline uint32_t __CLZ(uint32_t value)
+{
+	return value ? __builtin_clz(value) : 32;
+}
+
+#define __DSB()			__sync_synchronize()
+#define __ISB()			__sync_synchronize()
+#define __DMB()			__sync_synchronize()
+#define __disable_irq()
+#define __enable_irq()
+
+// Handing over to the application: the stack pointer is switched last
+#define __set_MSP(msp)	sim_firmware_start(msp)
+
+typedef uint32_t irqflags_t;
+#define cpu_irq_save()			((irqflags_t)0)
+#define cpu_irq_restore(flags)	((void)(flags))
+#define cpu_irq_enable()
+#define cpu_irq_disable()
+#define irq_initialize_vectors()
+
+// Clocks, board and watchdog
+#define CHIP_FREQ_MAINCK_RC_4MHZ	(4000000UL)
+#define CHIP_FREQ_CPU_MAX			(120000000UL)
+
+#define BOARD_FREQ_MAINCK_XTAL		(12000000UL)
+
+typedef struct
+{
+	uint32_t PMC_MCKR;
+} Pmc;
+
+extern Pmc sim_pmc;
+#define PMC		(&sim_pmc)
+
+#define PMC_MCKR_CSS_Msk		(0x3u << 0)
+#define PMC_MCKR_CSS_SLOW_CLK	(0x0u << 0)
+#define PMC_MCKR_CSS_MAIN_CLK	(0x1u << 0)
+#define PMC_MCKR_CSS_PLLA_CLK	(0x2u << 0)
+#define PMC_MCKR_PRES_CLK_1		(0x0u << 4)
+#define CKGR_MOR_MOSCRCF_4_MHz	(0x0u << 4)
+
+void sysclk_init(void);
+uint32_t sysclk_get_cpu_hz(void);
+uint32_t pmc_switch_mck_to_mainck(uint32_t ul_pres);
+void pmc_switch_mainck_to_fastrc(uint32_t ul_moscrcf);
+#define pmc_disable_pllack()
+#define pmc_osc_disable_xtal(bypass)
+#define SystemCoreClockUpdate()
+#define system_init_flash(clk)
+#define board_init()
+
+typedef struct
+{
+	uint32_t SYS_GPBR[20];
+} Gpbr;
+
+extern Gpbr sim_gpbr;
+#define GPBR	(&sim_gpbr)
+
+#define WDT		((void *)0)
+#define RSTC	((void *)0)
+#define wdt_init(wdt, mode, counter, delta)	((void)(mode), (void)(counter))
+#define wdt_disable(wdt)
+#define rstc_start_software_reset(rstc)		sim_reset()
+#define rstc_get_reset_cause(rstc)			(0x3u << RSTC_SR_RSTTYP_Pos)	// Software
+#define RSTC_SR_RSTTYP_Pos	8
+
+// USB CDC
+typedef size_t iram_size_t;
+#define stdio_usb_init()
+#define udc_detach()
+bool udi_cdc_is_rx_ready(void);
+int udi_cdc_getc(void);
+int udi_cdc_putc(int value);
+iram_size_t udi_cdc_read_no_polling(void *buf, iram_size_t size);
+iram_size_t udi_cdc_write_buf(const void *buf, iram_size_t size);
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port);
+iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void *buf, iram_size_t size);
+
+// Flash
+#define IFLASH_ADDR			SIM_FLASH_ADDR
+#define IFLASH_SIZE			0x00080000	// The part the BIOS is built for, see flash_get_descriptor()
+#define IFLASH_PAGE_SIZE	SIM_FLASH_PAGE_SIZE
+#define IFLASH_LOCK_REGION_SIZE	8192
+
+#define FLASH_ACCESS_MODE_128	0
+#define FLASH_ACCESS_MODE_64	1
+
+typedef enum flash_rc
+{
+	FLASH_RC_OK = 0,
+	FLASH_RC_YES = 1,
+	FLASH_RC_NO = 0,
+	FLASH_RC_ERROR = 0x10,
+	FLASH_RC_INVALID,
+	FLASH_RC_NOT_SUPPORT = 0xFFFFFFFF
+} flash_rc_t;
+
+enum
+{
+	IFLASH_ERASE_PAGES_4 = 0,
+	IFLASH_ERASE_PAGES_8,
+	IFLASH_ERASE_PAGES_16,
+	IFLASH_ERASE_PAGES_32,
+	IFLASH_ERASE_PAGES_INVALID,
+};
+
+uint32_t flash_init(uint32_t ul_mode, uint32_t ul_fws);
+uint32_t flash_erase_page(uint32_t ul_address, uint8_t uc_page_num);
+uint32_t flash_erase_sector(uint32_t ul_address);
+uint32_t flash_wait_ready(void);
+uint32_t flash_erase_sector_start(uint32_t ul_address);
+uint32_t flash_write_page_start(uint32_t ul_address, const uint32_t *pul_buffer);
+uint32_t flash_program_latch_start(uint32_t ul_address);
+uint32_t flash_write(uint32_t ul_address, const void *p_buffer, uint32_t ul_size, uint32_t ul_erase_flag);
+uint32_t flash_write_aligned(uint32_t ul_address, const uint32_t *pul_buffer, uint32_t ul_size);
+uint32_t flash_lock(uint32_t ul_start, uint32_t ul_end, uint32_t *pul_actual_start, uint32_t *pul_actual_end);
+uint32_t flash_unlock(uint32_t ul_start, uint32_t ul_end, uint32_t *pul_actual_start, uint32_t *pul_actual_end);
+uint32_t flash_read_unique_id(uint32_t *pul_data, uint32_t ul_size);
+uint32_t flash_get_descriptor(uint32_t ul_address, uint32_t *pul_flash_descriptor, uint32_t ul_size);
+uint32_t flash_get_page_count(const uint32_t *pul_flash_descriptor);
+
+static __always_inline void flash_latch_write(uint32_t ul_address, uint32_t ul_data)
+{
+	sim_flash_latch_write(ul_address, ul_data);
+}
+
+#endif /* ASF_H_ */
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * sim.h
+ *
+ * This file contains the host simulator board model definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <setjmp.h>
+
+#define SIM_CPU_HZ			120000000
+#define SIM_FLASH_ADDR		0x00400000
+#ifndef SIM_FLASH_SIZE
+#define SIM_FLASH_SIZE		0x00080000	// SAM4E8, make SIM_FLASH_SIZE=0x100000 for a SAM4E16
+#endif
+#define SIM_FLASH_PAGE_SIZE	512
+
+/*
+*	Flash operation costs in microseconds. Page erase is per EPA command,
+*	whatever the page count. The defaults are typical SAM4E figures.
+*/
+struct sim_flash_timing
+{
+	uint32_t program_us;
+	uint32_t erase_pages_us;
+	uint32_t erase_sector_us;
+};
+
+extern struct sim_flash_timing sim_flash_timing;
+
+// Clock
+void sim_clock_virtual(void);
+void sim_clock_advance(uint64_t ns);
+void sim_clock_cpu(double cycles_per_ns);
+uint64_t sim_time_ns(void);
+void sim_delay_ns(uint64_t ns);
+uint32_t sim_cycles(void);
+void sim_set_cpu_hz(uint32_t hz);
+int sim_model_enter(void);
+void sim_model_leave(int *scope);
+
+/*
+*	First statement of a model function the BIOS calls, so the host CPU
+*	time spent in the model is not charged to the BIOS
+*/
+#define SIM_MODEL_CALL() \
+	int sim_model_scope __attribute__ ((cleanup (sim_model_leave), unused)) = sim_model_enter()
+
+// Flash model
+int sim_flash_open(const char *image);
+int sim_flash_load(const char *file, uint32_t address);
+void sim_flash_reset(void);
+void sim_flash_fill(uint32_t address, const void *data, uint32_t size);
+void sim_flash_latch_write(uint32_t address, uint32_t data);
+uint32_t sim_flash_violations(void);
+
+// CDC endpoint
+int sim_cdc_open_pty(void);
+int sim_cdc_open_stdio(void);
+int sim_cdc_open_trace_pty(void);
+void sim_cdc_flush(void);
+int sim_cdc_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+// Reset and hand-off
+extern jmp_buf *sim_firmware_exit;	// Set to return here instead of exiting
+void sim_snapshot(void);
+void sim_restore(void);
+void sim_reset(void) __attribute__ ((noreturn));
+void sim_firmware_start(uint32_t msp) __attribute__ ((noreturn));
+
+#endif /* SIM_H_ */
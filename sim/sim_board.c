@@ -0,0 +1,354 @@
+/**
+ * @file
+ * sim_board.c
+ *
+ * This file contains the host simulator clock, core registers and reset
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <setjmp.h>
+#include <time.h>
+#include "conf_bios.h"
+#include "sim.h"
+#include "boot.h"
+#include "handoff.h"
+
+// Global variables
+CoreDebug_Type sim_core_debug;
+ITM_Type sim_itm;
+SCB_Type sim_scb = { SIM_FLASH_ADDR };
+NVIC_Type sim_nvic;
+Pmc sim_pmc = { PMC_MCKR_CSS_MAIN_CLK };
+Gpbr sim_gpbr;		// Backup domain, kept over a reset
+jmp_buf sim_reset_point;
+jmp_buf *sim_firmware_exit;
+extern struct boot_handoff boot_handoff;
+
+// Section bounds from the linker, see the Makefile
+extern char __data_start[], _end[];
+extern char __start_sim_noinit[] __attribute__ ((weak));
+extern char __stop_sim_noinit[] __attribute__ ((weak));
+
+/*
+*	Clock state. It keeps running across a soft reset, so sim_restore()
+*	carries it over the RAM restore.
+*/
+struct sim_clock
+{
+	uint64_t real_start_ns;		// Monotonic time the simulator started
+	int virtual;
+	uint64_t virtual_ns;
+	double cpu_cycles_per_ns;	// Host CPU time charge, 0 when off
+	uint64_t cpu_charged_ns;	// Thread CPU time already charged
+	uint64_t cpu_overhead_ns;	// Cost of reading the thread CPU time
+	int model_depth;			// Nesting of model calls, not charged
+	uint32_t cpu_hz;
+	uint64_t hz_since_ns;		// Time of the last clock switch
+	uint32_t hz_since_cycles;	// Cycle count at the last clock switch
+	DWT_Type dwt;
+	uint32_t cyccnt_offset;		// Written CYCCNT minus the cycle count
+	uint32_t cyccnt_last;		// CYCCNT as last handed out
+};
+
+// Local Variables
+static struct sim_clock board_clock = { .cpu_hz = CHIP_FREQ_MAINCK_RC_4MHZ };
+static char *ram_snapshot;
+
+// Internal Functions
+static uint64_t thread_cpu_ns(void);
+
+/*
+*	Run on a virtual clock that only moves through sim_clock_advance()
+*	and delays, so benchmark runs are repeatable
+*/
+void sim_clock_virtual(void)
+{
+	board_clock.virtual = 1;
+}
+
+void sim_clock_advance(uint64_t ns)
+{
+	board_clock.virtual_ns += ns;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+*	Also move the virtual clock by the host CPU time the BIOS uses
+*	outside model calls, as target cycles at cycles_per_ns per host
+*	nanosecond, so CPU bound phases such as verification show up.
+*	0 turns it off.
+*/
+void sim_clock_cpu(double cycles_per_ns)
+{
+	uint64_t overhead = UINT64_MAX;
+	
+	for (int i = 0; i < 100; i++)
+	{
+		uint64_t start = thread_cpu_ns();
+		uint64_t end = thread_cpu_ns();
+		
+		if (end - start < overhead) overhead = end - start;
+	}
+	board_clock.cpu_overhead_ns = overhead;
+	board_clock.cpu_cycles_per_ns = cycles_per_ns;
+	board_clock.cpu_charged_ns = thread_cpu_ns();
+	board_clock.model_depth = 0;
+}
+
+/*
+*	Charge the BIOS for its CPU time up to a model call, and restart the
+*	count when the outermost model call returns
+*/
+int sim_model_enter(void)
+{
+	struct sim_clock *c = &board_clock;
+	uint64_t now;
+	
+	if (c->model_depth++ == 0 && c->virtual && c->cpu_cycles_per_ns > 0)
+	{
+		now = thread_cpu_ns();
+		if (now - c->cpu_charged_ns > c->cpu_overhead_ns)
+		{
+			c->virtual_ns += (uint64_t)((now - c->cpu_charged_ns - c->cpu_overhead_ns)
+			* c->cpu_cycles_per_ns * 1000000000.0 / c->cpu_hz);
+		}
+	}
+	return 0;
+}
+
+void sim_model_leave(int *scope)
+{
+	struct sim_clock *c = &board_clock;
+	
+	if (--c->model_depth == 0 && c->cpu_cycles_per_ns > 0)
+	{
+		c->cpu_charged_ns = thread_cpu_ns();
+	}
+}
+
+/*
+*	Nanoseconds since the simulator started
+*
+*/
+uint64_t sim_time_ns(void)
+{
+	struct timespec ts;
+	uint64_t now;
+	
+	if (board_clock.virtual)
+	{
+		return board_clock.virtual_ns;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	if (board_clock.real_start_ns == 0) board_clock.real_start_ns = now - 1;
+	return now - board_clock.real_start_ns;
+}
+
+void sim_delay_ns(uint64_t ns)
+{
+	uint64_t end = sim_time_ns() + ns;
+	struct timespec ts;
+	uint64_t now;
+	
+	if (board_clock.virtual)
+	{
+		board_clock.virtual_ns += ns;
+		return;
+	}
+	while ((now = sim_time_ns()) < end)
+	{
+		ts.tv_sec = (end - now) / 1000000000;
+		ts.tv_nsec = (end - now) % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+/*
+*	Core clock cycles, counted at whatever clock the core was running
+*
+*/
+uint32_t sim_cycles(void)
+{
+	uint64_t now = sim_time_ns();
+	
+	return board_clock.hz_since_cycles
+	+ (uint32_t)((now - board_clock.hz_since_ns) * (board_clock.cpu_hz / 1000000) / 1000);
+}
+
+void sim_set_cpu_hz(uint32_t hz)
+{
+	board_clock.hz_since_cycles = sim_cycles();
+	board_clock.hz_since_ns = sim_time_ns();
+	board_clock.cpu_hz = hz;
+}
+
+/*
+*	The BIOS writes CYCCNT through the pointer returned here, so a write
+*	shows up as a changed value on the next access
+*/
+DWT_Type *sim_dwt(void)
+{
+	SIM_MODEL_CALL();
+	struct sim_clock *c = &board_clock;
+	
+	if (c->dwt.CYCCNT != c->cyccnt_last)
+	{
+		c->cyccnt_offset += c->dwt.CYCCNT - c->cyccnt_last;
+	}
+	c->dwt.CYCCNT = c->cyccnt_last = sim_cycles() + c->cyccnt_offset;
+	return &c->dwt;
+}
+
+void sysclk_init(void)
+{
+	SIM_MODEL_CALL();
+	sim_set_cpu_hz(CHIP_FREQ_CPU_MAX);
+	sim_pmc.PMC_MCKR = PMC_MCKR_CSS_PLLA_CLK;
+}
+
+uint32_t sysclk_get_cpu_hz(void)
+{
+	return CHIP_FREQ_CPU_MAX;
+}
+
+uint32_t pmc_switch_mck_to_mainck(uint32_t ul_pres)
+{
+	SIM_MODEL_CALL();
+	
+	sim_set_cpu_hz(BOARD_FREQ_MAINCK_XTAL);
+	sim_pmc.PMC_MCKR = PMC_MCKR_CSS_MAIN_CLK;
+	return 0;
+}
+
+void pmc_switch_mainck_to_fastrc(uint32_t ul_moscrcf)
+{
+	SIM_MODEL_CALL();
+	
+	if ((sim_pmc.PMC_MCKR & PMC_MCKR_CSS_Msk) == PMC_MCKR_CSS_MAIN_CLK)
+	{
+		sim_set_cpu_hz(CHIP_FREQ_MAINCK_RC_4MHZ);
+	}
+}
+
+/*
+*	Take the power-on copy of RAM used by sim_reset()
+*
+*	Called once, after sim_reset_point has been set.
+*/
+void sim_snapshot(void)
+{
+	ram_snapshot = malloc(_end - __data_start);
+	memcpy(ram_snapshot, __data_start, _end - __data_start);
+}
+
+/*
+*	Restore .data and .bss to their power-on contents, keeping the flash,
+*	the clock, GPBR, the reset point and anything in sim_noinit (the BIOS
+*	.noinit section).
+*	The core is back on the RC oscillator.
+*/
+void sim_restore(void)
+{
+	char *keep_start = __start_sim_noinit;
+	char *keep_end = __stop_sim_noinit;
+	char *snapshot = ram_snapshot;
+	struct sim_clock running;
+	Gpbr backup;
+	jmp_buf reset_point;
+	
+	flash_wait_ready();
+	running = board_clock;
+	backup = sim_gpbr;
+	memcpy(reset_point, sim_reset_point, sizeof(jmp_buf));
+	if (keep_start == NULL)
+	{
+		keep_start = keep_end = _end;
+	}
+	memcpy(__data_start, snapshot, keep_start - __data_start);
+	memcpy(keep_end, snapshot + (keep_end - __data_start), _end - keep_end);
+	// The copies overwrote these behind the compiler's back
+	__asm__ volatile ("" ::: "memory");
+	board_clock = running;
+	sim_gpbr = backup;
+	memcpy(sim_reset_point, reset_point, sizeof(jmp_buf));
+	sim_set_cpu_hz(CHIP_FREQ_MAINCK_RC_4MHZ);
+}
+
+/*
+*	Soft reset: restore RAM and start the BIOS again from main()
+*
+*/
+void sim_reset(void)
+{
+	fprintf(stderr, "sim: soft reset\n");
+	sim_restore();
+	longjmp(sim_reset_point, 1);
+}
+
+/*
+*	The BIOS has handed over to the application at SCB->VTOR
+*
+*/
+void sim_firmware_start(uint32_t msp)
+{
+	uint32_t violations = sim_flash_violations();
+	
+	if (sim_firmware_exit != NULL)
+	{
+		longjmp(*sim_firmware_exit, 1);
+	}
+	fprintf(stderr, "sim: starting firmware at %08x, MSP %08x, reset vector %08x\n",
+	SCB->VTOR, msp, *(uint32_t *)(uintptr_t)(SCB->VTOR + 4));
+	if (boot_handoff.magic == HANDOFF_MAGIC)
+	{
+		fprintf(stderr, "sim: handoff v%u path %u flags %x image %u bytes sum %08x, jump at %u us\n",
+		boot_handoff.version, boot_handoff.boot_path, boot_handoff.flags,
+		boot_handoff.image_length, boot_handoff.image_checksum,
+		boot_handoff.boot_us[BOOT_JUMP]);
+	}
+	for (int i = 0; i < 20; i++)
+	{
+		if (GPBR->SYS_GPBR[i] != 0)
+		{
+			fprintf(stderr, "sim: GPBR %d=%08x\n", i, GPBR->SYS_GPBR[i]);
+		}
+	}
+	if (violations)
+	{
+		fprintf(stderr, "sim: %u flash violations\n", violations);
+	}
+	sim_cdc_flush();
+	exit(violations ? 2 : 0);
+}
@@ -0,0 +1,323 @@
+/**
+ * @file
+ * sim_cdc.c
+ *
+ * This file contains the host simulator USB CDC endpoint
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define CDC_RX_LEN		4096
+#define CDC_IDLE_POLLS	1024	// Empty polls before blocking for 1ms
+#define CDC_TX_WAIT_MS	100		// Output is dropped if the host stops reading
+#define CDC_EP_SIZE		64		// Bulk endpoint size, the most the trace port takes at once
+
+// Local Variables
+static int cdc_in = -1;
+static int cdc_out = -1;
+static int cdc_slave = -1;
+static int cdc_trace = -1;
+static uint8_t rx_buf[CDC_RX_LEN];
+static size_t rx_head;
+static size_t rx_tail;
+static uint32_t idle_polls;
+static struct termios saved_tty;
+
+// Internal Functions
+static void cdc_fill(int timeout_ms);
+static void cdc_restore_tty(void);
+
+/*
+*	Expose the endpoint as a pseudo terminal for host tools to open
+*
+*/
+int sim_cdc_open_pty(void)
+{
+	struct termios tty;
+	
+	cdc_in = posix_openpt(O_RDWR | O_NOCTTY);
+	if (cdc_in < 0 || grantpt(cdc_in) != 0 || unlockpt(cdc_in) != 0)
+	{
+		return 0;
+	}
+	
+	// Hold the slave open so the master does not see a hang up between
+	// host sessions, and make it a raw line like the CDC ACM driver
+	cdc_slave = open(ptsname(cdc_in), O_RDWR | O_NOCTTY);
+	if (cdc_slave < 0 || tcgetattr(cdc_slave, &tty) != 0)
+	{
+		return 0;
+	}
+	cfmakeraw(&tty);
+	tcsetattr(cdc_slave, TCSANOW, &tty);
+	
+	fcntl(cdc_in, F_SETFL, fcntl(cdc_in, F_GETFL) | O_NONBLOCK);
+	cdc_out = cdc_in;
+	fprintf(stderr, "sim: USB CDC on %s\n", ptsname(cdc_in));
+	return 1;
+}
+
+/*
+*	Use stdin and stdout as the endpoint, for interactive use and pipes
+*
+*/
+int sim_cdc_open_stdio(void)
+{
+	struct termios tty;
+	
+	cdc_in = STDIN_FILENO;
+	cdc_out = STDOUT_FILENO;
+	if (isatty(cdc_in) && tcgetattr(cdc_in, &saved_tty) == 0)
+	{
+		tty = saved_tty;
+		cfmakeraw(&tty);
+		tty.c_lflag |= ISIG;	// Keep Ctrl-C
+		tcsetattr(cdc_in, TCSANOW, &tty);
+		atexit(cdc_restore_tty);
+	}
+	return 1;
+}
+
+/*
+*	Expose the trace port (CDC port 1) as a second pseudo terminal
+*
+*	The slave is not held open here, so the master sees a hang up while
+*	no host has the port open, which stands in for DTR.
+*/
+int sim_cdc_open_trace_pty(void)
+{
+	struct termios tty;
+	
+	cdc_trace = posix_openpt(O_RDWR | O_NOCTTY);
+	if (cdc_trace < 0 || grantpt(cdc_trace) != 0 || unlockpt(cdc_trace) != 0
+		|| tcgetattr(cdc_trace, &tty) != 0)
+	{
+		return 0;
+	}
+	cfmakeraw(&tty);
+	tcsetattr(cdc_trace, TCSANOW, &tty);
+	fcntl(cdc_trace, F_SETFL, fcntl(cdc_trace, F_GETFL) | O_NONBLOCK);
+	fprintf(stderr, "sim: USB CDC trace port on %s\n", ptsname(cdc_trace));
+	return 1;
+}
+
+/*
+*	Give the host up to a second to read what is still queued, since
+*	closing the pty master discards it
+*/
+void sim_cdc_flush(void)
+{
+	int pending = 0;
+	
+	for (int i = 0; i < 100 && cdc_slave >= 0; i++)
+	{
+		if (ioctl(cdc_slave, FIONREAD, &pending) != 0 || pending == 0) break;
+		sim_delay_ns(10000000);
+	}
+}
+
+static void cdc_restore_tty(void)
+{
+	tcsetattr(cdc_in, TCSANOW, &saved_tty);
+}
+
+/*
+*	Move whatever the host has sent into the receive buffer
+*
+*/
+static void cdc_fill(int timeout_ms)
+{
+	struct pollfd pfd = { cdc_in, POLLIN, 0 };
+	ssize_t len;
+	
+	if (rx_head == rx_tail)
+	{
+		rx_head = rx_tail = 0;
+	}
+	if (rx_tail == CDC_RX_LEN || poll(&pfd, 1, timeout_ms) <= 0)
+	{
+		return;
+	}
+	
+	len = read(cdc_in, rx_buf + rx_tail, CDC_RX_LEN - rx_tail);
+	if (len > 0)
+	{
+		rx_tail += len;
+	}
+	else if (len == 0 && cdc_in == STDIN_FILENO)
+	{
+		exit(sim_flash_violations() ? 2 : 0);	// End of scripted input
+	}
+	else if (timeout_ms != 0)
+	{
+		sim_delay_ns((uint64_t)(timeout_ms > 0 ? timeout_ms : 10) * 1000000);
+	}
+}
+
+/*
+*	Non-blocking check for received data
+*
+*	The BIOS polls this in tight loops and counts polls for its timeouts,
+*	so runs of empty polls are paced to keep those near target timing.
+*/
+bool udi_cdc_is_rx_ready(void)
+{
+	if (rx_head != rx_tail)
+	{
+		return true;
+	}
+	
+	cdc_fill(++idle_polls % CDC_IDLE_POLLS ? 0 : 1);
+	if (rx_head != rx_tail)
+	{
+		idle_polls = 0;
+		return true;
+	}
+	return false;
+}
+
+int udi_cdc_getc(void)
+{
+	while (rx_head == rx_tail)
+	{
+		cdc_fill(-1);
+	}
+	idle_polls = 0;
+	return rx_buf[rx_head++];
+}
+
+iram_size_t udi_cdc_read_no_polling(void *buf, iram_size_t size)
+{
+	size_t len;
+	
+	if (rx_head == rx_tail)
+	{
+		cdc_fill(0);
+	}
+	len = rx_tail - rx_head;
+	if (len > size) len = size;
+	memcpy(buf, rx_buf + rx_head, len);
+	rx_head += len;
+	return len;
+}
+
+iram_size_t udi_cdc_write_buf(const void *buf, iram_size_t size)
+{
+	const uint8_t *data = buf;
+	size_t left = size;
+	
+	while (left > 0)
+	{
+		ssize_t len = write(cdc_out, data, left);
+		
+		if (len > 0)
+		{
+			data += len;
+			left -= len;
+		}
+		else if (len < 0 && errno == EAGAIN)
+		{
+			struct pollfd pfd = { cdc_out, POLLOUT, 0 };
+			
+			if (poll(&pfd, 1, CDC_TX_WAIT_MS) <= 0)
+			{
+				break;	// Nobody is reading, drop like a closed port
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+	return left;
+}
+
+int udi_cdc_putc(int value)
+{
+	uint8_t ch = value;
+	
+	udi_cdc_write_buf(&ch, 1);
+	return 1;
+}
+
+/*
+*	Free space for the trace port, none while no host has it open
+*
+*/
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port)
+{
+	struct pollfd pfd = { cdc_trace, POLLOUT, 0 };
+	
+	if (port == 0)
+	{
+		return CDC_EP_SIZE;
+	}
+	if (cdc_trace < 0 || poll(&pfd, 1, 0) <= 0 || (pfd.revents & POLLHUP))
+	{
+		return 0;
+	}
+	return (pfd.revents & POLLOUT) ? CDC_EP_SIZE : 0;
+}
+
+iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void *buf, iram_size_t size)
+{
+	ssize_t len;
+	
+	if (port == 0)
+	{
+		return udi_cdc_write_buf(buf, size);
+	}
+	len = cdc_trace < 0 ? -1 : write(cdc_trace, buf, size);
+	return len > 0 ? size - len : size;
+}
+
+int sim_cdc_printf(const char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+	int len;
+	
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len > (int)sizeof(buf) - 1)
+	{
+		len = sizeof(buf) - 1;
+	}
+	if (len > 0)
+	{
+		udi_cdc_write_buf(buf, len);
+	}
+	return len;
+}
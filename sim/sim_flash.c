@@ -0,0 +1,523 @@
+/**
+ * @file
+ * sim_flash.c
+ *
+ * This file contains the host simulator flash model
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define SIM_LATCH_WORDS		(SIM_FLASH_PAGE_SIZE / sizeof(uint32_t))
+#define SIM_BLOCK_WORDS		4	// 128 bits, the partial programming unit
+#define SIM_SECTOR_SIZE		0x10000
+#define SIM_LOCK_REGIONS	(SIM_FLASH_SIZE / IFLASH_LOCK_REGION_SIZE)
+
+// Global variables
+struct sim_flash_timing sim_flash_timing = { 1500, 10000, 200000 };
+
+// Local Variables
+static uint8_t * const flash = (uint8_t *)SIM_FLASH_ADDR;
+static uint32_t latch[SIM_LATCH_WORDS];
+static uint64_t busy_until;
+static uint32_t op_error;
+static uint8_t locked[SIM_LOCK_REGIONS];
+// Kept over a simulated soft reset, like the rest of sim_noinit
+static uint32_t violations __attribute__ ((section ("sim_noinit")));
+
+// Internal Functions
+static void violation(const char *fmt, uint32_t address);
+static int flash_busy(void);
+static void flash_writable(int writable);
+static uint32_t flash_start(uint32_t address, uint32_t size, uint32_t cost_us);
+static void latch_reset(void);
+static int latch_block_erased(int i);
+static uint32_t flash_set_lock(uint32_t ul_start, uint32_t ul_end, uint8_t value);
+
+/*
+*	Report a use of the flash the EFC would not accept
+*
+*/
+static void violation(const char *fmt, uint32_t address)
+{
+	violations++;
+	fprintf(stderr, "sim: flash: ");
+	fprintf(stderr, fmt, address);
+	fprintf(stderr, "\n");
+}
+
+uint32_t sim_flash_violations(void)
+{
+	return violations;
+}
+
+static int flash_busy(void)
+{
+	return sim_time_ns() < busy_until;
+}
+
+/*
+*	The array is mapped read only, so a store to flash that bypasses the
+*	latch faults instead of silently changing the image
+*
+*/
+static void flash_writable(int writable)
+{
+	mprotect(flash, SIM_FLASH_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ);
+}
+
+static void latch_reset(void)
+{
+	memset(latch, 0xFF, sizeof(latch));
+}
+
+/*
+*	Whether the 128-bit block holding latch word i is all ones
+*
+*/
+static int latch_block_erased(int i)
+{
+	uint32_t *block = &latch[i & ~(SIM_BLOCK_WORDS - 1)];
+	
+	return (block[0] & block[1] & block[2] & block[3]) == 0xFFFFFFFF;
+}
+
+/*
+*	Start a flash command over [address, address + size)
+*
+*	The array changes straight away; the EFC then stays busy for the cost
+*	of the operation, until flash_wait_ready() has been called.
+*/
+static uint32_t flash_start(uint32_t address, uint32_t size, uint32_t cost_us)
+{
+	if (flash_busy())
+	{
+		violation("command started while busy at %08x", address);
+	}
+	
+	op_error = 0;
+	for (uint32_t a = address; a < address + size; a += IFLASH_LOCK_REGION_SIZE)
+	{
+		if (locked[(a - SIM_FLASH_ADDR) / IFLASH_LOCK_REGION_SIZE])
+		{
+			violation("command on locked region at %08x", a);
+			op_error = FLASH_RC_ERROR;
+			return op_error;
+		}
+	}
+	
+	busy_until = sim_time_ns() + (uint64_t)cost_us * 1000;
+	return FLASH_RC_OK;
+}
+
+/*
+*	Map the flash array at its address on the target
+*
+*	@param image - backing file, kept between runs; NULL for a blank part
+*/
+int sim_flash_open(const char *image)
+{
+	void *map;
+	int fd = -1;
+	
+	latch_reset();
+	if (image == NULL)
+	{
+		map = mmap(flash, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (map != flash) return 0;
+		memset(flash, 0xFF, SIM_FLASH_SIZE);
+		flash_writable(0);
+		return 1;
+	}
+	
+	fd = open(image, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return 0;
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return 0;
+	}
+	if (st.st_size < SIM_FLASH_SIZE)
+	{
+		// Extend a new or short image with erased flash
+		uint8_t erased[SIM_FLASH_PAGE_SIZE];
+		
+		memset(erased, 0xFF, sizeof(erased));
+		lseek(fd, st.st_size, SEEK_SET);
+		for (off_t pos = st.st_size; pos < SIM_FLASH_SIZE; pos += sizeof(erased))
+		{
+			if (write(fd, erased, sizeof(erased)) != sizeof(erased))
+			{
+				close(fd);
+				return 0;
+			}
+		}
+	}
+	
+	map = mmap(flash, SIM_FLASH_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	close(fd);
+	return map == flash;
+}
+
+/*
+*	Return the part to erased and idle, as between benchmark runs
+*
+*/
+void sim_flash_reset(void)
+{
+	flash_writable(1);
+	memset(flash, 0xFF, SIM_FLASH_SIZE);
+	flash_writable(0);
+	latch_reset();
+	memset(locked, 0, sizeof(locked));
+	busy_until = 0;
+	op_error = 0;
+}
+
+/*
+*	Write bytes straight into the array, as a programmer would
+*
+*/
+void sim_flash_fill(uint32_t address, const void *data, uint32_t size)
+{
+	flash_writable(1);
+	memcpy(flash + (address - SIM_FLASH_ADDR), data, size);
+	flash_writable(0);
+}
+
+/*
+*	Copy a raw binary into flash, as a programmer would
+*
+*/
+int sim_flash_load(const char *file, uint32_t address)
+{
+	FILE *f = fopen(file, "rb");
+	size_t len;
+	
+	if (f == NULL || address < SIM_FLASH_ADDR || address >= SIM_FLASH_ADDR + SIM_FLASH_SIZE)
+	{
+		if (f != NULL) fclose(f);
+		return 0;
+	}
+	
+	flash_writable(1);
+	len = fread(flash + (address - SIM_FLASH_ADDR), 1, SIM_FLASH_ADDR + SIM_FLASH_SIZE - address, f);
+	flash_writable(0);
+	fclose(f);
+	return len > 0;
+}
+
+/*
+*	Store a word in the latch
+*
+*/
+void sim_flash_latch_write(uint32_t address, uint32_t data)
+{
+	SIM_MODEL_CALL();
+	if (address < SIM_FLASH_ADDR || address >= SIM_FLASH_ADDR + SIM_FLASH_SIZE || (address & 3))
+	{
+		violation("latch write outside flash at %08x", address);
+		return;
+	}
+	if (flash_busy())
+	{
+		violation("latch write while busy at %08x", address);
+	}
+	latch[(address % SIM_FLASH_PAGE_SIZE) / sizeof(uint32_t)] = data;
+}
+
+/*
+*	Program the latch into a page
+*
+*	Programming can only clear bits; a page that needed erasing first is
+*	reported, and ends up with the AND of old and new data as on the part.
+*	A 128-bit block left erased in the latch is not programmed, so a page
+*	can be written in several passes as the EEFC's partial programming
+*	allows.
+*/
+uint32_t flash_program_latch_start(uint32_t ul_address)
+{
+	SIM_MODEL_CALL();
+	uint32_t *page = (uint32_t *)(uintptr_t)ul_address;
+	int reported = 0;
+	
+	if (ul_address % SIM_FLASH_PAGE_SIZE)
+	{
+		return FLASH_RC_INVALID;
+	}
+	if (flash_start(ul_address, SIM_FLASH_PAGE_SIZE, sim_flash_timing.program_us) != FLASH_RC_OK)
+	{
+		latch_reset();
+		return FLASH_RC_OK;
+	}
+	
+	flash_writable(1);
+	for (int i = 0; i < SIM_LATCH_WORDS; i++)
+	{
+		if (latch_block_erased(i))
+		{
+			continue;
+		}
+		if ((page[i] & latch[i]) != latch[i] && !reported)
+		{
+			violation("page at %08x programmed without an erase", ul_address);
+			reported = 1;
+		}
+		page[i] &= latch[i];
+	}
+	flash_writable(0);
+	latch_reset();
+	return FLASH_RC_OK;
+}
+
+uint32_t flash_write_page_start(uint32_t ul_address, const uint32_t *pul_buffer)
+{
+	SIM_MODEL_CALL();
+	for (int i = 0; i < SIM_LATCH_WORDS; i++)
+	{
+		sim_flash_latch_write(ul_address + i * sizeof(uint32_t), pul_buffer[i]);
+	}
+	return flash_program_latch_start(ul_address);
+}
+
+/*
+*	Erase the sector holding an address
+*
+*	Sector 0 is split into 8KB, 8KB and 48KB small sectors.
+*/
+uint32_t flash_erase_sector_start(uint32_t ul_address)
+{
+	SIM_MODEL_CALL();
+	uint32_t offset = ul_address - SIM_FLASH_ADDR;
+	uint32_t start, size;
+	
+	if (offset >= SIM_FLASH_SIZE)
+	{
+		return FLASH_RC_INVALID;
+	}
+	if (offset < 0x4000)
+	{
+		start = offset & ~0x1FFF;
+		size = 0x2000;
+	}
+	else if (offset < SIM_SECTOR_SIZE)
+	{
+		start = 0x4000;
+		size = SIM_SECTOR_SIZE - 0x4000;
+	}
+	else
+	{
+		start = offset & ~(SIM_SECTOR_SIZE - 1);
+		size = SIM_SECTOR_SIZE;
+	}
+	
+	if (flash_start(SIM_FLASH_ADDR + start, size, sim_flash_timing.erase_sector_us) == FLASH_RC_OK)
+	{
+		flash_writable(1);
+		memset(flash + start, 0xFF, size);
+		flash_writable(0);
+	}
+	return FLASH_RC_OK;
+}
+
+uint32_t flash_wait_ready(void)
+{
+	SIM_MODEL_CALL();
+	uint64_t now = sim_time_ns();
+	
+	if (now < busy_until)
+	{
+		sim_delay_ns(busy_until - now);
+	}
+	return op_error ? FLASH_RC_ERROR : FLASH_RC_OK;
+}
+
+uint32_t flash_erase_sector(uint32_t ul_address)
+{
+	SIM_MODEL_CALL();
+	flash_erase_sector_start(ul_address);
+	return flash_wait_ready();
+}
+
+uint32_t flash_erase_page(uint32_t ul_address, uint8_t uc_page_num)
+{
+	SIM_MODEL_CALL();
+	uint32_t size;
+	
+	if (uc_page_num >= IFLASH_ERASE_PAGES_INVALID)
+	{
+		return FLASH_RC_INVALID;
+	}
+	size = (4 << uc_page_num) * SIM_FLASH_PAGE_SIZE;
+	if (ul_address < SIM_FLASH_ADDR || ul_address >= SIM_FLASH_ADDR + SIM_FLASH_SIZE
+		|| (ul_address - SIM_FLASH_ADDR) % size)
+	{
+		return FLASH_RC_INVALID;
+	}
+	
+	if (flash_start(ul_address, size, sim_flash_timing.erase_pages_us) == FLASH_RC_OK)
+	{
+		flash_writable(1);
+		memset(flash + (ul_address - SIM_FLASH_ADDR), 0xFF, size);
+		flash_writable(0);
+	}
+	return flash_wait_ready();
+}
+
+uint32_t flash_write_aligned(uint32_t ul_address, const uint32_t *pul_buffer, uint32_t ul_size)
+{
+	SIM_MODEL_CALL();
+	uint32_t rc = FLASH_RC_OK;
+	
+	if ((ul_address % SIM_FLASH_PAGE_SIZE) || (ul_size % SIM_FLASH_PAGE_SIZE))
+	{
+		return FLASH_RC_INVALID;
+	}
+	
+	while (ul_size > 0 && rc == FLASH_RC_OK)
+	{
+		flash_write_page_start(ul_address, pul_buffer);
+		rc = flash_wait_ready();
+		ul_address += SIM_FLASH_PAGE_SIZE;
+		pul_buffer += SIM_LATCH_WORDS;
+		ul_size -= SIM_FLASH_PAGE_SIZE;
+	}
+	return rc;
+}
+
+/*
+*	Unaligned write, merging the data into the current page contents
+*
+*/
+uint32_t flash_write(uint32_t ul_address, const void *p_buffer, uint32_t ul_size, uint32_t ul_erase_flag)
+{
+	SIM_MODEL_CALL();
+	const uint8_t *data = p_buffer;
+	uint32_t page_buf[SIM_LATCH_WORDS];
+	uint32_t rc = FLASH_RC_OK;
+	
+	UNUSED(ul_erase_flag);
+	while (ul_size > 0 && rc == FLASH_RC_OK)
+	{
+		uint32_t page = ul_address & ~(SIM_FLASH_PAGE_SIZE - 1);
+		uint32_t offset = ul_address - page;
+		uint32_t len = SIM_FLASH_PAGE_SIZE - offset;
+		
+		if (len > ul_size) len = ul_size;
+		memset(page_buf, 0xFF, sizeof(page_buf));
+		memcpy((uint8_t *)page_buf + offset, data, len);
+		flash_write_page_start(page, page_buf);
+		rc = flash_wait_ready();
+		ul_address += len;
+		data += len;
+		ul_size -= len;
+	}
+	return rc;
+}
+
+uint32_t flash_init(uint32_t ul_mode, uint32_t ul_fws)
+{
+	SIM_MODEL_CALL();
+	UNUSED(ul_mode);
+	UNUSED(ul_fws);
+	return FLASH_RC_OK;
+}
+
+static uint32_t flash_set_lock(uint32_t ul_start, uint32_t ul_end, uint8_t value)
+{
+	if (ul_start < SIM_FLASH_ADDR || ul_end > SIM_FLASH_ADDR + SIM_FLASH_SIZE || ul_start > ul_end)
+	{
+		return FLASH_RC_INVALID;
+	}
+	for (uint32_t a = ul_start & ~(IFLASH_LOCK_REGION_SIZE - 1); a < ul_end; a += IFLASH_LOCK_REGION_SIZE)
+	{
+		locked[(a - SIM_FLASH_ADDR) / IFLASH_LOCK_REGION_SIZE] = value;
+	}
+	return FLASH_RC_OK;
+}
+
+uint32_t flash_lock(uint32_t ul_start, uint32_t ul_end, uint32_t *pul_actual_start, uint32_t *pul_actual_end)
+{
+	SIM_MODEL_CALL();
+	UNUSED(pul_actual_start);
+	UNUSED(pul_actual_end);
+	return flash_set_lock(ul_start, ul_end, 1);
+}
+
+uint32_t flash_unlock(uint32_t ul_start, uint32_t ul_end, uint32_t *pul_actual_start, uint32_t *pul_actual_end)
+{
+	SIM_MODEL_CALL();
+	UNUSED(pul_actual_start);
+	UNUSED(pul_actual_end);
+	return flash_set_lock(ul_start, ul_end, 0);
+}
+
+uint32_t flash_read_unique_id(uint32_t *pul_data, uint32_t ul_size)
+{
+	SIM_MODEL_CALL();
+	for (uint32_t i = 0; i < ul_size; i++)
+	{
+		pul_data[i] = 0x53494D30 + i;	// "SIM0", "SIM1", ...
+	}
+	return FLASH_RC_OK;
+}
+
+/*
+*	The descriptor of a single plane part with SIM_FLASH_SIZE bytes
+*
+*/
+uint32_t flash_get_descriptor(uint32_t ul_address, uint32_t *pul_flash_descriptor, uint32_t ul_size)
+{
+	const uint32_t descriptor[] =
+	{
+		0x00000010, SIM_FLASH_SIZE, SIM_FLASH_PAGE_SIZE, 1, SIM_FLASH_SIZE,
+		SIM_LOCK_REGIONS, IFLASH_LOCK_REGION_SIZE
+	};
+	uint32_t count = 0;
+	
+	SIM_MODEL_CALL();
+	UNUSED(ul_address);
+	while (count < ul_size && count < sizeof(descriptor) / sizeof(descriptor[0]))
+	{
+		pul_flash_descriptor[count] = descriptor[count];
+		count++;
+	}
+	return count;
+}
+
+uint32_t flash_get_page_count(const uint32_t *pul_flash_descriptor)
+{
+	return pul_flash_descriptor[1] / pul_flash_descriptor[2];
+}
@@ -0,0 +1,419 @@
+/**
+ * @file
+ * sim_link.c
+ *
+ * This file contains the simulated USB CDC link and XMODEM host
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include "sim.h"
+#include "sim_link.h"
+
+#define LINK_QUEUE_LEN	8192
+#define XMODEM_SOH		0x01
+#define XMODEM_EOT		0x04
+#define XMODEM_ACK		0x06
+#define XMODEM_NAK		0x15
+#define XMODEM_BLOCK	128
+
+enum host_state
+{
+	HOST_WAIT_START,
+	HOST_WAIT_ACK,
+	HOST_WAIT_EOT_ACK,
+	HOST_DONE,
+	HOST_GAVE_UP
+};
+
+struct link_byte
+{
+	uint64_t time;		// When the byte reaches the other end
+	uint8_t value;
+};
+
+struct link_queue
+{
+	struct link_byte bytes[LINK_QUEUE_LEN];
+	uint32_t head;
+	uint32_t tail;
+};
+
+// Local Variables
+static struct sim_link_config cfg;
+static struct sim_link_result result;
+static struct link_queue to_device;
+static struct link_queue to_host;
+static const uint8_t *image;
+static uint32_t image_blocks;
+static uint32_t image_len;
+static enum host_state state;
+static uint32_t block;			// Block the host is sending, from 0
+static uint32_t block_retries;
+static uint64_t host_deadline;	// Host timeout, 0 when not waiting
+static uint64_t link_free;		// Host to device link busy until
+static uint64_t run_deadline;
+static jmp_buf *run_abort;
+static uint32_t rng;
+
+// Internal Functions
+static uint32_t link_random(void);
+static int link_chance(uint32_t ppm);
+static void queue_put(struct link_queue *q, uint64_t time, uint8_t value);
+static int queue_ready(struct link_queue *q, uint64_t now);
+static void host_send(uint64_t time, const uint8_t *data, uint32_t len);
+static void host_send_block(uint64_t time);
+static void host_retry(uint64_t time);
+static void host_receive(uint64_t time, uint8_t value);
+static void link_update(void);
+
+/*
+*	xorshift32, so fault patterns repeat for a given seed
+*
+*/
+static uint32_t link_random(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static int link_chance(uint32_t ppm)
+{
+	return ppm && (link_random() % 1000000) < ppm;
+}
+
+static void queue_put(struct link_queue *q, uint64_t time, uint8_t value)
+{
+	if (q->tail - q->head == LINK_QUEUE_LEN)
+	{
+		return;		// Overrun, the byte is lost
+	}
+	q->bytes[q->tail % LINK_QUEUE_LEN].time = time;
+	q->bytes[q->tail % LINK_QUEUE_LEN].value = value;
+	q->tail++;
+}
+
+static int queue_ready(struct link_queue *q, uint64_t now)
+{
+	return q->head != q->tail && q->bytes[q->head % LINK_QUEUE_LEN].time <= now;
+}
+
+/*
+*	Send host data to the device, packet by packet, with faults applied
+*
+*/
+static void host_send(uint64_t time, const uint8_t *data, uint32_t len)
+{
+	uint64_t t = time > link_free ? time : link_free;
+	
+	for (uint32_t pos = 0; pos < len; pos += cfg.packet_size)
+	{
+		uint32_t n = len - pos < cfg.packet_size ? len - pos : cfg.packet_size;
+		
+		if (link_chance(cfg.stall_ppm))
+		{
+			t += cfg.stall_ns;
+			result.stalled++;
+		}
+		t += cfg.packet_ns;
+		if (link_chance(cfg.drop_ppm))
+		{
+			result.dropped++;
+			continue;
+		}
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint8_t value = data[pos + i];
+			
+			if (link_chance(cfg.corrupt_ppm))
+			{
+				value ^= 1 << (link_random() % 8);
+				result.corrupted++;
+			}
+			queue_put(&to_device, t, value);
+		}
+	}
+	link_free = t;
+	host_deadline = t + cfg.host_timeout_ns;
+}
+
+/*
+*	Frame and send the current block, padded with 0x1A like sx
+*
+*/
+static void host_send_block(uint64_t time)
+{
+	uint8_t frame[XMODEM_BLOCK + 4];
+	uint32_t offset = block * XMODEM_BLOCK;
+	uint8_t sum = 0;
+	
+	frame[0] = XMODEM_SOH;
+	frame[1] = (block + 1) & 0xFF;
+	frame[2] = 0xFF - frame[1];
+	for (int i = 0; i < XMODEM_BLOCK; i++)
+	{
+		frame[3 + i] = offset + i < image_len ? image[offset + i] : 0x1A;
+		sum += frame[3 + i];
+	}
+	frame[XMODEM_BLOCK + 3] = sum;
+	
+	if (result.blocks_sent == 0)
+	{
+		result.first_data_ns = time;
+	}
+	result.blocks_sent++;
+	host_send(time, frame, sizeof(frame));
+}
+
+/*
+*	Send the current block or <EOT> again
+*
+*/
+static void host_retry(uint64_t time)
+{
+	uint8_t eot = XMODEM_EOT;
+	
+	result.retries++;
+	if (++block_retries > cfg.host_retries)
+	{
+		state = HOST_GAVE_UP;
+		result.gave_up = 1;
+		host_deadline = 0;
+		return;
+	}
+	if (state == HOST_WAIT_EOT_ACK)
+	{
+		host_send(time, &eot, 1);
+	}
+	else
+	{
+		host_send_block(time);
+	}
+}
+
+/*
+*	React to a byte from the device, as an XMODEM checksum sender
+*
+*/
+static void host_receive(uint64_t time, uint8_t value)
+{
+	uint64_t reply = time + cfg.turnaround_ns;
+	uint8_t eot = XMODEM_EOT;
+	
+	switch (state)
+	{
+		case HOST_WAIT_START:
+			if (value == XMODEM_NAK)
+			{
+				state = HOST_WAIT_ACK;
+				host_send_block(reply);
+			}
+			break;
+			
+		case HOST_WAIT_ACK:
+			if (value == XMODEM_ACK)
+			{
+				block_retries = 0;
+				if (++block == image_blocks)
+				{
+					state = HOST_WAIT_EOT_ACK;
+					host_send(reply, &eot, 1);
+				}
+				else
+				{
+					host_send_block(reply);
+				}
+			}
+			else if (value == XMODEM_NAK)
+			{
+				host_retry(reply);
+			}
+			break;
+			
+		case HOST_WAIT_EOT_ACK:
+			if (value == XMODEM_ACK)
+			{
+				state = HOST_DONE;
+				result.done_ns = time;
+				host_deadline = 0;
+			}
+			else if (value == XMODEM_NAK)
+			{
+				host_retry(reply);
+			}
+			break;
+			
+		default:
+			break;
+	}
+}
+
+/*
+*	Run the host up to the current time, in time order
+*
+*/
+static void link_update(void)
+{
+	uint64_t now = sim_time_ns();
+	
+	// Nothing more will come once the host has given up
+	if (now > run_deadline || state == HOST_GAVE_UP)
+	{
+		longjmp(*run_abort, 1);
+	}
+	
+	while (1)
+	{
+		uint64_t next = queue_ready(&to_host, now) ? to_host.bytes[to_host.head % LINK_QUEUE_LEN].time : UINT64_MAX;
+		
+		if (host_deadline && host_deadline <= now && host_deadline < next)
+		{
+			result.host_timeouts++;
+			host_retry(host_deadline);
+		}
+		else if (next != UINT64_MAX)
+		{
+			host_receive(next, to_host.bytes[to_host.head % LINK_QUEUE_LEN].value);
+			to_host.head++;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+/*
+*	Start a transfer of an image with a fresh link and host
+*
+*	@param deadline_ns - run time after which 'abort' is taken
+*/
+void sim_link_start(const struct sim_link_config *config, const uint8_t *data,
+uint32_t length, uint64_t deadline_ns, jmp_buf *abort)
+{
+	cfg = *config;
+	memset(&result, 0, sizeof(result));
+	memset(&to_device, 0, sizeof(to_device));
+	memset(&to_host, 0, sizeof(to_host));
+	image = data;
+	image_len = length;
+	image_blocks = (length + XMODEM_BLOCK - 1) / XMODEM_BLOCK;
+	state = HOST_WAIT_START;
+	block = 0;
+	block_retries = 0;
+	host_deadline = 0;
+	link_free = 0;
+	run_deadline = sim_time_ns() + deadline_ns;
+	run_abort = abort;
+	rng = cfg.seed ? cfg.seed : 1;
+}
+
+const struct sim_link_result *sim_link_result(void)
+{
+	return &result;
+}
+
+bool udi_cdc_is_rx_ready(void)
+{
+	sim_clock_advance(cfg.poll_ns);
+	link_update();
+	return queue_ready(&to_device, sim_time_ns());
+}
+
+int udi_cdc_getc(void)
+{
+	while (!udi_cdc_is_rx_ready());
+	sim_clock_advance(cfg.byte_ns);
+	return to_device.bytes[to_device.head++ % LINK_QUEUE_LEN].value;
+}
+
+iram_size_t udi_cdc_read_no_polling(void *buf, iram_size_t size)
+{
+	uint8_t *data = buf;
+	iram_size_t len = 0;
+	
+	while (len < size && udi_cdc_is_rx_ready())
+	{
+		data[len++] = udi_cdc_getc();
+	}
+	return len;
+}
+
+/*
+*	Device to host data leaves at the next start of frame
+*
+*/
+iram_size_t udi_cdc_write_buf(const void *buf, iram_size_t size)
+{
+	const uint8_t *data = buf;
+	uint64_t now = sim_time_ns();
+	uint64_t sof = (now / cfg.sof_ns + 1) * cfg.sof_ns;
+	
+	for (iram_size_t i = 0; i < size; i++)
+	{
+		queue_put(&to_host, sof, data[i]);
+	}
+	link_update();
+	return 0;
+}
+
+int udi_cdc_putc(int value)
+{
+	uint8_t ch = value;
+	
+	udi_cdc_write_buf(&ch, 1);
+	return 1;
+}
+
+/*
+*	The trace port is not part of the link model
+*
+*/
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port)
+{
+	return 0;
+}
+
+iram_size_t udi_cdc_multi_write_buf(uint8_t port, const void *buf, iram_size_t size)
+{
+	return size;
+}
+
+/*
+*	Console output is not part of the link model
+*
+*/
+int sim_cdc_printf(const char *fmt, ...)
+{
+	UNUSED(fmt);
+	return 0;
+}
+
+void sim_cdc_flush(void)
+{
+}
@@ -0,0 +1,82 @@
+/**
+ * @file
+ * sim_link.h
+ *
+ * This file contains the simulated USB CDC link and XMODEM host definitions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#ifndef SIM_LINK_H_
+#define SIM_LINK_H_
+
+#include <setjmp.h>
+#include <stdint.h>
+
+/*
+*	Link and host parameters, times in nanoseconds
+*
+*	Host to device data arrives in packets of packet_size bytes, one per
+*	packet_ns. Device to host data is picked up at the next start of
+*	frame, every sof_ns. The host answers turnaround_ns after a reply
+*	reaches it and resends a block if nothing arrives in host_timeout_ns.
+*	Fault rates are parts per million: corruption per byte, drops and
+*	stalls per packet.
+*/
+struct sim_link_config
+{
+	uint32_t packet_size;
+	uint32_t packet_ns;
+	uint32_t sof_ns;
+	uint32_t turnaround_ns;
+	uint32_t host_timeout_ns;
+	uint32_t host_retries;		// Retries per block before the host gives up
+	uint32_t poll_ns;			// Device cost of an empty receive poll
+	uint32_t byte_ns;			// Device cost of reading one byte
+	uint32_t corrupt_ppm;
+	uint32_t drop_ppm;
+	uint32_t stall_ppm;
+	uint32_t stall_ns;
+	uint32_t seed;
+};
+
+struct sim_link_result
+{
+	uint64_t first_data_ns;		// First block handed to the link
+	uint64_t done_ns;			// Final <ACK> seen by the host, 0 if never
+	uint32_t blocks_sent;		// Including retries
+	uint32_t retries;			// Blocks sent again after a <NAK> or timeout
+	uint32_t host_timeouts;
+	uint32_t corrupted;
+	uint32_t dropped;
+	uint32_t stalled;
+	int gave_up;
+};
+
+void sim_link_start(const struct sim_link_config *config, const uint8_t *image,
+uint32_t length, uint64_t deadline_ns, jmp_buf *abort);
+const struct sim_link_result *sim_link_result(void);
+
+#endif /* SIM_LINK_H_ */
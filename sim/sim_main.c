@@ -0,0 +1,157 @@
+/**
+ * @file
+ * sim_main.c
+ *
+ * This file contains the host simulator entry point
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include "sim.h"
+#include "mailbox.h"
+#include "trace.h"
+
+// Global variables
+extern jmp_buf sim_reset_point;
+
+int bios_main(void);
+void boot_time_reset(void);
+void boot_fast_path(void);
+
+/*
+*	Print the command line usage
+*
+*/
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	"usage: %s [-s] [-f image] [-l file@address] [-T program,erase_pages,erase_sector]\n"
+	"          [-M size,checksum] [-G register=value]\n"
+	"  -s            use stdin/stdout as the USB CDC port instead of a pty\n"
+	"  -f image      flash backing file, created erased if missing\n"
+	"  -l file@addr  copy a raw binary into flash before booting (repeatable)\n"
+	"  -T a,b,c      flash page program, page erase and sector erase costs in us\n"
+	"  -M size,sum   leave an upload request in the GPBR mailbox, as the firmware does\n"
+	"  -G n=value    preset a general purpose backup register (repeatable)\n",
+	name);
+}
+
+/*
+*	Set up the board model and run the BIOS
+*
+*/
+int main(int argc, char **argv)
+{
+	const char *image = NULL;
+	const char *loads[8];
+	int load_count = 0;
+	int use_stdio = 0;
+	int opt;
+	unsigned int reg, value;
+	
+	while ((opt = getopt(argc, argv, "sf:l:T:M:G:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				use_stdio = 1;
+				break;
+			case 'f':
+				image = optarg;
+				break;
+			case 'l':
+				if (load_count < 8) loads[load_count++] = optarg;
+				break;
+			case 'T':
+				if (sscanf(optarg, "%u,%u,%u", &sim_flash_timing.program_us,
+					&sim_flash_timing.erase_pages_us, &sim_flash_timing.erase_sector_us) != 3)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'M':
+				if (sscanf(optarg, "%i,%i", (int *)&GPBR->SYS_GPBR[MAILBOX_GPBR_SIZE],
+					(int *)&GPBR->SYS_GPBR[MAILBOX_GPBR_CHECKSUM]) != 2)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				GPBR->SYS_GPBR[MAILBOX_GPBR_COMMAND] = MAILBOX_COMMAND(MAILBOX_CMD_UPLOAD, MAILBOX_PROTO_XMODEM);
+				break;
+			case 'G':
+				if (sscanf(optarg, "%u=%i", &reg, (int *)&value) != 2 || reg >= 20)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				GPBR->SYS_GPBR[reg] = value;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	
+	if (!sim_flash_open(image))
+	{
+		fprintf(stderr, "sim: cannot map flash at %08x\n", SIM_FLASH_ADDR);
+		return 1;
+	}
+	for (int i = 0; i < load_count; i++)
+	{
+		char file[256];
+		unsigned int address;
+		
+		if (sscanf(loads[i], "%255[^@]@%i", file, (int *)&address) != 2
+			|| !sim_flash_load(file, address))
+		{
+			fprintf(stderr, "sim: cannot load %s\n", loads[i]);
+			return 1;
+		}
+	}
+	if (!(use_stdio ? sim_cdc_open_stdio() : sim_cdc_open_pty()))
+	{
+		fprintf(stderr, "sim: cannot open the USB CDC port\n");
+		return 1;
+	}
+	if (sim_cdc_open_trace_pty())
+	{
+		// Enumerated, with DTR modelled by whether the pty is open
+		trace_cdc_enable();
+		trace_cdc_set_dtr(true);
+	}
+	
+	if (setjmp(sim_reset_point) == 0)
+	{
+		sim_snapshot();
+	}
+	boot_time_reset();	// As Reset_Handler does
+	boot_fast_path();
+	return bios_main();
+}
@@ -0,0 +1,322 @@
+/**
+ * @file
+ * upload_bench.c
+ *
+ * This file contains the upload goodput benchmark
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX firmware.
+ * Copyright (c) 2016 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Paul Zanna <paul@northboundnetworks.com>
+ *		  & Kristopher Chen <Kristopher@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include "conf_bios.h"
+#include "flash.h"
+#include "sim.h"
+#include "sim_link.h"
+
+#define BENCH_MAX_SIZES		8
+#define BENCH_MAX_IMAGE		(FLASH_BUFFER_END - FLASH_BUFFER)	// The default update buffer
+#define BENCH_RUN_LIMIT_S	300		// Virtual seconds before a run is abandoned
+
+struct bench_scenario
+{
+	const char *name;
+	struct sim_link_config link;
+};
+
+// Global variables
+extern struct xmodem_stats xmodem_stats;
+
+// Local Variables
+static const struct sim_link_config link_defaults =
+{
+	.packet_size = 64,
+	.packet_ns = 53000,			// 19 full speed bulk packets per frame
+	.sof_ns = 1000000,
+	.turnaround_ns = 200000,
+	.host_timeout_ns = 1000000000,
+	.host_retries = 10,
+	.poll_ns = 250,
+	.byte_ns = 1000,
+	.seed = 1,
+};
+static jmp_buf run_abort;
+static int json;
+
+// Internal Functions
+static uint32_t bench_image(uint8_t *image, uint32_t size, uint32_t seed);
+static void bench_run(const struct bench_scenario *scenario, uint32_t size);
+static void usage(const char *name);
+
+/*
+*	Build a firmware image with the checksum and padding that
+*	verification_check() expects
+*
+*/
+static uint32_t bench_image(uint8_t *image, uint32_t size, uint32_t seed)
+{
+	uint32_t sum = 0;
+	uint32_t body = size - 8;
+	
+	for (uint32_t i = 0; i < body; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		image[i] = (seed >> 16) % 0xFF;		// Never 0xFF, so nothing is stripped
+		sum += image[i];
+	}
+	memcpy(image + body, &sum, 4);
+	memset(image + body + 4, 0, 4);
+	return size;
+}
+
+/*
+*	Upload one image through the link and print the result row
+*
+*/
+static void bench_run(const struct bench_scenario *scenario, uint32_t size)
+{
+	static uint8_t image[BENCH_MAX_IMAGE];
+	const struct sim_link_result *link;
+	const struct sim_link_config *cfg = &scenario->link;
+	const char *status;
+	uint64_t start, end;
+	int uploaded = 0;
+	int verified = 0;
+	
+	sim_flash_reset();
+	bench_image(image, size, cfg->seed);
+	start = sim_time_ns();
+	sim_link_start(cfg, image, size, (uint64_t)BENCH_RUN_LIMIT_S * 1000000000, &run_abort);
+	if (setjmp(run_abort) == 0)
+	{
+		uploaded = firmware_upload();
+		verified = uploaded && verification_check() == SUCCESS;
+	}
+	end = sim_time_ns();
+	link = sim_link_result();
+	
+	if (verified) status = "ok";
+	else if (link->gave_up) status = "host_gave_up";
+	else if (uploaded) status = "verify_failed";
+	else if (end - start >= (uint64_t)BENCH_RUN_LIMIT_S * 1000000000) status = "run_limit";
+	else status = "write_failed";
+	
+	uint64_t wall_us = (end - start) / 1000;
+	uint64_t transfer_us = 0;
+	uint32_t cyc_per_us = sysclk_get_cpu_hz() / 1000000;
+	
+	// Goodput only counts images that arrived intact
+	if (link->blocks_sent)
+	{
+		transfer_us = (end - link->first_data_ns) / 1000;
+	}
+	
+	if (json)
+	{
+		fprintf(stdout, "{\"scenario\":\"%s\",\"image_bytes\":%u,\"packet\":%u,\"sof_us\":%u,"
+		"\"turnaround_us\":%u,\"corrupt_ppm\":%u,\"drop_ppm\":%u,\"stall_ppm\":%u,"
+		"\"stall_us\":%u,\"result\":\"%s\",\"wall_us\":%llu,\"transfer_us\":%llu,"
+		"\"goodput_kbps\":%.1f,\"transfer_kbps\":%.1f,\"blocks_sent\":%u,\"retries\":%u,"
+		"\"host_timeouts\":%u,\"naks\":%u,\"timeouts\":%u,\"duplicates\":%u,"
+		"\"erase_us\":%u,\"flash_wait_us\":%u,\"usb_wait_us\":%u}\n",
+		scenario->name, size, cfg->packet_size, cfg->sof_ns / 1000, cfg->turnaround_ns / 1000,
+		cfg->corrupt_ppm, cfg->drop_ppm, cfg->stall_ppm, cfg->stall_ns / 1000, status,
+		(unsigned long long)wall_us, (unsigned long long)transfer_us,
+		verified ? size * 1000000.0 / 1024 / wall_us : 0.0,
+		verified ? size * 1000000.0 / 1024 / transfer_us : 0.0,
+		link->blocks_sent, link->retries, link->host_timeouts,
+		xmodem_stats.naks, xmodem_stats.timeouts, xmodem_stats.duplicates,
+		xmodem_stats.erase_cycles / cyc_per_us, xmodem_stats.program_cycles / cyc_per_us,
+		xmodem_stats.usb_wait_cycles / cyc_per_us);
+	}
+	else
+	{
+		fprintf(stdout, "%s,%u,%u,%u,%u,%u,%u,%u,%u,%s,%llu,%llu,%.1f,%.1f,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+		scenario->name, size, cfg->packet_size, cfg->sof_ns / 1000, cfg->turnaround_ns / 1000,
+		cfg->corrupt_ppm, cfg->drop_ppm, cfg->stall_ppm, cfg->stall_ns / 1000, status,
+		(unsigned long long)wall_us, (unsigned long long)transfer_us,
+		verified ? size * 1000000.0 / 1024 / wall_us : 0.0,
+		verified ? size * 1000000.0 / 1024 / transfer_us : 0.0,
+		link->blocks_sent, link->retries, link->host_timeouts,
+		xmodem_stats.naks, xmodem_stats.timeouts, xmodem_stats.duplicates,
+		xmodem_stats.erase_cycles / cyc_per_us, xmodem_stats.program_cycles / cyc_per_us,
+		xmodem_stats.usb_wait_cycles / cyc_per_us);
+	}
+	fflush(stdout);
+}
+
+/*
+*	Print the command line usage
+*
+*/
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	"usage: %s [-j] [-n kb,kb,...] [-p bytes] [-P us] [-f us] [-t us] [-H us]\n"
+	"          [-c ppm] [-d ppm] [-s ppm,us] [-C poll_ns,byte_ns] [-T a,b,c] [-r seed]\n"
+	"  -j          JSON lines instead of CSV\n"
+	"  -n          image sizes in KB (default 64,128,192)\n"
+	"  -p, -P      host to device packet size and time per packet\n"
+	"  -f          start of frame period, device to host data waits for it\n"
+	"  -t          host turnaround after each reply\n"
+	"  -H          host timeout before resending a block\n"
+	"  -c          byte corruption, per million bytes\n"
+	"  -d          packet drops, per million packets\n"
+	"  -s          packet stalls per million packets, and stall length\n"
+	"  -C          device cost of an empty poll and of reading one byte\n"
+	"  -T          flash page program, page erase and sector erase costs in us\n"
+	"Without link or fault options a fixed set of scenarios is run, starting\n"
+	"with today's link as the baseline.\n",
+	name);
+}
+
+/*
+*	Run the scenarios and print one row per scenario and image size
+*
+*/
+int main(int argc, char **argv)
+{
+	struct bench_scenario custom = { "custom", link_defaults };
+	struct bench_scenario scenarios[] =
+	{
+		{ "baseline", link_defaults },
+		{ "corrupt", link_defaults },
+		{ "drop", link_defaults },
+		{ "stall", link_defaults },
+		{ "slow_host", link_defaults },
+	};
+	uint32_t sizes[BENCH_MAX_SIZES] = { 64, 128, 192 };
+	int size_count = 3;
+	int use_custom = 0;
+	int opt;
+	
+	scenarios[1].link.corrupt_ppm = 50;
+	scenarios[2].link.drop_ppm = 1000;
+	scenarios[3].link.stall_ppm = 2000;
+	scenarios[3].link.stall_ns = 20000000;
+	scenarios[4].link.turnaround_ns = 2000000;
+	
+	while ((opt = getopt(argc, argv, "jn:p:P:f:t:H:c:d:s:C:T:r:h")) != -1)
+	{
+		struct sim_link_config *l = &custom.link;
+		unsigned int a, b;
+		
+		switch (opt)
+		{
+			case 'j':
+				json = 1;
+				continue;
+			case 'n':
+				size_count = 0;
+				for (char *tok = strtok(optarg, ","); tok && size_count < BENCH_MAX_SIZES; tok = strtok(NULL, ","))
+				{
+					sizes[size_count++] = strtoul(tok, NULL, 0);
+				}
+				continue;
+			case 'T':
+				if (sscanf(optarg, "%u,%u,%u", &sim_flash_timing.program_us,
+					&sim_flash_timing.erase_pages_us, &sim_flash_timing.erase_sector_us) != 3)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				continue;
+			case 'r':
+				for (int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+				{
+					scenarios[i].link.seed = strtoul(optarg, NULL, 0);
+				}
+				l->seed = strtoul(optarg, NULL, 0);
+				continue;
+			case 'p': l->packet_size = strtoul(optarg, NULL, 0); break;
+			case 'P': l->packet_ns = strtoul(optarg, NULL, 0) * 1000; break;
+			case 'f': l->sof_ns = strtoul(optarg, NULL, 0) * 1000; break;
+			case 't': l->turnaround_ns = strtoul(optarg, NULL, 0) * 1000; break;
+			case 'H': l->host_timeout_ns = strtoul(optarg, NULL, 0) * 1000; break;
+			case 'c': l->corrupt_ppm = strtoul(optarg, NULL, 0); break;
+			case 'd': l->drop_ppm = strtoul(optarg, NULL, 0); break;
+			case 's':
+				if (sscanf(optarg, "%u,%u", &a, &b) != 2)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				l->stall_ppm = a;
+				l->stall_ns = b * 1000;
+				break;
+			case 'C':
+				if (sscanf(optarg, "%u,%u", &a, &b) != 2)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				// Device costs apply to every scenario
+				for (int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+				{
+					scenarios[i].link.poll_ns = a;
+					scenarios[i].link.byte_ns = b;
+				}
+				l->poll_ns = a;
+				l->byte_ns = b;
+				continue;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+		use_custom = 1;
+	}
+	
+	sim_clock_virtual();
+	if (!sim_flash_open(NULL))
+	{
+		fprintf(stderr, "upload_bench: cannot map flash at %08x\n", SIM_FLASH_ADDR);
+		return 1;
+	}
+	sysclk_init();
+	
+	if (!json)
+	{
+		fprintf(stdout, "scenario,image_bytes,packet,sof_us,turnaround_us,corrupt_ppm,drop_ppm,"
+		"stall_ppm,stall_us,result,wall_us,transfer_us,goodput_kbps,transfer_kbps,"
+		"blocks_sent,retries,host_timeouts,naks,timeouts,duplicates,erase_us,"
+		"flash_wait_us,usb_wait_us\n");
+	}
+	for (int s = 0; s < (use_custom ? 1 : sizeof(scenarios) / sizeof(scenarios[0])); s++)
+	{
+		for (int i = 0; i < size_count; i++)
+		{
+			uint32_t size = sizes[i] * 1024;
+			
+			if (size > BENCH_MAX_IMAGE || size < 1024)
+			{
+				fprintf(stderr, "upload_bench: %u KB does not fit the update buffer\n", sizes[i]);
+				return 1;
+			}
+			bench_run(use_custom ? &custom : &scenarios[s], size);
+		}
+	}
+	return sim_flash_violations() ? 2 : 0;
+}
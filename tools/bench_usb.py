@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# bench_usb.py
+#
+# Host side of the Zodiac FX BIOS 'bench usb' command. Sends the BIOS a
+# fixed block of data over the USB CDC port, reads the same amount back and
+# prints the host-side throughput next to the table printed by the device.
+#
+# This file is part of the Zodiac FX firmware.
+# Copyright (c) 2016 Northbound Networks.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: bench_usb.py /dev/ttyACM0
+#
+# Requires pyserial.
+
+import sys
+import time
+
+import serial
+
+CHUNK = 4096
+
+
+def wait_for(port, token, timeout=10.0):
+    """Read lines until one starting with token is seen."""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        line = port.readline().decode('ascii', 'replace').strip()
+        if line.startswith(token):
+            return line
+    raise RuntimeError('timed out waiting for %r' % token)
+
+
+def main():
+    if len(sys.argv) != 2:
+        print('usage: %s <serial port>' % sys.argv[0])
+        return 1
+
+    port = serial.Serial(sys.argv[1], 115200, timeout=1)
+    port.reset_input_buffer()
+    port.write(b'\r')
+    time.sleep(0.2)
+    port.reset_input_buffer()
+
+    port.write(b'bench usb\r')
+    ready = wait_for(port, 'BENCH-USB READY')
+    length = int(ready.split()[-1])
+
+    # Host -> device
+    payload = bytes(range(256)) * (CHUNK // 256)
+    start = time.perf_counter()
+    sent = 0
+    while sent < length:
+        n = min(CHUNK, length - sent)
+        port.write(payload[:n])
+        sent += n
+    port.flush()
+    tx_time = time.perf_counter() - start
+
+    # Device -> host
+    start = time.perf_counter()
+    received = 0
+    while received < length:
+        data = port.read(min(CHUNK, length - received))
+        if not data:
+            raise RuntimeError('device stopped sending after %d bytes' % received)
+        received += len(data)
+    rx_time = time.perf_counter() - start
+
+    # Device table
+    wait_for(port, 'Test')
+    print('Device:')
+    print(wait_for(port, 'usb cdc rx'))
+    print(wait_for(port, 'usb cdc tx'))
+    print('Host:')
+    print('%-20s %10.0f KB/s' % ('host to device', length / 1024.0 / tx_time))
+    print('%-20s %10.0f KB/s' % ('device to host', length / 1024.0 / rx_time))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+#
+# bincmd.py
+#
+# Host side of the Zodiac FX BIOS binary command mode (see binmode.h).
+# Drives one device without parsing the command line output, and can be
+# imported by fleet tools for the BinMode class.
+#
+# This file is part of the Zodiac FX firmware.
+# Copyright (c) 2016 Northbound Networks.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+# Usage: bincmd.py <serial port> status
+#        bincmd.py <serial port> slot <0|1>
+#        bincmd.py <serial port> verify <0|1>
+#        bincmd.py <serial port> stats
+#        bincmd.py <serial port> upload <image>
+#        bincmd.py <serial port> dump <start> <length> <file>
+#        bincmd.py <serial port> restart
+#
+# Requires pyserial.
+
+import struct
+import sys
+import time
+
+import serial
+
+MAGIC = b'\x16\x16\x16\x02'
+SYNC_REQUEST = 0xA5
+SYNC_REPLY = 0xA6
+
+OP_STATUS = 0x01
+OP_SLOT = 0x02
+OP_UPLOAD = 0x03
+OP_DUMP = 0x04
+OP_VERIFY = 0x05
+OP_RESTART = 0x06
+OP_STATS = 0x07
+OP_EXIT = 0x08
+
+ERRORS = {0: 'ok', 1: 'bad request crc', 2: 'unknown opcode', 3: 'bad length',
+          4: 'out of range', 5: 'transfer failed', 6: 'bad image',
+          7: 'busy with a dfu download'}
+SLOT_FLAGS = ['active', 'empty', 'pending', 'stage-1', 'spanned']
+
+SOH, STX, EOT, ACK, NAK, CAN = 0x01, 0x02, 0x04, 0x06, 0x15, 0x18
+
+
+def crc16(data, crc=0):
+    """CRC-16/XMODEM, as xmodem_crc16() in the BIOS."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+class BinModeError(Exception):
+    pass
+
+
+class BinMode:
+    def __init__(self, port):
+        self.port = port
+        self.seq = 0
+        port.write(b'\r' + MAGIC)
+        time.sleep(0.1)
+        port.reset_input_buffer()
+
+    def read(self, n):
+        data = self.port.read(n)
+        if len(data) != n:
+            raise BinModeError('timed out waiting for the device')
+        return data
+
+    def reply(self, opcode):
+        """Read up to the next reply frame for opcode and check its CRC."""
+        while True:
+            if self.read(1)[0] != SYNC_REPLY:
+                continue
+            header = self.read(5)
+            op, seq, status, length = struct.unpack('<BBBH', header)
+            payload = self.read(length)
+            crc = struct.unpack('<H', self.read(2))[0]
+            if crc != crc16(header + payload) or op != opcode or seq != self.seq:
+                continue
+            if status != 0:
+                raise BinModeError(ERRORS.get(status, 'error %d' % status))
+            return payload
+
+    def request(self, opcode, payload=b''):
+        self.seq = (self.seq + 1) & 0xFF
+        body = struct.pack('<BBH', opcode, self.seq, len(payload)) + payload
+        self.port.write(bytes([SYNC_REQUEST]) + body + struct.pack('<H', crc16(body)))
+        return self.reply(opcode)
+
+    def status(self):
+        version, flash, active, staging, ab, trial = struct.unpack('<8sIBBBB', self.request(OP_STATUS))
+        return {'version': version.rstrip(b'\0').decode(), 'flash_size': flash, 'active': active,
+                'staging': staging, 'ab_slots': ab, 'trial': trial}
+
+    def slot(self, slot):
+        base, size, slot, flags = struct.unpack('<IIBB', self.request(OP_SLOT, bytes([slot])))
+        return {'slot': slot, 'base': base, 'size': size,
+                'flags': [name for bit, name in enumerate(SLOT_FLAGS) if flags & (1 << bit)]}
+
+    def verify(self, slot):
+        length, found, calculated = struct.unpack('<III', self.request(OP_VERIFY, bytes([slot])))
+        return {'length': length, 'found': found, 'calculated': calculated}
+
+    def stats(self):
+        words = struct.unpack('<9I', self.request(OP_STATS))
+        names = ['bytes', 'blocks', 'naks', 'timeouts', 'duplicates', 'erase_us',
+                 'program_us', 'usb_wait_us', 'total_us']
+        return dict(zip(names, words))
+
+    def upload(self, image):
+        """Send an image with XMODEM (128 byte blocks, checksum)."""
+        self.request(OP_UPLOAD)
+        while self.read(1)[0] != NAK:
+            pass
+        blocks = [image[i:i + 128].ljust(128, b'\x1a') for i in range(0, len(image), 128)]
+        for number, block in enumerate(blocks, 1):
+            frame = bytes([SOH, number & 0xFF, 255 - (number & 0xFF)]) + block + bytes([sum(block) & 0xFF])
+            for _ in range(10):
+                self.port.write(frame)
+                if self.read(1)[0] == ACK:
+                    break
+            else:
+                raise BinModeError('block %d not acknowledged' % number)
+        self.port.write(bytes([EOT]))
+        while self.read(1)[0] != ACK:
+            pass
+        length, found, calculated = struct.unpack('<III', self.reply(OP_UPLOAD))
+        return {'length': length, 'found': found, 'calculated': calculated}
+
+    def dump(self, start, length):
+        """Receive a flash range with XMODEM-1K (CRC-16)."""
+        self.request(OP_DUMP, struct.pack('<II', start, length))
+        self.port.write(b'C')
+        data = b''
+        expect = 1
+        while True:
+            head = self.read(1)[0]
+            if head == EOT:
+                self.port.write(bytes([ACK]))
+                break
+            size = 1024 if head == STX else 128
+            block = self.read(2 + size + 2)
+            payload = block[2:2 + size]
+            if (block[0] + block[1] == 255 and block[0] == expect & 0xFF
+                    and crc16(payload) == struct.unpack('>H', block[2 + size:])[0]):
+                data += payload
+                expect += 1
+                self.port.write(bytes([ACK]))
+            else:
+                self.port.write(bytes([NAK]))
+        self.reply(OP_DUMP)
+        return data
+
+    def restart(self):
+        self.request(OP_RESTART)
+
+    def exit(self):
+        self.request(OP_EXIT)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print('usage: %s <serial port> status|slot|verify|stats|upload|dump|restart ...' % sys.argv[0])
+        return 1
+
+    port = serial.Serial(sys.argv[1], 115200, timeout=5)
+    bios = BinMode(port)
+    command, args = sys.argv[2], sys.argv[3:]
+    try:
+        if command == 'status':
+            print(bios.status())
+        elif command == 'slot':
+            print(bios.slot(int(args[0])))
+        elif command == 'verify':
+            print(bios.verify(int(args[0])))
+        elif command == 'stats':
+            print(bios.stats())
+        elif command == 'upload':
+            print(bios.upload(open(args[0], 'rb').read()))
+        elif command == 'dump':
+            data = bios.dump(int(args[0], 16), int(args[1], 16))
+            open(args[2], 'wb').write(data)
+            print('%d bytes' % len(data))
+        elif command == 'restart':
+            bios.restart()
+            return 0
+        else:
+            print('unknown command %s' % command)
+            return 1
+    except BinModeError as error:
+        print('error: %s' % error)
+        return 1
+    bios.exit()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+#
+# mkstage1.py
+#
+# Cuts the stage-1 part out of a Zodiac FX BIOS binary and adds the
+# checksum trailer, for an in-field BIOS update. Upload the result with
+# 'upload' like a firmware image; the BIOS leaves it in the buffer and
+# stage-0 copies it into place on the next reset.
+#
+# This file is part of the Zodiac FX firmware.
+# Copyright (c) 2016 Northbound Networks.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+# Usage: mkstage1.py ZodiacFX_BIOS.bin stage1.bin
+#
+# The BIOS binary has to start at the beginning of flash, with the gaps
+# filled with 0xFF: arm-none-eabi-objcopy -O binary --gap-fill 0xFF.
+
+import struct
+import sys
+
+FLASH_BASE = 0x400000
+STAGE1_BASE = 0x402000      # conf_bios.h
+STAGE1_END = 0x419000
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('usage: %s <BIOS binary> <stage-1 image>' % sys.argv[0])
+        return 1
+
+    bios = open(sys.argv[1], 'rb').read()
+    if len(bios) > STAGE1_END - FLASH_BASE:
+        print('%s is too big for the BIOS region' % sys.argv[1])
+        return 1
+    bios = bios.ljust(STAGE1_END - FLASH_BASE, b'\xff')
+
+    stage1 = bios[STAGE1_BASE - FLASH_BASE:]
+    reset_handler = struct.unpack_from('<I', stage1, 4)[0] & ~1
+    if not STAGE1_BASE <= reset_handler < STAGE1_END:
+        print('%s was not linked for stage-1 at 0x%x' % (sys.argv[1], STAGE1_BASE))
+        return 1
+
+    checksum = sum(stage1) & 0xFFFFFFFF
+    with open(sys.argv[2], 'wb') as out:
+        out.write(stage1 + struct.pack('<II', checksum, 0))
+    print('%d bytes, checksum %08x' % (len(stage1), checksum))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# trace_decode.py
+#
+# Host side decoder for the Zodiac FX BIOS trace ring. Reads the hex dump
+# printed by 'trace raw', or the records the BIOS streams on its second
+# CDC port, and resolves each record's format id (the address of its
+# format string) against the BIOS ELF file, so the strings never need to
+# be formatted on the device.
+#
+# This file is part of the Zodiac FX firmware.
+# Copyright (c) 2016 Northbound Networks.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: trace_decode.py ZodiacFX_BIOS.elf [dump.txt]
+#        trace_decode.py ZodiacFX_BIOS.elf -p <trace port>
+#
+# The dump is read from stdin when no file is given. With -p the records
+# are read live from the trace port until interrupted; this needs
+# pyserial. The core clock is used to convert the cycle timestamps into
+# microseconds.
+
+import re
+import struct
+import sys
+
+CPU_HZ = 120000000
+LEVELS = {1: 'ERR', 2: 'INF', 3: 'DBG'}
+RECORD_WORDS = 7
+
+
+def load_sections(path):
+    """Return (addr, data) for every allocated, loaded ELF32 section."""
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1:
+        raise RuntimeError('%s is not an ELF32 file' % path)
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum = struct.unpack_from('<HH', elf, 0x2e)
+    sections = []
+    for i in range(shnum):
+        (name, sh_type, flags, addr, offset, size) = struct.unpack_from(
+            '<IIIIII', elf, shoff + i * shentsize)
+        # SHF_ALLOC and not SHT_NOBITS
+        if flags & 0x2 and sh_type != 8 and size:
+            sections.append((addr, elf[offset:offset + size]))
+    return sections
+
+
+def read_string(sections, addr):
+    for base, data in sections:
+        if base <= addr < base + len(data):
+            end = data.find(b'\0', addr - base)
+            return data[addr - base:end].decode('ascii', 'replace')
+    return None
+
+
+def c_format(fmt, args):
+    """Apply a printf format to the raw argument words."""
+    out = []
+    pos = 0
+    argi = 0
+    for m in re.finditer(r'%([-+ 0#]*\d*(?:\.\d+)?)(?:l|h|hh)?([diuxXcs%])', fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, conv = m.group(1), m.group(2)
+        if conv == '%':
+            out.append('%')
+            continue
+        value = args[argi] if argi < len(args) else 0
+        argi += 1
+        if conv in 'di':
+            value = struct.unpack('<i', struct.pack('<I', value))[0]
+            conv = 'd'
+        elif conv == 'u':
+            conv = 'd'
+        elif conv == 's':
+            value = '<str %08x>' % value
+        out.append(('%' + flags + conv) % value)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def dump_records(dump):
+    """Yield the records of a 'trace raw' dump as lists of words."""
+    for line in dump:
+        words = line.split()
+        if len(words) != RECORD_WORDS:
+            continue
+        try:
+            yield [int(w, 16) for w in words]
+        except ValueError:
+            continue
+
+
+def port_records(path):
+    """Yield the records streamed on the trace port, as lists of words."""
+    import serial
+    port = serial.Serial(path, timeout=None)
+    while True:
+        data = port.read(RECORD_WORDS * 4)
+        if len(data) != RECORD_WORDS * 4:
+            return
+        yield list(struct.unpack('<%dI' % RECORD_WORDS, data))
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[2] == '-p':
+        records = port_records(sys.argv[3])
+    elif len(sys.argv) in (2, 3):
+        records = dump_records(open(sys.argv[2]) if len(sys.argv) == 3 else sys.stdin)
+    else:
+        print('usage: %s <bios.elf> [dump.txt | -p <trace port>]' % sys.argv[0])
+        return 1
+    sections = load_sections(sys.argv[1])
+
+    first = None
+    try:
+        for rec in records:
+            fmt_addr, stamp, info = rec[0], rec[1], rec[2]
+            level, nargs = info & 0xff, (info >> 8) & 0xff
+            if first is None:
+                first = stamp
+            fmt = read_string(sections, fmt_addr)
+            if fmt is None:
+                text = '<unknown format %08x> %s' % (
+                    fmt_addr, ' '.join('%08x' % a for a in rec[3:3 + nargs]))
+            else:
+                text = c_format(fmt, rec[3:3 + nargs])
+            usec = ((stamp - first) & 0xffffffff) * 1000000.0 / CPU_HZ
+            print('%12.1f %s %s' % (usec, LEVELS.get(level, '?'), text), flush=True)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())